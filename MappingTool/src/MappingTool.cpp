@@ -1,7 +1,7 @@
 /// 
-/// TODO:	| |  1) Render grid of ghost spheres every 1x1 tile unit (size TBD); as in, render white textures with alpha < 1 on spheres
+/// TODO:	|X|  1) Render grid of ghost spheres every 1x1 tile unit (size TBD); as in, render white textures with alpha < 1 on spheres
 ///			|X|  2) Allow movement throughout grid using wasd and mouse_look (toggled on and off using 'z' key)
-///			| |  3) Make listener for mouse click, check if it hits any rendered face (choose the frontmost), if so, return a tag identifying that object.
+///			|X|  3) Make listener for mouse click, check if it hits any rendered face (choose the frontmost), if so, return a tag identifying that object.
 ///			| |  4) Allow creation of planes by clicking on ghost spheres and dragging to make shape (kind of like Fusion 360)
 ///			| |  5) Make GUI to contain GLFW window and display available textures on the side (selectable using mouse click).
 ///			| |  6) Allow application of square tile textures to planes (as in, textures tile across rectangles)
@@ -18,6 +18,11 @@
 #include <jgl/jbufferqueue.h>
 #include <jgl/jgl.h>
 #include <jgl/jmodule.h>
+#include <jgl/jecs.h>
+#include <jgl/jgrid.h>
+#include <jgl/jselect.h>
+#include <jgl/jsnap.h>
+#include <jgl/jundo.h>
 #include <map>
 
 
@@ -35,6 +40,27 @@ float deltaTime;
 #define CTRL_LEFT		006
 #define CTRL_RIGHT 		007
 #define DEBUG_POSITION	010
+#define DEBUG_MEMORY	011
+#define DEBUG_JOBS		012
+#define DEBUG_OCTREE	013
+#define DEBUG_BVH		014
+#define DEBUG_SIMD		015
+#define CTRL_GPUPICK	016
+#define DEBUG_SELECT	017
+//Keys 1-5 flip camera.visibleLayers bits 0-4.
+#define CTRL_LAYER		020
+#define DEBUG_SNAP		030
+#define CTRL_LEVEL_UP	031
+#define CTRL_LEVEL_DOWN	032
+#define CTRL_IMPOSTORS	033
+#define CTRL_UNDO		034
+#define CTRL_REDO		035
+#define DEBUG_UNDO		036
+#define CTRL_GRID		037
+//The arrow keys move the selection a tile along -X, +X, -Z, +Z.
+#define CTRL_NUDGE		040
+#define DEBUG_TEXPACK	044
+#define DEBUG_GRID		045
 
 //A keyType is basically just a vector that stores a keyID int and an actionID int.
 struct keyType {
@@ -44,10 +70,12 @@ struct keyType {
 		action = actionI; 
 	}
 
-	//Needed so that it can be input into the map (for sorting).
+	//Needed so that it can be input into the map (for sorting). The
+	//action counts too, or a binding for a press would also fire on
+	//the release and on every repeat.
 	bool operator<(const keyType& rhs) const noexcept
 	{
-		return (key < rhs.key);
+		return key < rhs.key || (key == rhs.key && action < rhs.action);
 	}
 };
 
@@ -60,14 +88,45 @@ std::map<keyType, int> keyBindings = {
 	{keyType(GLFW_KEY_S, GLFW_PRESS), CTRL_BACK},
 	{keyType(GLFW_KEY_A, GLFW_PRESS), CTRL_LEFT},
 	{keyType(GLFW_KEY_D, GLFW_PRESS), CTRL_RIGHT},
-	{keyType(GLFW_KEY_P, GLFW_PRESS), DEBUG_POSITION}
+	{keyType(GLFW_KEY_P, GLFW_PRESS), DEBUG_POSITION},
+	{keyType(GLFW_KEY_M, GLFW_PRESS), DEBUG_MEMORY},
+	{keyType(GLFW_KEY_J, GLFW_PRESS), DEBUG_JOBS},
+	{keyType(GLFW_KEY_O, GLFW_PRESS), DEBUG_OCTREE},
+	{keyType(GLFW_KEY_B, GLFW_PRESS), DEBUG_BVH},
+	{keyType(GLFW_KEY_K, GLFW_PRESS), DEBUG_SIMD},
+	{keyType(GLFW_KEY_G, GLFW_PRESS), CTRL_GPUPICK},
+	{keyType(GLFW_KEY_X, GLFW_PRESS), DEBUG_SELECT},
+	{keyType(GLFW_KEY_V, GLFW_PRESS), DEBUG_SNAP},
+	{keyType(GLFW_KEY_PAGE_UP, GLFW_PRESS), CTRL_LEVEL_UP},
+	{keyType(GLFW_KEY_PAGE_DOWN, GLFW_PRESS), CTRL_LEVEL_DOWN},
+	{keyType(GLFW_KEY_I, GLFW_PRESS), CTRL_IMPOSTORS},
+	{keyType(GLFW_KEY_U, GLFW_PRESS), CTRL_UNDO},
+	{keyType(GLFW_KEY_Y, GLFW_PRESS), CTRL_REDO},
+	{keyType(GLFW_KEY_H, GLFW_PRESS), DEBUG_UNDO},
+	{keyType(GLFW_KEY_F, GLFW_PRESS), CTRL_GRID},
+	{keyType(GLFW_KEY_T, GLFW_PRESS), DEBUG_TEXPACK},
+	{keyType(GLFW_KEY_C, GLFW_PRESS), DEBUG_GRID},
+	{keyType(GLFW_KEY_LEFT, GLFW_PRESS), CTRL_NUDGE + 0},
+	{keyType(GLFW_KEY_RIGHT, GLFW_PRESS), CTRL_NUDGE + 1},
+	{keyType(GLFW_KEY_UP, GLFW_PRESS), CTRL_NUDGE + 2},
+	{keyType(GLFW_KEY_DOWN, GLFW_PRESS), CTRL_NUDGE + 3},
+	{keyType(GLFW_KEY_1, GLFW_PRESS), CTRL_LAYER + 0},
+	{keyType(GLFW_KEY_2, GLFW_PRESS), CTRL_LAYER + 1},
+	{keyType(GLFW_KEY_3, GLFW_PRESS), CTRL_LAYER + 2},
+	{keyType(GLFW_KEY_4, GLFW_PRESS), CTRL_LAYER + 3},
+	{keyType(GLFW_KEY_5, GLFW_PRESS), CTRL_LAYER + 4}
 };
 
 //Booleans
 int freeView = 0;
+int gpuPicking = 0; //Hover from the GPU ID buffer instead of CPU raycasts.
 float mouseSpeed = 0.1f, moveSpeed = 5.0f;
 double xpos, ypos;
 
+//What the last drag selected; see finishDrag().
+std::vector<Entity> selection;
+WorldObject* cube;
+
 float toggleTime;
 void toggleFreeView() {
 	if (glfwGetTime() < 1 + toggleTime)
@@ -111,10 +170,41 @@ void lookCamera() {
 	camera.updateView();
 }
 
+//Moves the selection by offset, through the undo stack so U and Y
+//take it back and forth.
+void nudgeSelection(glm::vec3 offset) {
+	std::vector<Entity> moved;
+	std::vector<glm::mat4> after;
+	for (Entity e : selection) {
+		if (!scene.transforms.has(e))
+			continue;
+		moved.push_back(e);
+		after.push_back(glm::translate(glm::mat4(1.0f), offset) * scene.transforms.local[scene.transforms.indexOf(e)]);
+	}
+	if (moved.empty())
+		return;
+	undoStack.setLocal(scene, moved.data(), after.data(), (uint32_t)moved.size());
+}
+
 //Check which key is keyed and what action is actioned and respond accordingly.
 void KeyEvent(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-	int command = keyBindings[keyType(key, action)];
+	//find() rather than [], which would add an entry for every
+	//unbound key and action.
+	auto binding = keyBindings.find(keyType(key, action));
+	if (binding == keyBindings.end())
+		return;
+	int command = binding->second;
+	if (command >= CTRL_LAYER && command < CTRL_LAYER + 5) {
+		//Culling reads the mask every frame; nothing else to redo.
+		camera.visibleLayers ^= 1ull << (command - CTRL_LAYER);
+		return;
+	}
+	if (command >= CTRL_NUDGE && command < CTRL_NUDGE + 4) {
+		const glm::vec3 offsets[4] = { glm::vec3(-1, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 0, 1) };
+		nudgeSelection(offsets[command - CTRL_NUDGE] * referenceGrid.spacing);
+		return;
+	}
 	switch (command) {
 		case CTRL_EXIT:
 			glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -125,24 +215,212 @@ void KeyEvent(GLFWwindow* window, int key, int scancode, int action, int mods)
 		case DEBUG_POSITION:
 			std::cout << "X: " << camera.position[0] << " Y: " << camera.position[1] << " Z: " << camera.position[2] << "\n";
 			break;
+		case DEBUG_MEMORY:
+			dedupStats.print();
+			printAllocStats();
+			mapGrid.printStats();
+			undoStack.printStats();
+			break;
+		case DEBUG_JOBS:
+			jobBenchmark();
+			break;
+		case DEBUG_OCTREE:
+			octreeBenchmark();
+			break;
+		case DEBUG_BVH:
+			bvhBenchmark();
+			break;
+		case DEBUG_SIMD:
+			rayKernelBenchmark();
+			break;
+		case CTRL_GPUPICK:
+			gpuPicking = (gpuPicking == 0);
+			std::cout << "Picking on the " << (gpuPicking ? "GPU" : "CPU") << "\n";
+			break;
+		case DEBUG_SELECT:
+			selectionBenchmark();
+			break;
+		case DEBUG_SNAP:
+			snapBenchmark();
+			break;
+		case CTRL_LEVEL_UP:
+		case CTRL_LEVEL_DOWN:
+			ghostGrid.level += command == CTRL_LEVEL_UP ? 1 : -1;
+			std::cout << "Ghost grid at Y: " << ghostGrid.level << "\n";
+			break;
+		case CTRL_IMPOSTORS:
+			ghostGrid.mode = ghostGrid.mode == GHOST_IMPOSTOR ? GHOST_MESH : GHOST_IMPOSTOR;
+			std::cout << "Ghost spheres as " << (ghostGrid.mode == GHOST_IMPOSTOR ? "impostors" : "meshes") << "\n";
+			break;
+		case CTRL_UNDO:
+			if (!undoStack.undo(scene, renderThread.packet()))
+				std::cout << "Nothing to undo\n";
+			break;
+		case CTRL_REDO:
+			if (!undoStack.redo(scene, renderThread.packet()))
+				std::cout << "Nothing to redo\n";
+			break;
+		case DEBUG_UNDO:
+			undoBenchmark();
+			break;
+		case CTRL_GRID:
+			referenceGrid.visible = (referenceGrid.visible == 0);
+			break;
+		case DEBUG_TEXPACK: {
+			//The paths the cube's Material built for box.obj, loaded by
+			//absolute path.
+			Material* mat = cube ? cube->findModule<Material>() : NULL;
+			texturePackCheck(mat ? mat->getTexturePaths() : std::vector<std::string>());
+			break;
+		}
+		case DEBUG_GRID:
+			gridBenchmark();
+			break;
 		default:
 			break;
 	}
 }
-/*
-	virtual void reset() = 0;
-	virtual bool loadModel(std::string) = 0;				//Model
-	virtual std::string getFilepath() = 0;					//Model
-	virtual std::vector<GLuint> getVertexBuffers() = 0;		//Model
-	virtual std::vector<GLuint> getIndexBuffers() = 0;		//Model
-	virtual std::vector<GLuint> getMaterialIndices() = 0;	//Model
-	virtual std::vector<GLuint> getIndexCounts() = 0;		//Model
-	virtual const aiScene* getScene() = 0;					//Model
-	virtual bool loadModel() = 0;							//Material
-	virtual void render(GLint progID) = 0;					//Material
-	virtual void bind(Texture* t, GLuint inp) = 0;			//Material
-	virtual void unbind(GLuint inp) = 0;					//Material
-*/
+
+//Whatever is under the cursor (the screen center in free view), updated every frame.
+PickHit hover;
+//Nearest vertex or edge midpoint within SNAP_PIXELS of the cursor, likewise.
+const float SNAP_PIXELS = 10.0f;
+SnapHit snap;
+
+//ID picks don't come with barycentrics; the rest maps over.
+PickHit fromIdPick(const IdPickResult& r) {
+	PickHit h;
+	if (!r.hit() || !scene.alive(r.entity))
+		return h;
+	h.entity = r.entity;
+	h.triangle = r.triangle;
+	h.position = r.position;
+	h.distance = glm::length(r.position - camera.position);
+	if (scene.models.has(r.entity)) {
+		uint32_t i = scene.models.indexOf(r.entity);
+		if (r.part < scene.models.meshCount[i])
+			h.mesh = scene.meshList[scene.models.firstMesh[i] + r.part];
+	}
+	return h;
+}
+
+void printHover() {
+	if (snap.hit()) {
+		std::cout << "SNAP: " << (snap.kind == SNAP_VERTEX ? "vertex" : "edge midpoint") << " of entity " << snap.entity << " at X: " << snap.position.x
+			<< " Y: " << snap.position.y << " Z: " << snap.position.z << ", " << snap.distance << " px away\n";
+	}
+	if (hover.entity == NULL_ENTITY) {
+		std::cout << "PICK: nothing\n";
+		return;
+	}
+	std::cout << "PICK: entity " << hover.entity << " mesh " << hover.mesh.value << " triangle " << hover.triangle
+		<< " uv (" << hover.u << ", " << hover.v << ") at " << hover.distance << "\n";
+}
+
+//Drag selection. Alt drags a lasso instead of a box; Ctrl only takes
+//what is wholly inside instead of everything touched.
+bool dragging = 0;
+int dragMods = 0;
+std::vector<glm::vec2> dragPath;
+
+void finishDrag() {
+	SelectionRegion region;
+	if (dragMods & GLFW_MOD_ALT)
+		region.setLasso(camera.VP, glWindow->XY_Resolution[0], glWindow->XY_Resolution[1], dragPath);
+	else
+		region.setBox(camera.VP, glWindow->XY_Resolution[0], glWindow->XY_Resolution[1], dragPath.front(), dragPath.back());
+	selection.clear();
+	selectRegion(scene, scenePicker, region, (dragMods & GLFW_MOD_CONTROL) ? SELECT_INSIDE : SELECT_TOUCHING, camera.visibleLayers, selection);
+	std::cout << "SELECT: " << selection.size() << " objects\n";
+}
+
+//Shift-drag on the ghost grid outlines a plane of 1x1 tiles between
+//the grid points under the press and the cursor. It is rebuilt every
+//frame into the packet's preview and streamed to the GPU from there.
+const int PLANE_MAX_TILES = 255;	//Per side, so a preview's vertices fit 16-bit indices
+bool planeDragging = 0;
+glm::ivec2 planeStart, planeEnd;	//Grid points (x, z) on ghostGrid.level
+
+//The grid point of the working level nearest to where the ray under
+//the cursor meets it. Returns 0 if the ray never does.
+bool ghostPointAt(double x, double y, glm::ivec2& out) {
+	glm::vec3 rayOrigin, rayDir;
+	camera.screenRay(x, y, rayOrigin, rayDir);
+	if (fabsf(rayDir.y) < 1e-6f)
+		return 0;
+	float t = ((float)ghostGrid.level - rayOrigin.y) / rayDir.y;
+	if (t < 0.0f)
+		return 0;
+	glm::vec3 p = rayOrigin + t * rayDir;
+	out = glm::ivec2((int)floorf(p.x + 0.5f), (int)floorf(p.z + 0.5f));
+	return 1;
+}
+
+//Tiles of the plane with corners a and b, as a grid of shared vertices.
+void buildPlanePreview(glm::ivec2 a, glm::ivec2 b, PreviewGeometry& out) {
+	glm::ivec2 lo = glm::min(a, b);
+	glm::ivec2 size = glm::min(glm::abs(b - a), glm::ivec2(PLANE_MAX_TILES));
+	out.clear();
+	out.color = glm::vec4(0.3f, 0.6f, 1.0f, 0.45f);
+	if (size.x == 0 || size.y == 0)
+		return;
+	float y = (float)ghostGrid.level;
+	for (int z = 0; z <= size.y; z++) {
+		for (int x = 0; x <= size.x; x++)
+			out.positions.push_back(glm::vec3((float)(lo.x + x), y, (float)(lo.y + z)));
+	}
+	for (int z = 0; z < size.y; z++) {
+		for (int x = 0; x < size.x; x++) {
+			unsigned short i = (unsigned short)(z * (size.x + 1) + x);
+			unsigned short below = (unsigned short)(i + size.x + 1);
+			unsigned short quad[6] = { i, below, (unsigned short)(i + 1), (unsigned short)(i + 1), below, (unsigned short)(below + 1) };
+			out.indices.insert(out.indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+void MouseEvent(GLFWwindow* window, int button, int action, int mods)
+{
+	if (button != GLFW_MOUSE_BUTTON_LEFT)
+		return;
+	//In free view the cursor is pinned to the middle; no dragging.
+	if (freeView) {
+		if (action == GLFW_PRESS)
+			printHover();
+		return;
+	}
+	double x, y;
+	glfwGetCursorPos(window, &x, &y);
+	if (action == GLFW_PRESS && (mods & GLFW_MOD_SHIFT)) {
+		planeDragging = ghostPointAt(x, y, planeStart);
+		planeEnd = planeStart;
+	}
+	else if (action == GLFW_RELEASE && planeDragging) {
+		planeDragging = 0;
+		glm::ivec2 size = glm::min(glm::abs(planeEnd - planeStart), glm::ivec2(PLANE_MAX_TILES));
+		//The tiles go into mapGrid, sitting on the working level;
+		//building geometry for them is still to do (TODO 4).
+		if (size.x && size.y) {
+			glm::ivec2 lo = glm::min(planeStart, planeEnd);
+			mapGrid.fill(glm::ivec3(lo.x, ghostGrid.level, lo.y), glm::ivec3(lo.x + size.x - 1, ghostGrid.level, lo.y + size.y - 1), 1);
+			std::cout << "PLANE: " << size.x << "x" << size.y << " tiles from X: " << planeStart.x << " Z: " << planeStart.y
+				<< " to X: " << planeEnd.x << " Z: " << planeEnd.y << " at Y: " << ghostGrid.level << "\n";
+		}
+	}
+	else if (action == GLFW_PRESS) {
+		dragging = 1;
+		dragMods = mods;
+		dragPath.assign(1, glm::vec2((float)x, (float)y));
+	}
+	else if (action == GLFW_RELEASE && dragging) {
+		dragging = 0;
+		dragPath.push_back(glm::vec2((float)x, (float)y));
+		if (glm::length(dragPath.back() - dragPath.front()) < 4.0f)
+			printHover(); //A click, not a drag.
+		else
+			finishDrag();
+	}
+}
 bool t = 1;
 int main(void) {
 	if (!glInit())
@@ -154,22 +432,24 @@ int main(void) {
 	glDeactivate();
 }
 
-WorldObject cube;
-
 void Initialize() {
 	t = 0;
 
-	Model* model = new Model();
-	Material* mat = new Material();
+	cube = worldObjectPool.create();
+	Model* model = modelPool.create();
+	Material* mat = materialPool.create();
 
-	cube.insertModule(model);
-	cube.insertModule(mat);
+	cube->insertModule(model);
+	cube->insertModule(mat);
 	std::cout << "Modules inserted\n";
 	
 	model->loadModel("D:/SOFTWARE DEV/MappingTool/MappingTool/src/assets/box.obj");
 	std::cout << "Model loaded\n";
 	mat->loadModel(glWindow->programID);
 	std::cout << "Textures gotten\n";
+	dedupStats.print();
+
+	scene.attach(cube);
 }
 
 void Loop() {
@@ -177,6 +457,8 @@ void Loop() {
 
 	if (freeView)
 		lookCamera();
+	if (dragging && glm::vec2((float)xpos, (float)ypos) != dragPath.back())
+		dragPath.push_back(glm::vec2((float)xpos, (float)ypos));
 
 	if (glfwGetKey(glWindow->window, GLFW_KEY_W) == GLFW_PRESS)
 		moveCamera(CTRL_FWD);
@@ -188,11 +470,48 @@ void Loop() {
 		moveCamera(CTRL_RIGHT);
 }
 
-void WorldRenderPoll() {
+std::vector<Entity> visible;
 
-	cube.findModule(MOD_MATERIAL)->pushVAO();
+void WorldRenderPoll() {
+	visible.clear();
+	scene.transforms.update();
+	boundsSystem(scene);
+	scenePicker.update(scene);
+	vertexSnapper.update(scene);
+	if (gpuPicking) {
+		//Asked for this frame, answered a frame or two later. Culling
+		//already dropped hidden layers from the draws it renders.
+		renderThread.packet().pick = { 1, (int)xpos, (int)ypos };
+		IdPickResult r;
+		if (idPicker.poll(r))
+			hover = fromIdPick(r);
+	}
+	else {
+		glm::vec3 rayOrigin, rayDir;
+		camera.screenRay(xpos, ypos, rayOrigin, rayDir);
+		hover = PickHit();
+		scenePicker.raycast(rayOrigin, rayDir, hover, camera.visibleLayers);
+	}
+	snap = SnapHit();
+	vertexSnapper.nearestScreen(glm::vec2((float)xpos, (float)ypos), camera.VP, glWindow->XY_Resolution[0], glWindow->XY_Resolution[1],
+		SNAP_PIXELS, snap, SNAP_ALL, camera.visibleLayers);
+	//The floor grid sits on the ghosts' level, its lines on their points.
+	referenceGrid.submit((float)ghostGrid.level, renderThread.packet());
+	//Key 5 hides them along with anything else on LAYER_GHOSTS.
+	if (camera.visibleLayers & LAYER_GHOSTS)
+		ghostGrid.submit(camera.frustum, camera.position, renderThread.packet());
+	if (planeDragging) {
+		//Off the level (looking up at it, say), it keeps the last corner.
+		ghostPointAt(xpos, ypos, planeEnd);
+		buildPlanePreview(planeStart, planeEnd, renderThread.packet().preview);
+	}
+	cullSystem(scene, camera, visible);
+	residencySystem(scene, camera, visible, renderThread.packet());
+	submitSystem(scene, visible, renderThread.packet());
 }
 
 void Deactivate() {
-
+	scene.destroy(cube->entity);
+	worldObjectPool.destroy(cube);
+	closeMap();
 }
\ No newline at end of file
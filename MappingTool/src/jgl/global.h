@@ -1,10 +1,7 @@
 #ifndef GLOBAL_H
 #define GLOBAL_H
 
-#include <queue>
 #include <jgl/jbufferqueue.h>
 #include <jgl/jgl.h>
 
-std::queue<BufferContainer*> glVAOs;
-
 #endif
\ No newline at end of file
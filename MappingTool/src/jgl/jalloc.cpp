@@ -0,0 +1,127 @@
+#include "jalloc.h"
+#include <algorithm>
+#include <iostream>
+
+Arena mapArena("map arena");
+
+#pragma region AllocTracker:
+//Function static so pools defined in other files can register
+//during static initialization in any order.
+static std::vector<AllocTracker*>& trackers() {
+	static std::vector<AllocTracker*> list;
+	return list;
+}
+
+AllocTracker::AllocTracker(const char* nameIn) {
+	name = nameIn;
+	trackers().push_back(this);
+}
+
+AllocTracker::~AllocTracker() {
+	std::vector<AllocTracker*>& list = trackers();
+	list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+void printAllocStats() {
+	for (AllocTracker* t : trackers())
+		t->printStats();
+}
+
+void printPoolStats(const char* name, size_t live, size_t capacity, size_t peak, size_t blocks, size_t allocs, size_t frees) {
+	//Unused slots below the high-water mark are the pool's fragmentation.
+	int unused = capacity ? (int)(100 * (capacity - live) / capacity) : 0;
+	std::cout << "ALLOC: " << name << ": " << live << "/" << capacity << " slots live (peak " << peak << "), "
+		<< blocks << " blocks, " << allocs << " allocs, " << frees << " frees, " << unused << "% unused\n";
+}
+#pragma endregion
+
+#pragma region Arena:
+Arena::Arena(const char* nameIn, size_t blockSizeIn) : AllocTracker(nameIn) {
+	blockSize = blockSizeIn;
+}
+
+Arena::~Arena() {
+	for (Block& b : blocks)
+		delete[] b.data;
+}
+
+void* Arena::alloc(size_t size, size_t align) {
+	while (current < blocks.size()) {
+		Block& b = blocks[current];
+		//Align the address, not the offset: blocks themselves are only
+		//aligned to max_align_t, and packets want 32 bytes.
+		uintptr_t base = (uintptr_t)b.data;
+		size_t offset = (size_t)(((base + b.used + align - 1) & ~(uintptr_t)(align - 1)) - base);
+		if (offset + size <= b.size) {
+			b.used = offset + size;
+			allocs++;
+			peakUsed = std::max(peakUsed, getUsed());
+			return b.data + offset;
+		}
+		//Blocks past current are only left over from a rewind, and
+		//are empty. Skip a full one; an empty one that is too small
+		//gets a bigger block put in front of it.
+		if (b.used == 0)
+			break;
+		current++;
+	}
+
+	Block b;
+	b.size = std::max(blockSize, size + align);
+	b.data = new unsigned char[b.size];
+	b.used = 0;
+	blocks.insert(blocks.begin() + current, b);
+	return alloc(size, align);
+}
+
+ArenaMark Arena::mark() {
+	ArenaMark m;
+	if (current < blocks.size()) {
+		m.block = current;
+		m.offset = blocks[current].used;
+	}
+	return m;
+}
+
+void Arena::rewind(ArenaMark m) {
+	for (size_t i = m.block; i < blocks.size(); i++)
+		blocks[i].used = (i == m.block) ? m.offset : 0;
+	current = m.block;
+}
+
+void Arena::reset() {
+	for (size_t i = 1; i < blocks.size(); i++)
+		delete[] blocks[i].data;
+	if (blocks.size() > 1)
+		blocks.resize(1);
+	if (!blocks.empty())
+		blocks[0].used = 0;
+	current = 0;
+	allocs = 0;
+}
+
+size_t Arena::getUsed() {
+	size_t used = 0;
+	for (Block& b : blocks)
+		used += b.used;
+	return used;
+}
+
+size_t Arena::getReserved() {
+	size_t reserved = 0;
+	for (Block& b : blocks)
+		reserved += b.size;
+	return reserved;
+}
+
+void Arena::printStats() {
+	//Space left at the end of blocks the arena has moved past is lost
+	//until the next reset.
+	size_t lost = 0;
+	for (size_t i = 0; i < current && i < blocks.size(); i++)
+		lost += blocks[i].size - blocks[i].used;
+	std::cout << "ALLOC: " << name << ": " << getUsed() / 1024 << "/" << getReserved() / 1024 << " KB used (peak "
+		<< peakUsed / 1024 << " KB), " << blocks.size() << " blocks, " << allocs << " allocs, "
+		<< lost / 1024 << " KB lost to block tails\n";
+}
+#pragma endregion
@@ -0,0 +1,148 @@
+#ifndef JALLOC_H
+#define JALLOC_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+///
+/// Allocators for the things a map is made of. Scene objects and
+/// components come from a Pool per type, so they sit next to each
+/// other and a freed slot is reused by the next one of the same
+/// type. Data that only lives as long as the map (mesh arrays read
+/// at load time) goes in an Arena and is dropped in one go when
+/// the map closes.
+///
+/// None of these are thread safe; allocate from the main thread.
+///
+
+/// <summary>
+/// AllocTracker. Every pool and arena registers itself here so the
+/// debug stats view can list them.
+/// </summary>
+class AllocTracker {
+	protected:
+		const char* name;
+	public:
+		AllocTracker(const char* nameIn);
+		virtual ~AllocTracker();
+		virtual void printStats() = 0;
+};
+
+//Prints every live pool and arena.
+void printAllocStats();
+
+/// <summary>
+/// Pool. Fixed-size slots for one type, handed out from a free list
+/// and grown SLOTS at a time. Blocks are never given back, so a
+/// pool's capacity is its high-water mark.
+/// </summary>
+template<class T, size_t SLOTS = 64> class Pool : public AllocTracker {
+	private:
+		union Slot {
+			Slot* next;
+			alignas(T) unsigned char storage[sizeof(T)];
+		};
+		std::vector<Slot*> blocks;
+		Slot* freeList = NULL;
+		size_t live = 0, peak = 0, allocs = 0, frees = 0;
+
+		void grow() {
+			Slot* block = new Slot[SLOTS];
+			//Chain back to front so slots are handed out in address order.
+			for (size_t i = SLOTS; i-- > 0;) {
+				block[i].next = freeList;
+				freeList = &block[i];
+			}
+			blocks.push_back(block);
+		}
+	public:
+		Pool(const char* nameIn) : AllocTracker(nameIn) {}
+		~Pool() {
+			for (Slot* b : blocks)
+				delete[] b;
+		}
+
+		template<class... Args> T* create(Args&&... args) {
+			if (!freeList)
+				grow();
+			Slot* s = freeList;
+			freeList = s->next;
+			T* obj = new (s->storage) T(std::forward<Args>(args)...);
+			allocs++;
+			if (++live > peak)
+				peak = live;
+			return obj;
+		}
+
+		void destroy(T* obj) {
+			if (!obj)
+				return;
+			obj->~T();
+			Slot* s = reinterpret_cast<Slot*>(obj);
+			s->next = freeList;
+			freeList = s;
+			live--;
+			frees++;
+		}
+
+		size_t getLive() { return live; }
+		size_t getCapacity() { return blocks.size() * SLOTS; }
+		void printStats();
+};
+
+//Where an Arena was at some point, to roll back to.
+struct ArenaMark {
+	size_t block = 0, offset = 0;
+};
+
+/// <summary>
+/// Arena. Bump allocator over large blocks. Nothing is freed on its
+/// own: rewind() drops everything after a mark and reset() drops it
+/// all. Only for trivially destructible data, since no destructors run.
+/// </summary>
+class Arena : public AllocTracker {
+	private:
+		struct Block {
+			unsigned char* data;
+			size_t size, used;
+		};
+		std::vector<Block> blocks;
+		size_t current = 0, blockSize;
+		size_t allocs = 0, peakUsed = 0;
+	public:
+		Arena(const char* nameIn, size_t blockSizeIn = 1 << 20);
+		~Arena();
+
+		void* alloc(size_t size, size_t align = alignof(std::max_align_t));
+		template<class T> T* allocArray(size_t count) {
+			static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+			return (T*)alloc(sizeof(T) * count, alignof(T));
+		}
+		template<class T, class... Args> T* create(Args&&... args) {
+			static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+			return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		ArenaMark mark();
+		void rewind(ArenaMark m);
+		//Frees everything. The first block is kept for the next map.
+		void reset();
+
+		size_t getUsed();
+		size_t getReserved();
+		void printStats();
+};
+
+//Load-time data for the open map. Reset by closeMap().
+extern Arena mapArena;
+
+void printPoolStats(const char* name, size_t live, size_t capacity, size_t peak, size_t blocks, size_t allocs, size_t frees);
+
+template<class T, size_t SLOTS> void Pool<T, SLOTS>::printStats() {
+	printPoolStats(name, live, getCapacity(), peak, blocks.size(), allocs, frees);
+}
+
+#endif
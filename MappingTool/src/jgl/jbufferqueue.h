@@ -2,14 +2,22 @@
 #define JBUFFERQUEUE_H
 
 #include <GL/glew.h>
+#include <stdint.h>
 #include <vector>
 #include <string>
 #include <queue>
 #include <GLFW/glfw3.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "jalloc.h"
+#include "jhandle.h"
 
 struct BufferContainer {
 	GLuint VAO;
 	int numIndices;
+	GLuint texture = 0; //Textures aren't VAO state, so glRender binds this.
+	bool alphaTest = 0;
 
 	BufferContainer(GLuint vaoIn, int numIndicesIn) {
 		VAO = vaoIn;
@@ -18,7 +26,105 @@ struct BufferContainer {
 
 };
 
-extern std::queue<BufferContainer*> glVAOs;
+typedef Handle<BufferContainer> BufferHandle;
+struct Texture;
+
+//One queued draw: the GL names of its buffers, and where in the
+//world. The main thread looks them up in bufferHandles when it fills
+//the packet, so the render thread never reads the table while it is
+//being changed. entity and part (which of the entity's draws) are
+//what ID picking writes out.
+struct DrawRecord {
+	GLuint VAO = 0, texture = 0;
+	int numIndices = 0;
+	glm::mat4 model;
+	uint32_t entity = 0xFFFFFFFF;
+	uint32_t part = 0;
+	bool alphaTest = 0;
+};
+
+//Asks the render thread for an ID pick at a window pixel.
+struct PickRequest {
+	bool active = 0;
+	int x = 0, y = 0;	//Top-left origin, like glfwGetCursorPos
+};
+
+//Geometry rebuilt every frame while an edit is in progress, like a
+//plane being dragged out. It has no buffers of its own; the render
+//thread streams it through streamRing. Clearing keeps the capacity,
+//so refilling it every frame doesn't allocate.
+struct PreviewGeometry {
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned short> indices;	//Triangles
+	glm::vec4 color = glm::vec4(1.0f);
+
+	void clear() {
+		positions.clear();
+		indices.clear();
+	}
+};
+
+//How many pixels a texture covers on screen, for textureResidency.
+struct MipRequest {
+	Texture* texture;
+	float screenPixels;
+};
+
+//The floor reference grid, if it is drawn this frame.
+struct GridRequest {
+	bool draw = 0;
+	float level = 0.0f;			//Height (y) of the plane
+	float spacing = 1.0f;		//Between minor lines
+	int majorEvery = 8;			//Minor lines per major line
+	float maxDistance = 0.0f;	//Faded out completely past this
+};
+
+//Part of a GL buffer to overwrite before the frame is drawn, for
+//meshes edited in place. The bytes are in RenderPacket::writeData.
+struct BufferWrite {
+	GLuint buffer;
+	GLintptr offset;
+	size_t dataStart, size;
+};
+
+/// <summary>
+/// RenderPacket. One frame as the main thread saw it: the camera,
+/// the window size and the draws culling kept. The render thread
+/// draws it from a copy the main thread no longer touches, so
+/// nothing in here may point at data the next frame rewrites.
+/// </summary>
+struct RenderPacket {
+	glm::mat4 model = glm::mat4(1.0f), VP = glm::mat4(1.0f);
+	glm::vec3 eye = glm::vec3(0.0f);	//Camera position
+	int width = 0, height = 0;
+	std::vector<DrawRecord> draws;
+	std::vector<MipRequest> mipRequests;
+	std::vector<glm::vec4> ghosts;	//Ghost sphere centers (xyz) and opacities (w)
+	bool ghostImpostors = 0;		//Draw them as GHOST_IMPOSTOR rather than GHOST_MESH
+	PreviewGeometry preview;
+	GridRequest grid;
+	std::vector<BufferWrite> bufferWrites;
+	std::vector<uint8_t> writeData;
+	PickRequest pick;
+	//Vertex arrays to delete once this frame is drawn. Earlier packets
+	//may still draw them, and they are drawn first.
+	std::vector<GLuint> deadVAOs;
+
+	void clear() {
+		draws.clear();
+		mipRequests.clear();
+		ghosts.clear();
+		preview.clear();
+		grid = GridRequest();
+		bufferWrites.clear();
+		writeData.clear();
+		pick = PickRequest();
+		deadVAOs.clear();
+	}
+};
+//Material makes its BufferContainers here and hands out handles.
+extern Pool<BufferContainer> bufferPool;
+extern HandleTable<BufferContainer> bufferHandles;
 
 
 
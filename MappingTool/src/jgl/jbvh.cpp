@@ -0,0 +1,721 @@
+#include "jbvh.h"
+#include "jjobs.h"
+#include "jmodule.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <numeric>
+#include <random>
+#include <string.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+ScenePicker scenePicker;
+
+#pragma region Build:
+static float surfaceArea(glm::vec3 bMin, glm::vec3 bMax) {
+	glm::vec3 d = bMax - bMin;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+/// <summary>
+/// Binned SAH over primitive boxes. Works on an index permutation,
+/// so the same code builds triangle and instance trees. Subtrees of
+/// at least BVH_PARALLEL_MIN primitives are handed to the job system
+/// as children of root; node slots are claimed two at a time with
+/// an atomic counter.
+/// </summary>
+struct BVHBuilder {
+	const glm::vec3* pMin;
+	const glm::vec3* pMax;
+	const glm::vec3* centroid;
+	uint32_t* order;
+	BVHNode* nodes;
+	std::atomic<uint32_t> nodeCount{ 1 };
+	Job* root = NULL;	//NULL builds everything on the calling thread
+	uint32_t leafWidth = 1;	//Primitives tested together in a leaf
+
+	//Cost of testing n primitives, in units of one test.
+	float leafCost(uint32_t n) const { return (float)((n + leafWidth - 1) / leafWidth); }
+
+	void build(uint32_t node, uint32_t begin, uint32_t end, int depth);
+	void makeLeaf(uint32_t node, uint32_t begin, uint32_t end) {
+		nodes[node].first = begin;
+		nodes[node].count = end - begin;
+	}
+};
+
+void BVHBuilder::build(uint32_t node, uint32_t begin, uint32_t end, int depth) {
+	glm::vec3 bMin(FLT_MAX), bMax(-FLT_MAX), cMin(FLT_MAX), cMax(-FLT_MAX);
+	for (uint32_t i = begin; i < end; i++) {
+		uint32_t p = order[i];
+		bMin = glm::min(bMin, pMin[p]);
+		bMax = glm::max(bMax, pMax[p]);
+		cMin = glm::min(cMin, centroid[p]);
+		cMax = glm::max(cMax, centroid[p]);
+	}
+	nodes[node].bMin = bMin;
+	nodes[node].bMax = bMax;
+	uint32_t count = end - begin;
+	if (count <= 2) {
+		makeLeaf(node, begin, end);
+		return;
+	}
+
+	//Cheapest split over every axis and bin boundary. Costs are in
+	//units of one primitive test, relative to this node's area.
+	struct Bin {
+		glm::vec3 bMin = glm::vec3(FLT_MAX), bMax = glm::vec3(-FLT_MAX);
+		uint32_t count = 0;
+	};
+	float bestCost = FLT_MAX;
+	int bestAxis = -1, bestBin = 0;
+	glm::vec3 extent = cMax - cMin;
+	for (int axis = 0; axis < 3 && depth < BVH_SAH_DEPTH; axis++) {
+		if (extent[axis] <= 0.0f)
+			continue;
+		Bin bins[BVH_BINS];
+		float scale = BVH_BINS / extent[axis];
+		for (uint32_t i = begin; i < end; i++) {
+			uint32_t p = order[i];
+			int b = std::min((int)((centroid[p][axis] - cMin[axis]) * scale), BVH_BINS - 1);
+			bins[b].bMin = glm::min(bins[b].bMin, pMin[p]);
+			bins[b].bMax = glm::max(bins[b].bMax, pMax[p]);
+			bins[b].count++;
+		}
+		float rightCost[BVH_BINS];
+		Bin right;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			right.bMin = glm::min(right.bMin, bins[b].bMin);
+			right.bMax = glm::max(right.bMax, bins[b].bMax);
+			right.count += bins[b].count;
+			rightCost[b] = right.count ? leafCost(right.count) * surfaceArea(right.bMin, right.bMax) : 0.0f;
+		}
+		Bin left;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			left.bMin = glm::min(left.bMin, bins[b].bMin);
+			left.bMax = glm::max(left.bMax, bins[b].bMax);
+			left.count += bins[b].count;
+			if (!left.count || left.count == count)
+				continue;
+			float cost = leafCost(left.count) * surfaceArea(left.bMin, left.bMax) + rightCost[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	uint32_t mid;
+	float area = surfaceArea(bMin, bMax);
+	if (bestAxis < 0) {
+		//Every centroid in the same place, or too deep already: halve
+		//it, which keeps the traversal stack bounded.
+		if (count <= BVH_MAX_LEAF) {
+			makeLeaf(node, begin, end);
+			return;
+		}
+		mid = begin + count / 2;
+	}
+	else {
+		//One traversal step plus the expected tests in each child.
+		float splitCost = 1.0f + (area > 0.0f ? bestCost / area : leafCost(count));
+		if (count <= BVH_MAX_LEAF && leafCost(count) <= splitCost) {
+			makeLeaf(node, begin, end);
+			return;
+		}
+		float scale = BVH_BINS / extent[bestAxis];
+		float lo = cMin[bestAxis];
+		const glm::vec3* c = centroid;
+		uint32_t* split = std::partition(order + begin, order + end, [c, bestAxis, bestBin, scale, lo](uint32_t p) {
+			return std::min((int)((c[p][bestAxis] - lo) * scale), BVH_BINS - 1) <= bestBin;
+		});
+		mid = (uint32_t)(split - order);
+		if (mid == begin || mid == end)
+			mid = begin + count / 2;
+	}
+
+	uint32_t left = nodeCount.fetch_add(2, std::memory_order_relaxed);
+	nodes[node].first = left;
+	nodes[node].count = 0;
+	if (root && count >= BVH_PARALLEL_MIN) {
+		BVHBuilder* self = this;
+		jobSystem.run(jobSystem.create([self, left, begin, mid, depth] { self->build(left, begin, mid, depth + 1); }, root));
+	}
+	else {
+		build(left, begin, mid, depth + 1);
+	}
+	build(left + 1, mid, end, depth + 1);
+}
+
+void buildTriangleBVH(const Vertex* vertices, const unsigned short* indices, uint32_t triCount, Arena& arena, TriangleBVH& out) {
+	out = TriangleBVH();
+	if (triCount == 0)
+		return;
+
+	std::vector<glm::vec3> pMin(triCount), pMax(triCount), centroid(triCount);
+	std::vector<uint32_t> order(triCount);
+	jobSystem.parallelFor(triCount, 4096, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; t++) {
+			const glm::vec3& a = vertices[indices[3 * t]].position;
+			const glm::vec3& b = vertices[indices[3 * t + 1]].position;
+			const glm::vec3& c = vertices[indices[3 * t + 2]].position;
+			pMin[t] = glm::min(a, glm::min(b, c));
+			pMax[t] = glm::max(a, glm::max(b, c));
+			centroid[t] = (a + b + c) * (1.0f / 3.0f);
+			order[t] = t;
+		}
+	});
+
+	std::vector<BVHNode> nodes(2 * (size_t)triCount);
+	BVHBuilder builder;
+	builder.pMin = pMin.data();
+	builder.pMax = pMax.data();
+	builder.centroid = centroid.data();
+	builder.order = order.data();
+	builder.nodes = nodes.data();
+	builder.leafWidth = PACKET_WIDTH;
+	builder.root = jobSystem.create([] {});
+	builder.build(0, 0, triCount, 0);
+	jobSystem.run(builder.root);
+	jobSystem.wait(builder.root);
+
+	out.nodeCount = builder.nodeCount.load();
+	out.triCount = triCount;
+	out.nodes = arena.allocArray<BVHNode>(out.nodeCount);
+	std::copy(nodes.begin(), nodes.begin() + out.nodeCount, out.nodes);
+	for (uint32_t i = 0; i < out.nodeCount; i++)
+		out.packetCount += out.nodes[i].count != 0;
+	out.packets = arena.allocArray<TrianglePacket8>(out.packetCount);
+	out.triIds = arena.allocArray<uint32_t>((size_t)out.packetCount * PACKET_WIDTH);
+	memset(out.packets, 0, sizeof(TrianglePacket8) * out.packetCount);
+	std::fill(out.triIds, out.triIds + (size_t)out.packetCount * PACKET_WIDTH, UINT32_MAX);
+	uint32_t packet = 0;
+	for (uint32_t i = 0; i < out.nodeCount; i++) {
+		BVHNode& n = out.nodes[i];
+		if (!n.count)
+			continue;
+		for (uint32_t lane = 0; lane < n.count; lane++) {
+			uint32_t t = order[n.first + lane];
+			out.packets[packet].set(lane, vertices[indices[3 * t]].position, vertices[indices[3 * t + 1]].position, vertices[indices[3 * t + 2]].position);
+			out.triIds[packet * PACKET_WIDTH + lane] = t;
+		}
+		n.first = packet++;
+	}
+}
+
+void buildBoxTree(const glm::vec3* bMin, const glm::vec3* bMax, uint32_t count, std::vector<BVHNode>& nodes, std::vector<uint32_t>& order) {
+	order.resize(count);
+	std::iota(order.begin(), order.end(), 0);
+	if (!count) {
+		nodes.clear();
+		return;
+	}
+	std::vector<glm::vec3> centroid(count);
+	for (uint32_t i = 0; i < count; i++)
+		centroid[i] = (bMin[i] + bMax[i]) * 0.5f;
+	nodes.assign(2 * (size_t)count, BVHNode());
+	BVHBuilder builder;
+	builder.pMin = bMin;
+	builder.pMax = bMax;
+	builder.centroid = centroid.data();
+	builder.order = order.data();
+	builder.nodes = nodes.data();
+	builder.build(0, 0, count, 0);
+	nodes.resize(builder.nodeCount.load());
+}
+#pragma endregion
+
+#pragma region Raycast:
+//Entry distance into the box, or FLT_MAX if the ray misses it
+//before maxT.
+static inline float slab(const BVHNode& n, glm::vec3 origin, glm::vec3 inv, float maxT) {
+	glm::vec3 t0 = (n.bMin - origin) * inv, t1 = (n.bMax - origin) * inv;
+	glm::vec3 tMin = glm::min(t0, t1), tMax = glm::max(t0, t1);
+	float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+	float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxT));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+//Walks a tree closest box first, calling leaf(first, count) for
+//each leaf that could still hold something nearer than maxT(),
+//which the leaf callback is expected to lower as it finds hits.
+template<class Leaf, class MaxT> static void traverse(const BVHNode* nodes, glm::vec3 origin, glm::vec3 dir, Leaf leaf, MaxT maxT) {
+	glm::vec3 inv = 1.0f / dir;
+	struct Entry { uint32_t node; float t; };
+	Entry stack[64];
+	int top = 0;
+	float t = slab(nodes[0], origin, inv, maxT());
+	if (t == FLT_MAX)
+		return;
+	stack[top++] = { 0, t };
+	while (top > 0) {
+		Entry e = stack[--top];
+		if (e.t >= maxT())
+			continue;
+		const BVHNode& n = nodes[e.node];
+		if (n.count) {
+			leaf(n.first, n.count);
+			continue;
+		}
+		float tl = slab(nodes[n.first], origin, inv, maxT());
+		float tr = slab(nodes[n.first + 1], origin, inv, maxT());
+		//Push the far child first so the near one comes off next.
+		if (tl <= tr) {
+			if (tr != FLT_MAX)
+				stack[top++] = { n.first + 1, tr };
+			if (tl != FLT_MAX)
+				stack[top++] = { n.first, tl };
+		}
+		else {
+			if (tl != FLT_MAX)
+				stack[top++] = { n.first, tl };
+			stack[top++] = { n.first + 1, tr };
+		}
+	}
+}
+
+bool raycastTriangles(const TriangleBVH& bvh, glm::vec3 origin, glm::vec3 dir, TriangleHit& hit) {
+	if (!bvh.nodeCount)
+		return 0;
+	bool found = 0;
+	KernelRay ray(origin, dir);
+	RayTriangles8Fn test = rayKernels->triangles8;
+	traverse(bvh.nodes, origin, dir, [&](uint32_t packet, uint32_t count) {
+		int lane = test(bvh.packets[packet], (int)count, ray, hit.t, hit.t, hit.u, hit.v);
+		if (lane >= 0) {
+			hit.triangle = bvh.triIds[packet * PACKET_WIDTH + lane];
+			found = 1;
+		}
+	}, [&] { return hit.t; });
+	return found;
+}
+#pragma endregion
+
+#pragma region ScenePicker:
+void ScenePicker::updateInstanceBounds(Instance& inst) {
+	const glm::mat4& world = store->transforms.world[store->transforms.indexOf(inst.entity)];
+	inst.toLocal = glm::inverse(world);
+	//World box of the transformed local box (Arvo's method).
+	const BVHNode& r = inst.bvh->nodes[0];
+	glm::vec3 center = glm::vec3(world[3]);
+	glm::vec3 bMin = center, bMax = center;
+	for (int col = 0; col < 3; col++) {
+		glm::vec3 a = glm::vec3(world[col]) * r.bMin[col];
+		glm::vec3 b = glm::vec3(world[col]) * r.bMax[col];
+		bMin += glm::min(a, b);
+		bMax += glm::max(a, b);
+	}
+	inst.bMin = bMin;
+	inst.bMax = bMax;
+}
+
+void ScenePicker::gatherInstances() {
+	instances.clear();
+	firstInstance.assign(firstInstance.size(), UINT32_MAX);
+	const ModelRefPool& models = store->models;
+	for (uint32_t i = 0; i < models.size(); i++) {
+		Entity e = models.entityAt(i);
+		if (!store->transforms.has(e))
+			continue;
+		for (uint32_t m = 0; m < models.meshCount[i]; m++) {
+			MeshHandle h = store->meshList[models.firstMesh[i] + m];
+			const TriangleBVH* bvh = meshTree(h);
+			if (!bvh || !bvh->nodeCount)
+				continue;
+			if (handleIndex(e) >= firstInstance.size())
+				firstInstance.resize(handleIndex(e) + 1, UINT32_MAX);
+			if (firstInstance[handleIndex(e)] == UINT32_MAX)
+				firstInstance[handleIndex(e)] = (uint32_t)instances.size();
+			Instance inst;
+			inst.entity = e;
+			inst.mesh = h;
+			inst.bvh = bvh;
+			updateInstanceBounds(inst);
+			instances.push_back(inst);
+		}
+	}
+}
+
+void ScenePicker::refit() {
+	//Children always come after their parent, so one backwards pass
+	//sees both children before the node itself.
+	for (size_t i = nodes.size(); i-- > 0;) {
+		BVHNode& n = nodes[i];
+		if (n.count) {
+			n.bMin = glm::vec3(FLT_MAX);
+			n.bMax = glm::vec3(-FLT_MAX);
+			for (uint32_t k = n.first; k < n.first + n.count; k++) {
+				n.bMin = glm::min(n.bMin, instances[order[k]].bMin);
+				n.bMax = glm::max(n.bMax, instances[order[k]].bMax);
+			}
+		}
+		else {
+			n.bMin = glm::min(nodes[n.first].bMin, nodes[n.first + 1].bMin);
+			n.bMax = glm::max(nodes[n.first].bMax, nodes[n.first + 1].bMax);
+		}
+	}
+}
+
+void ScenePicker::update(EntityStore& storeIn) {
+	store = &storeIn;
+
+	//Trees for meshes seen for the first time. Each build is split
+	//across the job system; the copy into mapArena happens here.
+	for (MeshHandle h : store->meshList) {
+		if (meshTrees.count(h.value))
+			continue;
+		Mesh* mesh = meshHandles.get(h);
+		if (!mesh)
+			continue;
+		TriangleBVH* tree = mapArena.create<TriangleBVH>();
+		buildTriangleBVH(mesh->getVertices(), mesh->getIndices(), mesh->getTriangleCount(), mapArena, *tree);
+		meshTrees[h.value] = tree;
+	}
+
+	if (builtVersion != store->version) {
+		gatherInstances();
+		uint32_t n = (uint32_t)instances.size();
+		std::vector<glm::vec3> pMin(n), pMax(n);
+		for (uint32_t i = 0; i < n; i++) {
+			pMin[i] = instances[i].bMin;
+			pMax[i] = instances[i].bMax;
+		}
+		buildBoxTree(pMin.data(), pMax.data(), n, nodes, order);
+		builtVersion = store->version;
+		return;
+	}
+
+	//Same instances, some moved: new boxes for those, then refit.
+	if (store->transforms.changed.empty() || instances.empty())
+		return;
+	bool moved = 0;
+	for (Entity e : store->transforms.changed) {
+		uint32_t i = handleIndex(e);
+		if (i >= firstInstance.size())
+			continue;
+		for (uint32_t k = firstInstance[i]; k < instances.size() && instances[k].entity == e; k++) {
+			updateInstanceBounds(instances[k]);
+			moved = 1;
+		}
+	}
+	if (moved)
+		refit();
+}
+
+bool ScenePicker::raycast(glm::vec3 origin, glm::vec3 dir, PickHit& hit, LayerMask layers, float maxDist) const {
+	if (nodes.empty() || !store)
+		return 0;
+	float len = glm::length(dir);
+	if (len <= 0.0f)
+		return 0;
+	glm::vec3 d = dir / len;
+
+	//The local ray is origin and dir put through the inverse world
+	//matrix, which keeps t the same along both.
+	TriangleHit best;
+	best.t = maxDist;
+	const Instance* bestInst = NULL;
+	traverse(nodes.data(), origin, d, [&](uint32_t first, uint32_t count) {
+		for (uint32_t k = first; k < first + count; k++) {
+			const Instance& inst = instances[order[k]];
+			if (!(store->getLayers(inst.entity) & layers))
+				continue;
+			glm::vec3 lo = glm::vec3(inst.toLocal * glm::vec4(origin, 1.0f));
+			glm::vec3 ld = glm::vec3(inst.toLocal * glm::vec4(d, 0.0f));
+			if (raycastTriangles(*inst.bvh, lo, ld, best))
+				bestInst = &inst;
+		}
+	}, [&] { return best.t; });
+
+	if (!bestInst)
+		return 0;
+	hit.entity = bestInst->entity;
+	hit.mesh = bestInst->mesh;
+	hit.triangle = best.triangle;
+	hit.u = best.u;
+	hit.v = best.v;
+	hit.distance = best.t;
+	hit.position = origin + d * best.t;
+	return 1;
+}
+
+void ScenePicker::invalidate(MeshHandle h) {
+	if (meshTrees.erase(h.value))
+		builtVersion = UINT32_MAX;	//Instances still point at the old tree.
+}
+
+const TriangleBVH* ScenePicker::meshTree(MeshHandle h) const {
+	auto it = meshTrees.find(h.value);
+	return it == meshTrees.end() ? NULL : it->second;
+}
+
+void ScenePicker::clear() {
+	meshTrees.clear();
+	instances.clear();
+	firstInstance.clear();
+	nodes.clear();
+	order.clear();
+	builtVersion = UINT32_MAX;
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+aiMesh* makeTestTerrain(int size, float phase) {
+	aiMesh* m = new aiMesh();
+	m->mNumVertices = size * size;
+	m->mVertices = new aiVector3D[m->mNumVertices];
+	m->mNormals = new aiVector3D[m->mNumVertices];
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			float h = 4.0f * sinf(x * 0.11f + phase) * cosf(z * 0.07f - phase);
+			m->mVertices[x + z * size] = aiVector3D((float)x, h, (float)z);
+			m->mNormals[x + z * size] = aiVector3D(0.0f, 1.0f, 0.0f);
+		}
+	}
+	m->mNumFaces = 2 * (size - 1) * (size - 1);
+	m->mFaces = new aiFace[m->mNumFaces];
+	unsigned int f = 0;
+	for (int z = 0; z < size - 1; z++) {
+		for (int x = 0; x < size - 1; x++) {
+			unsigned int i = x + z * size;
+			unsigned int quad[2][3] = { { i, i + size, i + 1 }, { i + 1, i + size, i + size + 1 } };
+			for (int t = 0; t < 2; t++, f++) {
+				m->mFaces[f].mNumIndices = 3;
+				m->mFaces[f].mIndices = new unsigned int[3];
+				std::copy(quad[t], quad[t] + 3, m->mFaces[f].mIndices);
+			}
+		}
+	}
+	return m;
+}
+
+void bvhBenchmark() {
+	//256^2 vertices is as big as 16-bit indices go: 130k triangles a
+	//patch. 8 different patches, each placed 4 times, makes a 4.2
+	//million triangle scene.
+	const int SIZE = 256, PATCHES = 8, COPIES = 4, RAYS = 10000;
+	ArenaMark mark = mapArena.mark();
+
+	std::vector<MeshHandle> handles;
+	for (int p = 0; p < PATCHES; p++) {
+		aiMesh* source = makeTestTerrain(SIZE, p * 0.7f);
+		handles.push_back(meshHandles.insert(mapArena.create<Mesh>(source)));
+		delete source;	//The Mesh has its own copy in mapArena.
+	}
+
+	EntityStore store;
+	ScenePicker picker;
+	float spacing = (float)SIZE;
+	int side = (int)ceilf(sqrtf((float)(PATCHES * COPIES)));
+	for (int i = 0; i < PATCHES * COPIES; i++) {
+		Entity e = store.create();
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3((i % side) * spacing, 0.0f, (i / side) * spacing));
+		store.transforms.add(e, m);
+		store.addMeshes(e, &handles[i % PATCHES], 1);
+	}
+	store.transforms.update();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	picker.update(store);
+	double build = msSince(start);
+	size_t tris = (size_t)PATCHES * 2 * (SIZE - 1) * (SIZE - 1);
+
+	//Mouse-like rays: from a camera above the map looking down at
+	//random points on it.
+	std::mt19937 rng(99);
+	std::uniform_real_distribution<float> spot(0.0f, side * spacing);
+	PickHit hit;
+	int hits = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < RAYS; r++) {
+		glm::vec3 eye(side * spacing * 0.5f, 150.0f, -50.0f);
+		glm::vec3 target(spot(rng), 0.0f, spot(rng));
+		hits += picker.raycast(eye, target - eye, hit);
+	}
+	double rays = msSince(start);
+
+	std::cout << "BVH: " << PATCHES << " meshes, " << tris << " triangles built in " << build << " ms ("
+		<< tris / build / 1000.0 << " Mtri/s) on " << jobSystem.getWorkerCount() << " workers\n";
+	std::cout << "BVH: " << PATCHES * COPIES << " instances, " << tris * COPIES << " triangles, "
+		<< rays * 1000.0 / RAYS << " us/ray, " << hits << "/" << RAYS << " hit\n";
+
+	for (MeshHandle h : handles)
+		meshHandles.remove(h);
+	picker.clear();
+	mapArena.rewind(mark);
+}
+#pragma endregion
+
+#pragma region Kernel benchmark:
+void rayKernelBenchmark() {
+	const int RAYS = 1 << 16, REPS = 8, MIN_PACKETS = 4096;
+	ArenaMark mark = mapArena.mark();
+
+	//Real map data if there is enough of it.
+	std::vector<const TriangleBVH*> trees;
+	uint32_t packetTotal = 0;
+	for (auto& entry : scenePicker.getMeshTrees()) {
+		if (entry.second->packetCount) {
+			trees.push_back(entry.second);
+			packetTotal += entry.second->packetCount;
+		}
+	}
+	const char* source = "open map";
+	if (packetTotal < MIN_PACKETS) {
+		aiMesh* terrain = makeTestTerrain(256, 0.0f);
+		Mesh* mesh = mapArena.create<Mesh>(terrain);
+		delete terrain;
+		TriangleBVH* tree = mapArena.create<TriangleBVH>();
+		buildTriangleBVH(mesh->getVertices(), mesh->getIndices(), mesh->getTriangleCount(), mapArena, *tree);
+		trees.assign(1, tree);
+		source = "generated terrain";
+	}
+
+	//Packets and boxes paired with a ray aimed near them, so most
+	//tests do the whole computation instead of failing early.
+	struct TriangleCase { const TrianglePacket8* packet; int count; KernelRay ray; };
+	struct BoxCase { const BoxPacket8* packet; int count; KernelRay ray; };
+	std::vector<TriangleCase> triCases;
+	std::vector<BoxCase> boxCases;
+	std::vector<BoxPacket8> boxes;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (const TriangleBVH* tree : trees) {
+		glm::vec3 size = tree->nodes[0].bMax - tree->nodes[0].bMin;
+		float reach = std::max(std::max(size.x, size.y), size.z) * 0.1f + 1.0f;
+		for (uint32_t i = 0; i + PACKET_WIDTH <= tree->nodeCount; i += PACKET_WIDTH) {
+			BoxPacket8 b;
+			for (int lane = 0; lane < PACKET_WIDTH; lane++)
+				b.set(lane, tree->nodes[i + lane].bMin, tree->nodes[i + lane].bMax);
+			boxes.push_back(b);
+		}
+		for (uint32_t n = 0; n < tree->nodeCount; n++) {
+			const BVHNode& node = tree->nodes[n];
+			if (!node.count)
+				continue;
+			const TrianglePacket8& p = tree->packets[node.first];
+			glm::vec3 target(p.v0[0][0], p.v0[1][0], p.v0[2][0]);
+			target += glm::vec3(p.e1[0][0], p.e1[1][0], p.e1[2][0]) * 0.3f + glm::vec3(p.e2[0][0], p.e2[1][0], p.e2[2][0]) * 0.3f;
+			glm::vec3 from = target + glm::vec3(unit(rng), unit(rng), unit(rng)) * reach;
+			glm::vec3 jitter = glm::vec3(unit(rng), unit(rng), unit(rng)) * (0.05f * reach);
+			triCases.push_back({ &p, (int)node.count, KernelRay(from, target + jitter - from) });
+		}
+	}
+	for (size_t i = 0; i < boxes.size(); i++) {
+		const BoxPacket8& b = boxes[i];
+		glm::vec3 center(b.bMin[0][0] + b.bMax[0][0], b.bMin[1][0] + b.bMax[1][0], b.bMin[2][0] + b.bMax[2][0]);
+		center *= 0.5f;
+		glm::vec3 from = center + glm::vec3(unit(rng), unit(rng), unit(rng)) * 20.0f;
+		boxCases.push_back({ &b, PACKET_WIDTH, KernelRay(from, center - from) });
+		//And along an axis, where invDir has infinities in it. Just off
+		//the center, so the ray doesn't lie in the plane of a flat box,
+		//where (b - o) * inv is 0 * inf.
+		glm::vec3 axis(0.0f);
+		axis[i % 3] = 1.0f;
+		glm::vec3 off = (glm::vec3(1.0f) - axis) * 0.01f;
+		boxCases.push_back({ &b, PACKET_WIDTH, KernelRay(center + off - axis * 20.0f, axis) });
+	}
+	std::shuffle(triCases.begin(), triCases.end(), rng);
+	std::shuffle(boxCases.begin(), boxCases.end(), rng);
+	if (triCases.size() > RAYS)
+		triCases.erase(triCases.begin() + RAYS, triCases.end());
+	if (boxCases.size() > RAYS)
+		boxCases.erase(boxCases.begin() + RAYS, boxCases.end());
+
+	std::cout << "SIMD: detected " << rayKernelsFor(detectSimdLevel()).name << ", " << triCases.size() << " triangle packets and "
+		<< boxCases.size() << " box packets from the " << source << "\n";
+
+	//Scalar answers to check the others against.
+	std::vector<float> refT(triCases.size());
+	std::vector<uint32_t> refMask(boxCases.size());
+	const RayKernels& scalar = rayKernelsFor(SIMD_SCALAR);
+	for (size_t i = 0; i < triCases.size(); i++) {
+		float t = FLT_MAX, u, v;
+		scalar.triangles8(*triCases[i].packet, triCases[i].count, triCases[i].ray, FLT_MAX, t, u, v);
+		refT[i] = t;
+	}
+	float tEnter[PACKET_WIDTH];
+	for (size_t i = 0; i < boxCases.size(); i++)
+		refMask[i] = scalar.boxes8(*boxCases[i].packet, boxCases[i].count, boxCases[i].ray, FLT_MAX, tEnter);
+
+	double scalarTri = 0.0, scalarBox = 0.0;
+	bool same = 1;
+	for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+		const RayKernels& k = rayKernelsFor((SimdLevel)level);
+		int hits = 0, triDiff = 0, boxDiff = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int rep = 0; rep < REPS; rep++) {
+			for (size_t i = 0; i < triCases.size(); i++) {
+				float t = FLT_MAX, u, v;
+				hits += k.triangles8(*triCases[i].packet, triCases[i].count, triCases[i].ray, FLT_MAX, t, u, v) >= 0;
+				if (rep == 0 && fabsf(t - refT[i]) > 1e-4f * std::max(1.0f, refT[i]))
+					triDiff++;
+			}
+		}
+		double triMs = msSince(start);
+		uint32_t boxHits = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (int rep = 0; rep < REPS; rep++) {
+			for (size_t i = 0; i < boxCases.size(); i++) {
+				uint32_t mask = k.boxes8(*boxCases[i].packet, boxCases[i].count, boxCases[i].ray, FLT_MAX, tEnter);
+				boxHits += mask & 1;
+				if (rep == 0 && mask != refMask[i])
+					boxDiff++;
+			}
+		}
+		double boxMs = msSince(start);
+		if (level == SIMD_SCALAR) {
+			scalarTri = triMs;
+			scalarBox = boxMs;
+		}
+		double triNs = triMs * 1e6 / ((double)REPS * triCases.size());
+		double boxNs = boxMs * 1e6 / ((double)REPS * boxCases.size());
+		std::cout << "SIMD: " << k.name << " ray/8 triangles " << triNs << " ns (" << scalarTri / triMs << "x), ray/8 boxes "
+			<< boxNs << " ns (" << scalarBox / boxMs << "x), " << hits / REPS << " hits, " << triDiff << " + " << boxDiff
+			<< " differ from scalar\n";
+		if (triDiff || boxDiff)
+			same = 0;
+	}
+	if (!same)
+		std::cout << "SIMD: the kernels and the scalar reference differ!\n";
+
+	//The same kernels inside whole-tree raycasts.
+	const TriangleBVH* tree = trees[0];
+	for (const TriangleBVH* t : trees) {
+		if (t->packetCount > tree->packetCount)
+			tree = t;
+	}
+	glm::vec3 bMin = tree->nodes[0].bMin, bMax = tree->nodes[0].bMax;
+	std::vector<KernelRay> rays;
+	for (int r = 0; r < RAYS / 4; r++) {
+		glm::vec3 a = bMin + (bMax - bMin) * glm::vec3(unit(rng) * 0.5f + 0.5f, 2.0f, unit(rng) * 0.5f + 0.5f);
+		glm::vec3 b = bMin + (bMax - bMin) * glm::vec3(unit(rng) * 0.5f + 0.5f, 0.0f, unit(rng) * 0.5f + 0.5f);
+		rays.push_back(KernelRay(a, b - a));
+	}
+	const RayKernels* saved = rayKernels;
+	for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++) {
+		rayKernels = &rayKernelsFor((SimdLevel)level);
+		int hits = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const KernelRay& r : rays) {
+			TriangleHit hit;
+			hits += raycastTriangles(*tree, r.origin, r.dir, hit);
+		}
+		double ms = msSince(start);
+		std::cout << "SIMD: " << rayKernels->name << " tree raycast " << ms * 1000.0 / rays.size() << " us/ray over "
+			<< tree->triCount << " triangles, " << hits << "/" << rays.size() << " hit\n";
+	}
+	rayKernels = saved;
+	mapArena.rewind(mark);
+}
+#pragma endregion
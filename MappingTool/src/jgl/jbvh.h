@@ -0,0 +1,146 @@
+#ifndef JBVH_H
+#define JBVH_H
+
+#include <float.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include "jalloc.h"
+#include "jecs.h"
+#include "jhandle.h"
+#include "jsimd.h"
+
+///
+/// Ray picking. Each mesh gets a triangle BVH, built once with
+/// binned SAH (big subtrees go to the job system) and kept in
+/// mapArena next to the mesh it belongs to. On top of those,
+/// ScenePicker keeps a BVH over the scene's mesh instances, rebuilt
+/// when entities come or go and refit when they only move.
+///
+/// A ray goes through the top tree in world space, then into each
+/// instance's tree in the instance's local space, closest box first,
+/// so the search stops as soon as nothing left can be nearer. Leaves
+/// of the triangle trees are one TrianglePacket8 each, tested with
+/// rayKernels.
+///
+
+class Mesh;
+struct Vertex;
+struct aiMesh;
+typedef Handle<Mesh> MeshHandle;
+
+const int BVH_BINS = 16;
+const int BVH_MAX_LEAF = PACKET_WIDTH;	//Leaves can hold up to this many primitives
+const uint32_t BVH_PARALLEL_MIN = 8192;	//Smaller subtrees are built on one thread
+const int BVH_SAH_DEPTH = 40;			//Deeper than this, split at the median to bound the depth
+
+//Leaves have count > 0 and hold primitives [first, first + count),
+//or in a TriangleBVH, count triangles of packet first.
+//Inner nodes have count == 0 and children first and first + 1.
+struct BVHNode {
+	glm::vec3 bMin;
+	uint32_t first;
+	glm::vec3 bMax;
+	uint32_t count;
+};
+
+/// <summary>
+/// TriangleBVH. One mesh's tree. Each leaf's triangles are one packet,
+/// with their original indices at triIds[packet * 8 + lane] (UINT32_MAX
+/// in unused lanes). Everything is in mapArena.
+/// </summary>
+struct TriangleBVH {
+	BVHNode* nodes = NULL;
+	TrianglePacket8* packets = NULL;
+	uint32_t* triIds = NULL;
+	uint32_t nodeCount = 0, triCount = 0, packetCount = 0;
+};
+
+//Builds the tree for triCount triangles of indices into vertices.
+//Safe to call from several threads at once as long as arena is only
+//used by the calling thread; the finished tree is copied into it.
+void buildTriangleBVH(const Vertex* vertices, const unsigned short* indices, uint32_t triCount, Arena& arena, TriangleBVH& out);
+
+//Tree over count boxes, like the one ScenePicker keeps over its
+//instances; order maps leaf ranges back to box indices. Built on the
+//calling thread. nodes is empty if count is 0.
+void buildBoxTree(const glm::vec3* bMin, const glm::vec3* bMax, uint32_t count, std::vector<BVHNode>& nodes, std::vector<uint32_t>& order);
+
+//Closest hit along a ray, in the ray's own space; t is in units of dir.
+struct TriangleHit {
+	float t = FLT_MAX;
+	float u = 0.0f, v = 0.0f;	//Barycentrics of v1 and v2; v0's is 1 - u - v
+	uint32_t triangle = UINT32_MAX;
+};
+
+//Returns 1 and fills hit if something is nearer than hit.t.
+bool raycastTriangles(const TriangleBVH& bvh, glm::vec3 origin, glm::vec3 dir, TriangleHit& hit);
+
+//What a pick found.
+struct PickHit {
+	Entity entity = NULL_ENTITY;	//The object's tag
+	MeshHandle mesh;
+	uint32_t triangle = UINT32_MAX;	//In the mesh's index order
+	float u = 0.0f, v = 0.0f;		//Barycentrics, as in TriangleHit
+	float distance = FLT_MAX;		//Along the normalized ray, world units
+	glm::vec3 position = glm::vec3(0.0f);
+};
+
+/// <summary>
+/// ScenePicker. Top-level BVH over every (entity, mesh) pair in an
+/// EntityStore. Call update() once a frame after transforms.update();
+/// it builds trees for new meshes, then rebuilds or refits the top.
+/// </summary>
+class ScenePicker {
+	private:
+		struct Instance {
+			Entity entity;
+			MeshHandle mesh;
+			const TriangleBVH* bvh;
+			glm::mat4 toLocal;		//Inverse world matrix
+			glm::vec3 bMin, bMax;	//World space
+		};
+		EntityStore* store = NULL;
+		std::vector<Instance> instances;
+		std::vector<BVHNode> nodes;
+		std::vector<uint32_t> order;	//Leaf order -> instances index
+		std::vector<uint32_t> firstInstance;	//By entity index; an entity's instances are adjacent
+		std::unordered_map<uint32_t, TriangleBVH*> meshTrees;	//By MeshHandle value
+		uint32_t builtVersion = UINT32_MAX;
+
+		void gatherInstances();
+		void updateInstanceBounds(Instance& inst);
+		void refit();
+	public:
+		void update(EntityStore& storeIn);
+		//The mesh's vertices changed: its tree is rebuilt next update().
+		//The old one's memory stays in mapArena until closeMap().
+		void invalidate(MeshHandle h);
+		//Closest hit on a visible layer within maxDist. dir need not be
+		//normalized. Returns 0 on a miss.
+		bool raycast(glm::vec3 origin, glm::vec3 dir, PickHit& hit, LayerMask layers = LAYER_ALL, float maxDist = FLT_MAX) const;
+		//Triangle tree of a mesh, NULL if none has been built yet.
+		const TriangleBVH* meshTree(MeshHandle h) const;
+		const std::unordered_map<uint32_t, TriangleBVH*>& getMeshTrees() const { return meshTrees; }
+		//Forgets every mesh tree. Their memory goes with mapArena.
+		void clear();
+		size_t getInstanceCount() const { return instances.size(); }
+};
+
+extern ScenePicker scenePicker;
+
+//Rolling terrain patch of size x size vertices one unit apart, for
+//benchmarks. The caller deletes it.
+aiMesh* makeTestTerrain(int size, float phase);
+
+//Times a parallel build of a large mesh and raycasts against a
+//multi-million-triangle scene.
+void bvhBenchmark();
+//Times every level of rayKernels against the scalar ones on packets
+//from the open map's trees (or a generated terrain if it has few),
+//checks they agree, then repeats whole-tree raycasts per level.
+void rayKernelBenchmark();
+
+#endif
@@ -0,0 +1,440 @@
+#include "jecs.h"
+#include "jgl.h"
+#include "jmodule.h"
+#include "jjobs.h"
+#include <algorithm>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <iostream>
+
+EntityStore scene;
+
+#pragma region SparseSet:
+uint32_t SparseSet::insertIndex(Entity e) {
+	uint32_t s = handleIndex(e);
+	if (s >= sparse.size())
+		sparse.resize(s + 1, NULL_ENTITY);
+	sparse[s] = (uint32_t)dense.size();
+	dense.push_back(e);
+	return sparse[s];
+}
+
+uint32_t SparseSet::eraseIndex(Entity e) {
+	if (!has(e))
+		return NULL_ENTITY;
+	uint32_t i = sparse[handleIndex(e)];
+	Entity last = dense.back();
+	dense[i] = last;
+	sparse[handleIndex(last)] = i;
+	dense.pop_back();
+	sparse[handleIndex(e)] = NULL_ENTITY;
+	return i;
+}
+#pragma endregion
+
+#pragma region Pools:
+void TransformPool::add(Entity e, const glm::mat4& m) {
+	if (!has(e)) {
+		insertIndex(e);
+		local.push_back(m);
+		world.push_back(m);
+		parent.push_back(NULL_ENTITY);
+		firstChild.push_back(NULL_ENTITY);
+		nextSibling.push_back(NULL_ENTITY);
+		dirty.push_back(0);
+	}
+	setLocal(e, m);
+}
+
+void TransformPool::remove(Entity e) {
+	if (!has(e))
+		return;
+	Entity c = firstChild[indexOf(e)];
+	while (c != NULL_ENTITY) {
+		Entity next = nextSibling[indexOf(c)];
+		setParent(c, NULL_ENTITY);
+		c = next;
+	}
+	setParent(e, NULL_ENTITY);
+
+	uint32_t i = eraseIndex(e);
+	swapRemove(local, i);
+	swapRemove(world, i);
+	swapRemove(parent, i);
+	swapRemove(firstChild, i);
+	swapRemove(nextSibling, i);
+	swapRemove(dirty, i);
+}
+
+void TransformPool::setLocal(Entity e, const glm::mat4& m) {
+	uint32_t i = indexOf(e);
+	local[i] = m;
+	if (!dirty[i]) {
+		dirty[i] = 1;
+		dirtyRoots.push_back(e);
+	}
+}
+
+bool TransformPool::setParent(Entity child, Entity newParent) {
+	if (!has(child) || (newParent != NULL_ENTITY && !has(newParent)))
+		return 0;
+	for (Entity p = newParent; p != NULL_ENTITY; p = parent[indexOf(p)]) {
+		if (p == child)
+			return 0; //child is an ancestor of newParent
+	}
+
+	uint32_t ci = indexOf(child);
+	Entity old = parent[ci];
+	if (old == newParent)
+		return 1;
+	if (old != NULL_ENTITY) {
+		Entity* link = &firstChild[indexOf(old)];
+		while (*link != child)
+			link = &nextSibling[indexOf(*link)];
+		*link = nextSibling[ci];
+	}
+
+	parent[ci] = newParent;
+	nextSibling[ci] = NULL_ENTITY;
+	glm::mat4 parentWorld(1.0f);
+	if (newParent != NULL_ENTITY) {
+		uint32_t pi = indexOf(newParent);
+		nextSibling[ci] = firstChild[pi];
+		firstChild[pi] = child;
+		parentWorld = world[pi];
+	}
+	setLocal(child, glm::inverse(parentWorld) * world[ci]);
+	return 1;
+}
+
+void TransformPool::updateLevel(uint32_t begin, uint32_t end) {
+	for (uint32_t k = begin; k < end; k++) {
+		uint32_t i = indexOf(changed[k]);
+		Entity p = parent[i];
+		world[i] = (p == NULL_ENTITY) ? local[i] : world[indexOf(p)] * local[i];
+	}
+}
+
+void TransformPool::update() {
+	changed.clear();
+	levelStart.clear();
+
+	//A dirty entity under a dirty ancestor gets reached from that
+	//ancestor, so only the topmost dirty entities start the walk.
+	for (Entity e : dirtyRoots) {
+		if (!has(e) || !dirty[indexOf(e)])
+			continue;
+		bool covered = 0;
+		for (Entity p = parent[indexOf(e)]; p != NULL_ENTITY && !covered; p = parent[indexOf(p)])
+			covered = dirty[indexOf(p)];
+		if (!covered)
+			changed.push_back(e);
+	}
+	dirtyRoots.clear();
+
+	uint32_t begin = 0;
+	while (begin < changed.size()) {
+		uint32_t end = (uint32_t)changed.size();
+		levelStart.push_back(begin);
+		jobSystem.parallelFor(end - begin, 256, [this, begin](uint32_t b, uint32_t e) {
+			updateLevel(begin + b, begin + e);
+		});
+		for (uint32_t k = begin; k < end; k++) {
+			for (Entity c = firstChild[indexOf(changed[k])]; c != NULL_ENTITY; c = nextSibling[indexOf(c)])
+				changed.push_back(c);
+		}
+		begin = end;
+	}
+
+	for (Entity e : changed)
+		dirty[indexOf(e)] = 0;
+}
+
+void BoundsPool::add(Entity e, glm::vec3 bMin, glm::vec3 bMax) {
+	glm::vec3 c = (bMin + bMax) * 0.5f;
+	float r = glm::length(bMax - bMin) * 0.5f;
+	if (has(e)) {
+		uint32_t i = indexOf(e);
+		localMin[i] = bMin;
+		localMax[i] = bMax;
+		centerX[i] = c.x; centerY[i] = c.y; centerZ[i] = c.z; radius[i] = r;
+		return;
+	}
+	insertIndex(e);
+	localMin.push_back(bMin);
+	localMax.push_back(bMax);
+	centerX.push_back(c.x);
+	centerY.push_back(c.y);
+	centerZ.push_back(c.z);
+	radius.push_back(r);
+}
+
+void BoundsPool::remove(Entity e) {
+	uint32_t i = eraseIndex(e);
+	if (i == NULL_ENTITY)
+		return;
+	swapRemove(localMin, i);
+	swapRemove(localMax, i);
+	swapRemove(centerX, i);
+	swapRemove(centerY, i);
+	swapRemove(centerZ, i);
+	swapRemove(radius, i);
+}
+
+void MeshRefPool::add(Entity e, uint32_t first, uint32_t count) {
+	if (has(e)) {
+		firstDraw[indexOf(e)] = first;
+		drawCount[indexOf(e)] = count;
+		return;
+	}
+	insertIndex(e);
+	firstDraw.push_back(first);
+	drawCount.push_back(count);
+}
+
+void MeshRefPool::remove(Entity e) {
+	uint32_t i = eraseIndex(e);
+	if (i == NULL_ENTITY)
+		return;
+	swapRemove(firstDraw, i);
+	swapRemove(drawCount, i);
+}
+
+void ModelRefPool::add(Entity e, uint32_t first, uint32_t count) {
+	if (has(e)) {
+		firstMesh[indexOf(e)] = first;
+		meshCount[indexOf(e)] = count;
+		return;
+	}
+	insertIndex(e);
+	firstMesh.push_back(first);
+	meshCount.push_back(count);
+}
+
+void ModelRefPool::remove(Entity e) {
+	uint32_t i = eraseIndex(e);
+	if (i == NULL_ENTITY)
+		return;
+	swapRemove(firstMesh, i);
+	swapRemove(meshCount, i);
+}
+
+void MaterialRefPool::add(Entity e, Handle<Material> m) {
+	if (has(e)) {
+		material[indexOf(e)] = m;
+		return;
+	}
+	insertIndex(e);
+	material.push_back(m);
+}
+
+void MaterialRefPool::remove(Entity e) {
+	uint32_t i = eraseIndex(e);
+	if (i == NULL_ENTITY)
+		return;
+	swapRemove(material, i);
+}
+
+void UnboundedPool::add(Entity e) {
+	if (!has(e))
+		insertIndex(e);
+}
+
+void UnboundedPool::remove(Entity e) {
+	eraseIndex(e);
+}
+#pragma endregion
+
+#pragma region EntityStore:
+Entity EntityStore::create() {
+	uint32_t i;
+	if (!freeEntities.empty()) {
+		i = freeEntities.back();
+		freeEntities.pop_back();
+	}
+	else {
+		//The top index is left out so no entity can equal NULL_ENTITY.
+		if (generations.size() >= HANDLE_INDEX_MASK) {
+			std::cout << "ECS: Out of entities\n";
+			return NULL_ENTITY;
+		}
+		i = (uint32_t)generations.size();
+		generations.push_back(1);
+		layers.push_back(0);
+	}
+	layers[i] = LAYER_DEFAULT;
+	return makeHandle(i, generations[i]);
+}
+
+void EntityStore::destroy(Entity e) {
+	if (!alive(e))
+		return;
+	if (meshes.has(e))
+		deadDraws += meshes.drawCount[meshes.indexOf(e)];
+	if (models.has(e))
+		deadMeshes += models.meshCount[models.indexOf(e)];
+	transforms.remove(e);
+	bounds.remove(e);
+	meshes.remove(e);
+	models.remove(e);
+	materials.remove(e);
+	unbounded.remove(e);
+	octree.remove(e);
+	version++;
+	uint32_t i = handleIndex(e);
+	generations[i] = nextGeneration(generations[i]);
+	freeEntities.push_back(i);
+	compactLists();
+}
+
+void EntityStore::compactLists() {
+	if (deadDraws > 0 && deadDraws * 2 >= drawList.size()) {
+		std::vector<BufferHandle> live;
+		live.reserve(drawList.size() - deadDraws);
+		for (uint32_t k = 0; k < meshes.size(); k++) {
+			uint32_t first = meshes.firstDraw[k];
+			meshes.firstDraw[k] = (uint32_t)live.size();
+			live.insert(live.end(), drawList.begin() + first, drawList.begin() + first + meshes.drawCount[k]);
+		}
+		drawList.swap(live);
+		deadDraws = 0;
+	}
+	if (deadMeshes > 0 && deadMeshes * 2 >= meshList.size()) {
+		std::vector<Handle<Mesh>> live;
+		live.reserve(meshList.size() - deadMeshes);
+		for (uint32_t k = 0; k < models.size(); k++) {
+			uint32_t first = models.firstMesh[k];
+			models.firstMesh[k] = (uint32_t)live.size();
+			live.insert(live.end(), meshList.begin() + first, meshList.begin() + first + models.meshCount[k]);
+		}
+		meshList.swap(live);
+		deadMeshes = 0;
+	}
+}
+
+void EntityStore::setLayers(Entity e, LayerMask mask) {
+	if (!alive(e))
+		return;
+	layers[handleIndex(e)] = mask;
+	octree.setMask(e, mask);
+}
+
+Entity EntityStore::attach(WorldObject* obj) {
+	Entity e = create();
+	if (e == NULL_ENTITY)
+		return e;
+	obj->entity = e;
+	layers[handleIndex(e)] = obj->layers;
+	transforms.add(e, obj->worldMatrix);
+
+	Model* model = obj->findModule<Model>();
+	glm::vec3 bMin, bMax;
+	if (model && model->getBounds(bMin, bMax))
+		bounds.add(e, bMin, bMax);
+	if (model)
+		addMeshes(e, model->getMeshes().data(), (uint32_t)model->getMeshes().size());
+
+	Material* mat = obj->findModule<Material>();
+	if (mat) {
+		const std::vector<BufferHandle>& buffers = mat->getBuffers();
+		meshes.add(e, (uint32_t)drawList.size(), (uint32_t)buffers.size());
+		drawList.insert(drawList.end(), buffers.begin(), buffers.end());
+		materials.add(e, mat->getHandle());
+		if (!bounds.has(e))
+			unbounded.add(e);
+	}
+	return e;
+}
+
+void EntityStore::addMeshes(Entity e, const Handle<Mesh>* list, uint32_t count) {
+	if (!alive(e))
+		return;
+	if (models.has(e))
+		deadMeshes += models.meshCount[models.indexOf(e)];	//Replaced below
+	models.add(e, (uint32_t)meshList.size(), count);
+	meshList.insert(meshList.end(), list, list + count);
+	version++;
+	compactLists();
+}
+
+void EntityStore::meshBoundsChanged(Handle<Mesh> h) {
+	for (uint32_t k = 0; k < models.size(); k++) {
+		uint32_t first = models.firstMesh[k], count = models.meshCount[k];
+		if (std::find(meshList.begin() + first, meshList.begin() + first + count, h) == meshList.begin() + first + count)
+			continue;
+		Entity e = models.entityAt(k);
+		glm::vec3 bMin, bMax;
+		bool any = 0;
+		for (uint32_t m = first; m < first + count; m++) {
+			Mesh* mesh = meshHandles.get(meshList[m]);
+			if (!mesh)
+				continue;
+			bMin = any ? glm::min(bMin, mesh->getBoundsMin()) : mesh->getBoundsMin();
+			bMax = any ? glm::max(bMax, mesh->getBoundsMax()) : mesh->getBoundsMax();
+			any = 1;
+		}
+		if (!any)
+			continue;
+		bounds.add(e, bMin, bMax);
+		unbounded.remove(e);
+		updateWorldBounds(*this, e);
+	}
+}
+#pragma endregion
+
+#pragma region Systems:
+void updateWorldBounds(EntityStore& store, Entity e) {
+	BoundsPool& b = store.bounds;
+	if (!b.has(e))
+		return;
+	uint32_t i = b.indexOf(e);
+	glm::mat4 m = store.transforms.has(e) ? store.transforms.world[store.transforms.indexOf(e)] : glm::mat4(1.0f);
+	glm::vec3 c = glm::vec3(m * glm::vec4((b.localMin[i] + b.localMax[i]) * 0.5f, 1.0f));
+	float scale = glm::max(glm::length(glm::vec3(m[0])), glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+	b.centerX[i] = c.x;
+	b.centerY[i] = c.y;
+	b.centerZ[i] = c.z;
+	b.radius[i] = glm::length(b.localMax[i] - b.localMin[i]) * 0.5f * scale;
+	store.octree.update(e, c, b.radius[i], store.getLayers(e));
+}
+
+void boundsSystem(EntityStore& store) {
+	for (Entity e : store.transforms.changed)
+		updateWorldBounds(store, e);
+}
+
+void cullSystem(EntityStore& store, const jglCamera& cam, std::vector<Entity>& visible) {
+	store.octree.queryFrustum(cam.frustum, visible, cam.visibleLayers);
+	for (uint32_t k = 0; k < store.unbounded.size(); k++) {
+		Entity e = store.unbounded.entityAt(k);
+		if (!store.bounds.has(e) && (store.getLayers(e) & cam.visibleLayers))
+			visible.push_back(e);
+	}
+}
+
+void residencySystem(EntityStore& store, jglCamera& cam, const std::vector<Entity>& visible, RenderPacket& packet) {
+	for (Entity e : visible) {
+		if (!store.materials.has(e) || !store.bounds.has(e))
+			continue;
+		Material* mat = materialHandles.get(store.materials.material[store.materials.indexOf(e)]);
+		if (!mat)
+			continue;
+		uint32_t i = store.bounds.indexOf(e);
+		glm::vec3 c(store.bounds.centerX[i], store.bounds.centerY[i], store.bounds.centerZ[i]);
+		mat->requestMips(cam.projectedPixels(c, store.bounds.radius[i]), packet.mipRequests);
+	}
+}
+
+void submitSystem(EntityStore& store, const std::vector<Entity>& visible, RenderPacket& packet) {
+	for (Entity e : visible) {
+		if (!store.meshes.has(e))
+			continue;
+		uint32_t i = store.meshes.indexOf(e);
+		const glm::mat4& m = store.transforms.has(e) ? store.transforms.world[store.transforms.indexOf(e)] : glm::mat4(1.0f);
+		for (uint32_t d = 0; d < store.meshes.drawCount[i]; d++) {
+			BufferContainer* b = bufferHandles.get(store.drawList[store.meshes.firstDraw[i] + d]);
+			if (b)
+				packet.draws.push_back({ b->VAO, b->texture, b->numIndices, m, e, d, b->alphaTest });
+		}
+	}
+}
+#pragma endregion
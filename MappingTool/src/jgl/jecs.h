@@ -0,0 +1,201 @@
+#ifndef JECS_H
+#define JECS_H
+
+#include <stdint.h>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "jbufferqueue.h"
+#include "jhandle.h"
+#include "joctree.h"
+
+class WorldObject;
+class Material;
+class Mesh;
+class jglCamera;
+
+///
+/// Entity/component storage for the things in the map. An Entity
+/// is only an index; its data lives in one pool per component
+/// type, and each pool keeps its members densely packed in
+/// separate arrays (structure of arrays). Systems walk a pool's
+/// arrays front to back, so culling reads four float arrays
+/// instead of visiting every WorldObject and its modules.
+///
+/// WorldObjects are still how user code builds things; attach()
+/// copies one into the store once its modules are loaded.
+///
+
+//Laid out like a Handle: index in the low bits, generation above.
+//A destroyed entity's id stops matching once its index is reused.
+typedef uint32_t Entity;
+const Entity NULL_ENTITY = 0xFFFFFFFF;
+
+//Visibility layers. Every entity is on one or more; culling keeps
+//it only if it shares a bit with the camera's visibleLayers, so
+//showing and hiding a layer changes nothing but that mask.
+typedef uint64_t LayerMask;
+const LayerMask LAYER_DEFAULT	= 1ull << 0;
+const LayerMask LAYER_DETAIL	= 1ull << 1;
+const LayerMask LAYER_LIGHTS	= 1ull << 2;
+const LayerMask LAYER_COLLISION	= 1ull << 3;
+const LayerMask LAYER_GHOSTS	= 1ull << 4;
+const LayerMask LAYER_ALL		= ~0ull;
+
+/// <summary>
+/// Entity -> dense index map shared by every pool. Removal moves
+/// the last element into the hole, so pools must do the same to
+/// each of their arrays (see swapRemove). Sparse is indexed by the
+/// entity's index; dense keeps the whole id, which is what makes
+/// has() reject stale generations.
+/// </summary>
+class SparseSet {
+	protected:
+		std::vector<uint32_t> sparse;
+		std::vector<Entity> dense;
+		uint32_t insertIndex(Entity e);
+		//Returns the dense index that was freed, or NULL_ENTITY.
+		uint32_t eraseIndex(Entity e);
+	public:
+		bool has(Entity e) const {
+			uint32_t i = handleIndex(e);
+			return i < sparse.size() && sparse[i] != NULL_ENTITY && dense[sparse[i]] == e;
+		}
+		uint32_t indexOf(Entity e) const { return sparse[handleIndex(e)]; }
+		uint32_t size() const { return (uint32_t)dense.size(); }
+		Entity entityAt(uint32_t i) const { return dense[i]; }
+};
+
+template<class T> void swapRemove(std::vector<T>& v, uint32_t i) {
+	v[i] = v.back();
+	v.pop_back();
+}
+
+/// <summary>
+/// Transforms form a hierarchy: world = parent's world * local.
+/// setLocal() only flags the entity; update() then recomputes the
+/// dirty subtrees and nothing else, breadth first. Every entity in
+/// one level of that walk depends only on earlier levels, so each
+/// level is split across the job system.
+/// </summary>
+struct TransformPool : public SparseSet {
+	std::vector<glm::mat4> local, world;
+	std::vector<Entity> parent, firstChild, nextSibling;
+	std::vector<uint8_t> dirty;
+	std::vector<Entity> dirtyRoots;		//setLocal() since the last update
+	std::vector<Entity> changed;		//World matrices the last update() wrote, in level order
+	std::vector<uint32_t> levelStart;	//Where each level begins in changed
+
+	void add(Entity e, const glm::mat4& m);
+	//Children of e become roots and keep their world transforms.
+	void remove(Entity e);
+	void setLocal(Entity e, const glm::mat4& m);
+	//NULL_ENTITY detaches. Keeps the child where it was in the world
+	//as of the last update(). Returns 0 if it would make a cycle.
+	bool setParent(Entity child, Entity newParent);
+	void update();
+	void updateLevel(uint32_t begin, uint32_t end);
+};
+
+struct BoundsPool : public SparseSet {
+	std::vector<glm::vec3> localMin, localMax;
+	//World-space bounding spheres, one array per field for culling.
+	std::vector<float> centerX, centerY, centerZ, radius;
+	void add(Entity e, glm::vec3 bMin, glm::vec3 bMax);
+	void remove(Entity e);
+};
+
+//A range of EntityStore::drawList.
+struct MeshRefPool : public SparseSet {
+	std::vector<uint32_t> firstDraw, drawCount;
+	void add(Entity e, uint32_t first, uint32_t count);
+	void remove(Entity e);
+};
+
+//A range of EntityStore::meshList: the meshes of the entity's Model.
+struct ModelRefPool : public SparseSet {
+	std::vector<uint32_t> firstMesh, meshCount;
+	void add(Entity e, uint32_t first, uint32_t count);
+	void remove(Entity e);
+};
+
+//Resolved through materialHandles when used, so a Material deleted
+//before its entity is passed over instead of read.
+struct MaterialRefPool : public SparseSet {
+	std::vector<Handle<Material>> material;
+	void add(Entity e, Handle<Material> m);
+	void remove(Entity e);
+};
+
+//Entities with draws but no bounds, so not in the octree. cullSystem
+//keeps them whenever their layer is visible.
+struct UnboundedPool : public SparseSet {
+	void add(Entity e);
+	void remove(Entity e);
+};
+
+/// <summary>
+/// EntityStore. Hands out entities and owns the component pools.
+/// </summary>
+class EntityStore {
+	private:
+		std::vector<uint32_t> freeEntities;	//Indices
+		std::vector<uint32_t> generations;	//Current generation per index
+		std::vector<LayerMask> layers;		//Per index
+		uint32_t deadDraws = 0, deadMeshes = 0;	//drawList/meshList entries no entity uses any more
+
+		//Rebuilds drawList and meshList from the ranges still in use,
+		//once at least half of either is dead.
+		void compactLists();
+	public:
+		TransformPool transforms;
+		BoundsPool bounds;
+		MeshRefPool meshes;
+		ModelRefPool models;
+		MaterialRefPool materials;
+		UnboundedPool unbounded;
+		//Ranges of these belong to meshes and models. Destroying an
+		//entity leaves its range dead until compactLists() moves the
+		//others down over it.
+		std::vector<BufferHandle> drawList;
+		std::vector<Handle<Mesh>> meshList;
+		uint32_t version = 0;	//Changes whenever an entity is attached or destroyed
+		Octree octree;		//Over bounds, kept current by boundsSystem
+
+		Entity create();
+		void destroy(Entity e);
+		bool alive(Entity e) const {
+			return e != NULL_ENTITY && handleIndex(e) < generations.size() && generations[handleIndex(e)] == handleGeneration(e);
+		}
+		LayerMask getLayers(Entity e) const { return alive(e) ? layers[handleIndex(e)] : 0; }
+		void setLayers(Entity e, LayerMask mask);
+		//Makes an entity from a loaded WorldObject's Model and Material.
+		Entity attach(WorldObject* obj);
+		//Gives e the meshes it is picked by.
+		void addMeshes(Entity e, const Handle<Mesh>* list, uint32_t count);
+		//The mesh's vertices changed: redoes the local bounds of every
+		//entity using it, and their world bounds and octree places.
+		void meshBoundsChanged(Handle<Mesh> h);
+};
+
+//Systems. Each one streams over the pools it needs.
+
+//Recomputes e's world bounding sphere and octree place from its local
+//bounds and world matrix (identity without a transform).
+void updateWorldBounds(EntityStore& store, Entity e);
+//Recomputes world bounding spheres of whatever transforms.update() changed.
+void boundsSystem(EntityStore& store);
+//Appends every entity on a visible layer whose bounds touch the
+//camera frustum, found through store.octree, and every entity in
+//store.unbounded on a visible layer.
+void cullSystem(EntityStore& store, const jglCamera& cam, std::vector<Entity>& visible);
+//Records how large each visible entity is on screen; the render
+//thread passes that on to textureResidency.
+void residencySystem(EntityStore& store, jglCamera& cam, const std::vector<Entity>& visible, RenderPacket& packet);
+//Adds the draws of every visible entity to the frame's packet.
+void submitSystem(EntityStore& store, const std::vector<Entity>& visible, RenderPacket& packet);
+
+extern EntityStore scene;
+
+#endif
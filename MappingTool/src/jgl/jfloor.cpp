@@ -0,0 +1,73 @@
+#include "jfloor.h"
+#include "headers/shader.hpp"
+#include <iostream>
+#include <glm/gtc/matrix_inverse.hpp>
+
+ReferenceGrid referenceGrid;
+
+void ReferenceGrid::submit(float level, RenderPacket& packet) const {
+	if (!visible)
+		return;
+	packet.grid.draw = 1;
+	packet.grid.level = level;
+	packet.grid.spacing = spacing;
+	packet.grid.majorEvery = majorEvery;
+	packet.grid.maxDistance = maxDistance;
+}
+
+bool ReferenceGrid::init() {
+	if (vao)
+		return 1;
+	if (failed)
+		return 0;
+	failed = 1;	//Until everything below works out; no retrying every frame.
+	program = LoadShaders("src/shaders/floorvert.glsl", "src/shaders/floorfrag.glsl");
+	if (!program) {
+		std::cout << "FLOOR: could not load the reference grid shaders\n";
+		return 0;
+	}
+	vpID = glGetUniformLocation(program, "VP");
+	invVPID = glGetUniformLocation(program, "invVP");
+	eyeID = glGetUniformLocation(program, "eye");
+	levelID = glGetUniformLocation(program, "level");
+	spacingID = glGetUniformLocation(program, "spacing");
+	majorID = glGetUniformLocation(program, "majorEvery");
+	distanceID = glGetUniformLocation(program, "maxDistance");
+	//Core profile wants a VAO bound even though nothing is read.
+	glGenVertexArrays(1, &vao);
+	failed = 0;
+	return 1;
+}
+
+void ReferenceGrid::render(const RenderPacket& packet) {
+	const GridRequest& g = packet.grid;
+	if (!g.draw || !init())
+		return;
+	glm::mat4 invVP = glm::inverse(packet.VP);
+
+	//Like the ghosts: tested against the scene, blended, no depth written.
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+	glUseProgram(program);
+	glUniformMatrix4fv(vpID, 1, GL_FALSE, &packet.VP[0][0]);
+	glUniformMatrix4fv(invVPID, 1, GL_FALSE, &invVP[0][0]);
+	glUniform3fv(eyeID, 1, &packet.eye[0]);
+	glUniform1f(levelID, g.level);
+	glUniform1f(spacingID, g.spacing);
+	glUniform1f(majorID, (float)g.majorEvery);
+	glUniform1f(distanceID, g.maxDistance);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void ReferenceGrid::release() {
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	if (program)
+		glDeleteProgram(program);
+	vao = program = 0;
+}
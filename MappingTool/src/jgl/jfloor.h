@@ -0,0 +1,49 @@
+#ifndef JFLOOR_H
+#define JFLOOR_H
+
+#include <GL/glew.h>
+#include "jbufferqueue.h"
+
+///
+/// The floor reference grid: minor lines every tile, major lines every
+/// majorEvery tiles and the world axes, on the working level, out to
+/// the horizon. There is no geometry. One triangle covers the screen,
+/// and the fragment shader intersects each pixel's view ray with the
+/// plane and works out from there how near it is to a line. Lines
+/// stay about a pixel wide at any distance (the distance to a line is
+/// measured with screen-space derivatives), cells too small to make
+/// out fade away rather than shimmer, and everything fades out towards
+/// maxDistance.
+///
+/// So it costs one pass over the screen, whatever the size of the map.
+///
+
+/// <summary>
+/// ReferenceGrid. submit() is for the main thread; render() and
+/// release() are for the GL thread.
+/// </summary>
+class ReferenceGrid {
+	private:
+		GLuint program = 0, vao = 0;
+		GLint vpID = -1, invVPID = -1, eyeID = -1, levelID = -1, spacingID = -1, majorID = -1, distanceID = -1;
+		bool failed = 0;
+
+		bool init();
+	public:
+		//Main thread only; the render thread gets them through the packet.
+		bool visible = 1;
+		float spacing = 1.0f;		//Between minor lines: a tile, the ghost grid's snap
+		int majorEvery = 8;
+		float maxDistance = 200.0f;
+
+		//Asks for the grid on y = level this frame, if it is visible.
+		void submit(float level, RenderPacket& packet) const;
+		//Draws packet.grid. Call after the opaque draws and before other
+		//see-through ones, so those blend over it.
+		void render(const RenderPacket& packet);
+		void release();
+};
+
+extern ReferenceGrid referenceGrid;
+
+#endif
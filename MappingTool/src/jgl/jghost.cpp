@@ -0,0 +1,183 @@
+#include "jghost.h"
+#include "jstream.h"
+#include "headers/shader.hpp"
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <glm/geometric.hpp>
+
+GhostGrid ghostGrid;
+
+#pragma region Gather:
+void GhostGrid::gather(const glm::vec4 frustum[6], glm::vec3 eye, std::vector<glm::vec4>& out) const {
+	//Within maxDistance is a circle on the level's plane.
+	float y = (float)level, dy = y - eye.y;
+	float reach2 = maxDistance * maxDistance - dy * dy;
+	if (reach2 <= 0.0f)
+		return;
+	float reach = sqrtf(reach2);
+	float fadeStart = GHOST_FADE_START * maxDistance;
+	size_t limit = out.size() + GHOST_MAX_POINTS;
+
+	for (int z = (int)ceilf(eye.z - reach); z <= (int)floorf(eye.z + reach); z++) {
+		float dz = (float)z - eye.z;
+		float half = sqrtf(std::max(reach2 - dz * dz, 0.0f));
+		float xMin = eye.x - half, xMax = eye.x + half;
+		//On this row each plane reads a * x + b >= 0, which keeps
+		//the x on one side of -b / a. Planes are normalized, so adding
+		//the radius keeps spheres whose centers are just outside.
+		for (int p = 0; p < 6 && xMin <= xMax; p++) {
+			float a = frustum[p].x;
+			float b = frustum[p].y * y + frustum[p].z * (float)z + frustum[p].w + GHOST_RADIUS;
+			if (fabsf(a) < 1e-6f) {
+				if (b < 0.0f)
+					xMax = xMin - 1.0f;
+			}
+			else if (a > 0.0f) {
+				xMin = std::max(xMin, -b / a);
+			}
+			else {
+				xMax = std::min(xMax, -b / a);
+			}
+		}
+		for (int x = (int)ceilf(xMin); x <= (int)floorf(xMax); x++) {
+			if (out.size() >= limit)
+				return;
+			glm::vec3 center((float)x, y, (float)z);
+			float dist = glm::length(center - eye);
+			float fade = 1.0f - std::clamp((dist - fadeStart) / std::max(maxDistance - fadeStart, 1e-3f), 0.0f, 1.0f);
+			out.push_back(glm::vec4(center, GHOST_OPACITY * fade));
+		}
+	}
+}
+
+void GhostGrid::submit(const glm::vec4 frustum[6], glm::vec3 eye, RenderPacket& packet) const {
+	gather(frustum, eye, packet.ghosts);
+	packet.ghostImpostors = mode == GHOST_IMPOSTOR;
+}
+#pragma endregion
+
+#pragma region Render:
+bool GhostGrid::init() {
+	if (vao)
+		return 1;
+	if (failed)
+		return 0;
+	failed = 1;	//Until everything below works out; no retrying every frame.
+	program = LoadShaders("src/shaders/ghostvert.glsl", "src/shaders/ghostfrag.glsl");
+	impostorProgram = LoadShaders("src/shaders/impostorvert.glsl", "src/shaders/impostorfrag.glsl");
+	if (!program || !impostorProgram) {
+		std::cout << "GHOST: could not load the ghost shaders\n";
+		release();
+		return 0;
+	}
+	vpID = glGetUniformLocation(program, "VP");
+	radiusID = glGetUniformLocation(program, "radius");
+	impostorVPID = glGetUniformLocation(impostorProgram, "VP");
+	impostorRadiusID = glGetUniformLocation(impostorProgram, "radius");
+	impostorEyeID = glGetUniformLocation(impostorProgram, "eye");
+
+	//A unit UV sphere; the shader scales and places each copy.
+	std::vector<glm::vec3> positions;
+	for (int r = 0; r <= GHOST_SPHERE_RINGS; r++) {
+		float polar = 3.14159265f * r / GHOST_SPHERE_RINGS;
+		for (int s = 0; s <= GHOST_SPHERE_SEGMENTS; s++) {
+			float azimuth = 6.2831853f * s / GHOST_SPHERE_SEGMENTS;
+			positions.push_back(glm::vec3(sinf(polar) * cosf(azimuth), cosf(polar), sinf(polar) * sinf(azimuth)));
+		}
+	}
+	std::vector<unsigned short> indices;
+	for (int r = 0; r < GHOST_SPHERE_RINGS; r++) {
+		for (int s = 0; s < GHOST_SPHERE_SEGMENTS; s++) {
+			unsigned short i = (unsigned short)(r * (GHOST_SPHERE_SEGMENTS + 1) + s);
+			unsigned short below = (unsigned short)(i + GHOST_SPHERE_SEGMENTS + 1);
+			unsigned short quad[6] = { i, below, (unsigned short)(i + 1), (unsigned short)(i + 1), below, (unsigned short)(below + 1) };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	indexCount = (GLsizei)indices.size();
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(1, &sphereVertices);
+	glBindBuffer(GL_ARRAY_BUFFER, sphereVertices);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glGenBuffers(1, &sphereIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+	//One (center, opacity) per sphere drawn, at 3; it comes out of
+	//streamRing, so render() points it there each frame.
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+
+	//Impostors need nothing but the instances; the vertex shader makes
+	//each quad's corners from gl_VertexID.
+	glGenVertexArrays(1, &impostorVAO);
+	glBindVertexArray(impostorVAO);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	failed = 0;
+	return 1;
+}
+
+void GhostGrid::render(const RenderPacket& packet) {
+	if (packet.ghosts.empty() || !init())
+		return;
+	size_t count = std::min(packet.ghosts.size(), (size_t)GHOST_MAX_POINTS);
+
+	GLintptr offset = streamRing.write(packet.ghosts.data(), count * sizeof(glm::vec4));
+	if (offset < 0)
+		return;
+	GLuint drawVAO = packet.ghostImpostors ? impostorVAO : vao;
+	glBindVertexArray(drawVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, streamRing.getBuffer());
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)offset);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//Blended over the scene and tested against its depth, but without
+	//writing any, so the spheres don't hide one another.
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+	if (packet.ghostImpostors) {
+		glUseProgram(impostorProgram);
+		glUniformMatrix4fv(impostorVPID, 1, GL_FALSE, &packet.VP[0][0]);
+		glUniform1f(impostorRadiusID, GHOST_RADIUS);
+		glUniform3fv(impostorEyeID, 1, &packet.eye[0]);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
+	}
+	else {
+		glUseProgram(program);
+		glUniformMatrix4fv(vpID, 1, GL_FALSE, &packet.VP[0][0]);
+		glUniform1f(radiusID, GHOST_RADIUS);
+		glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0, (GLsizei)count);
+	}
+	glBindVertexArray(0);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void GhostGrid::release() {
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	if (impostorVAO)
+		glDeleteVertexArrays(1, &impostorVAO);
+	GLuint buffers[2] = { sphereVertices, sphereIndices };
+	for (GLuint b : buffers) {
+		if (b)
+			glDeleteBuffers(1, &b);
+	}
+	if (program)
+		glDeleteProgram(program);
+	if (impostorProgram)
+		glDeleteProgram(impostorProgram);
+	vao = sphereVertices = sphereIndices = program = 0;
+	impostorVAO = impostorProgram = 0;
+}
+#pragma endregion
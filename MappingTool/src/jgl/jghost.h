@@ -0,0 +1,76 @@
+#ifndef JGHOST_H
+#define JGHOST_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "jbufferqueue.h"
+
+///
+/// The ghost-sphere grid: a translucent sphere on every grid point of
+/// the working level, to click on and drag between. Nothing is stored
+/// per sphere. Each frame the main thread works out which grid points
+/// are in the camera's frustum and within maxDistance, row by row
+/// (each frustum plane cuts a row to an interval), and writes their
+/// centers and opacities into the RenderPacket. The render thread
+/// streams those through streamRing and draws them all with one
+/// instanced draw of a shared low-poly sphere.
+///
+/// So the cost follows the number of visible points, which maxDistance
+/// bounds, and not the size of the map.
+///
+/// Spheres can be drawn two ways. GHOST_MESH draws a shared low-poly
+/// sphere per point. GHOST_IMPOSTOR draws a quad per point, just big
+/// enough to cover the sphere as seen from the camera; the fragment
+/// shader intersects the view ray with the exact sphere, discards
+/// misses and writes the hit's depth and normal. That is four vertices
+/// a sphere instead of dozens, and round at any size on screen.
+///
+
+const int GHOST_SPHERE_RINGS = 6;		//Latitude bands of the shared sphere
+const int GHOST_SPHERE_SEGMENTS = 8;	//Longitude slices
+const int GHOST_MAX_POINTS = 1 << 16;	//Points past this are left out
+const float GHOST_RADIUS = 0.08f;
+const float GHOST_OPACITY = 0.35f;		//Up close; it fades to 0 at maxDistance
+const float GHOST_FADE_START = 0.6f;	//Fraction of maxDistance where fading starts
+
+enum GhostMode {
+	GHOST_MESH,
+	GHOST_IMPOSTOR
+};
+
+/// <summary>
+/// GhostGrid. gather() is for the main thread; render() and release()
+/// are for the GL thread.
+/// </summary>
+class GhostGrid {
+	private:
+		GLuint program = 0, vao = 0, sphereVertices = 0, sphereIndices = 0;
+		GLint vpID = -1, radiusID = -1;
+		GLuint impostorProgram = 0, impostorVAO = 0;
+		GLint impostorVPID = -1, impostorRadiusID = -1, impostorEyeID = -1;
+		GLsizei indexCount = 0;
+		bool failed = 0;
+
+		bool init();
+	public:
+		//Main thread only; the render thread gets what they made.
+		int level = 0;					//Height (y) of the working grid
+		float maxDistance = 40.0f;		//From the camera
+		GhostMode mode = GHOST_IMPOSTOR;
+
+		//Appends the grid points whose spheres are inside the frustum
+		//(inward planes, as frustumPlanes() makes them) and within
+		//maxDistance of eye, as (center, opacity).
+		void gather(const glm::vec4 frustum[6], glm::vec3 eye, std::vector<glm::vec4>& out) const;
+		//Gathers into packet.ghosts and tells it how to draw them.
+		void submit(const glm::vec4 frustum[6], glm::vec3 eye, RenderPacket& packet) const;
+		//Draws packet.ghosts. Call after the frame's opaque draws.
+		void render(const RenderPacket& packet);
+		void release();
+};
+
+extern GhostGrid ghostGrid;
+
+#endif
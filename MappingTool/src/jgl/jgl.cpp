@@ -19,10 +19,11 @@ void printMatrix(float* elementZero, int sizeRows, int sizeCols) {
 }
 
 float jglVariables::getAspectRatio() {
-	return XY_Resolution[0] / XY_Resolution[1];
+	return (float)XY_Resolution[0] / (float)XY_Resolution[1];
 }
 
-jglCamera::jglCamera(float fov, glm::vec3 posM, glm::vec3 lookAt) {
+jglCamera::jglCamera(float fovM, glm::vec3 posM, glm::vec3 lookAt) {
+	fov = fovM;
 	position = posM;
 	View = glm::lookAt(position, lookAt, glm::vec3(0, 1, 0));
 	Model = glm::mat4(1.0f); //eye(4)
@@ -59,17 +60,50 @@ void jglCamera::updateView() {
 	);
 
 	VP = Projection * View;
+	updateFrustum();
 
 	positionOld = position;
 	horizOld = horizAng;
 	vertOld = vertAng;
 }
 
+void jglCamera::updateFrustum() {
+	frustumPlanes(VP, frustum);
+}
+
+bool jglCamera::sphereVisible(glm::vec3 center, float radius) {
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(frustum[i]), center) + frustum[i].w < -radius)
+			return 0;
+	}
+	return 1;
+}
+
+float jglCamera::projectedPixels(glm::vec3 center, float radius) {
+	float dist = glm::length(center - position);
+	if (dist <= radius)
+		return (float)glWindow->XY_Resolution[1]; //Camera is inside it.
+	float halfFovTan = tanf(glm::radians(fov) * 0.5f);
+	return (radius / (dist * halfFovTan)) * glWindow->XY_Resolution[1];
+}
+
+void jglCamera::screenRay(double x, double y, glm::vec3& origin, glm::vec3& dir) {
+	float ndcX = (float)(2.0 * x / glWindow->XY_Resolution[0] - 1.0);
+	float ndcY = (float)(1.0 - 2.0 * y / glWindow->XY_Resolution[1]);
+	glm::mat4 inv = glm::inverse(VP);
+	glm::vec4 nearP = inv * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farP = inv * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	origin = glm::vec3(nearP) / nearP.w;
+	dir = glm::normalize(glm::vec3(farP) / farP.w - origin);
+}
+
 void windowSizeCallback(GLFWwindow* window, int width, int height) {
 	glWindow->XY_Resolution[0] = width;
-	glWindow->XY_Resolution[0] = height;
-	glViewport(0, 0, width, height);
+	glWindow->XY_Resolution[1] = height;
+	//glViewport happens on the render thread, from the packet.
 	camera.Projection = glm::perspective(glm::radians(camera.fov), glWindow->getAspectRatio(), 0.1f, 100.0f);
+	camera.VP = camera.Projection * camera.View;
+	camera.updateFrustum();
 }
 
 // This macro will help us make the attribute pointers
@@ -78,13 +112,36 @@ void windowSizeCallback(GLFWwindow* window, int width, int height) {
 #define SetupAttribute(index, size, type, structure, element) \
 	glVertexAttribPointer(index, size, type, 0, sizeof(structure), (void*)offsetof(structure, element)); \
 
-void glRender() {
-	while (!glVAOs.empty()) {
-		glBindVertexArray(glVAOs.front()->VAO);
-		glDrawElements(GL_TRIANGLES, glVAOs.front()->numIndices, GL_UNSIGNED_SHORT, 0);
+void glRender(const RenderPacket& packet) {
+	glViewport(0, 0, packet.width, packet.height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glUseProgram(glWindow->programID);
+
+	//I'm just commenting this here so some lone
+	//reader might know my struggle.
+	//I spent AN ENTIRE DAY trying to fix 
+	//an access violation issue regarding
+	//&camera.Model[0][0]. And you know what
+	//fixed it? I had the std::string type inside
+	//of Module default to NULL, which is an issue
+	//of its own, but that manifested itself as
+	//an access violation here?!?!?!? WHY?
+	//Lesson be learned, fellas: what you think
+	//is the issue and what you're told is the issue
+	//might not actually be the issue.
+
+	glUniformMatrix4fv(glWindow->modelMatID, 1, GL_FALSE, &packet.model[0][0]);
+	glUniformMatrix4fv(glWindow->projCamMatID, 1, GL_FALSE, &packet.VP[0][0]);
+
+	for (const DrawRecord& draw : packet.draws) {
+		glUniformMatrix4fv(glWindow->modelMatID, 1, GL_FALSE, &draw.model[0][0]);
+		glUniform1f(glWindow->alphaCutoffID, draw.alphaTest ? IDPICK_ALPHA_CUTOFF : 0.0f);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, draw.texture);
+		glBindVertexArray(draw.VAO);
+		glDrawElements(GL_TRIANGLES, draw.numIndices, GL_UNSIGNED_SHORT, 0);
 		//glDrawArrays(GL_TRIANGLES, 0, glVAOs.front()->numIndices);
 		glBindVertexArray(0);
-		glVAOs.pop();
 	}
 }
 
@@ -129,31 +186,38 @@ bool glInit() {
 	std::cout << "loadshaders   " << glGetError() << std::endl; // returns 0 (no error)
 	glWindow->modelMatID = glGetUniformLocation(glWindow->programID, "M");
 	glWindow->projCamMatID = glGetUniformLocation(glWindow->programID, "VP");
+	glWindow->alphaCutoffID = glGetUniformLocation(glWindow->programID, "alphaCutoff");
 
 	GLuint VertexArrayID;
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
 
 	glfwSetKeyCallback(glWindow->window, KeyEvent);
+	glfwSetMouseButtonCallback(glWindow->window, MouseEvent);
 	glfwSetWindowSizeCallback(glWindow->window, windowSizeCallback);
 	glClearColor(glWindow->bgColor[0], glWindow->bgColor[1], glWindow->bgColor[2], glWindow->bgColor[3]);
 
 	std::cout << userVars->Window_Title << " Loaded. GLFW, GLEW initialized.\n";
 
-	//TODO: Init all possible textures and assign them GLuint texture values from GL.
-	//Put into a map with (string absoluteFilePath, GLuint texture)
-	//Whenever a texture is needed, poll the map for its filepath and use that texture
-	//This avoids loading the same texture multiple times.
-	//Will need to adjust jmodule textures[] vectors to be strings instead of GLuints
+	//Textures are loaded the first time getTexture() is asked for them.
+	//If a pack has been built with TexPacker it is checked before loose
+	//files, so startup doesn't have to open and decode every image.
+	texturePack.open("src/assets/textures.jtp");
+	//One worker per core for jobs. Thumbnails keep two threads of their
+	//own since they spend most of their time waiting on file reads.
+	jobSystem.start();
+	//Palette previews are made in the background as they're asked for.
+	thumbnailService.start("src/assets/thumbs.jtc", 2);
 
 	Initialize();
 
+	//From here on only the render thread touches GL.
+	renderThread.start(glWindow->window);
+
 	return 1;
 }
 
 bool glLoop() {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
 	///
 	/// Calculating length of frame for movement math.
 	/// 
@@ -178,24 +242,13 @@ bool glLoop() {
 	/// 
 	/// Matrix calculation before sending to GPU
 	///
-	
-	glUseProgram(glWindow->programID);
 
-	//I'm just commenting this here so some lone
-	//reader might know my struggle.
-	//I spent AN ENTIRE DAY trying to fix 
-	//an access violation issue regarding
-	//&camera.Model[0][0]. And you know what
-	//fixed it? I had the std::string type inside
-	//of Module default to NULL, which is an issue
-	//of its own, but that manifested itself as
-	//an access violation here?!?!?!? WHY?
-	//Lesson be learned, fellas: what you think
-	//is the issue and what you're told is the issue
-	//might not actually be the issue.
-
-	glUniformMatrix4fv(glWindow->modelMatID, 1, GL_FALSE, &camera.Model[0][0]);
-	glUniformMatrix4fv(glWindow->projCamMatID, 1, GL_FALSE, &camera.VP[0][0]);
+	RenderPacket& packet = renderThread.packet();
+	packet.model = camera.Model;
+	packet.VP = camera.VP;
+	packet.eye = camera.position;
+	packet.width = glWindow->XY_Resolution[0];
+	packet.height = glWindow->XY_Resolution[1];
 
 	///
 	/// Render whatever has to be rendered here:::
@@ -204,13 +257,13 @@ bool glLoop() {
 	//TODO: Poll through every WorldObject and find renderable ones, then call
 	//render() on their material modules
 	WorldRenderPoll(); //This should resolve that todo.
-	glRender();
 
 	/// 
 	/// End of Frame's Work
 	/// 
 
-	glfwSwapBuffers(glWindow->window);
+	//The render thread draws and swaps this frame while we start the next.
+	renderThread.submit();
 	glfwPollEvents();
 
 	///
@@ -224,10 +277,19 @@ bool glLoop() {
 }
 
 void glDeactivate() {
+	//Takes the context back to this thread before anything frees GL objects.
+	renderThread.stop();
+	idPicker.release();
+	ghostGrid.release();
+	previewRenderer.release();
+	referenceGrid.release();
+	streamRing.release();
+	thumbnailService.stop();
+	//User cleanup frees GL objects, so it runs while the context is alive.
+	Deactivate();
+	jobSystem.stop();
 	glDeleteProgram(glWindow->programID);
 
 	glfwDestroyWindow(glWindow->window);
 	glfwTerminate();
-
-	Deactivate();
 }
\ No newline at end of file
@@ -12,6 +12,17 @@
 #include <glm/vec3.hpp>
 #include <algorithm>
 #include "jbufferqueue.h"
+#include "jtexpack.h"
+#include "jresidency.h"
+#include "jthumbs.h"
+#include "jjobs.h"
+#include "jrender.h"
+#include "joctree.h"
+#include "jbvh.h"
+#include "jidpick.h"
+#include "jghost.h"
+#include "jstream.h"
+#include "jfloor.h"
 
 //User defined. Runs before loop, at startup.
 void Initialize();	
@@ -21,11 +32,14 @@ void Loop();
 void Deactivate();
 //User defined. Runs whenever a key is pressed/repeated/released.
 void KeyEvent(GLFWwindow* window, int key, int scancode, int action, int mods);
+//User defined. Runs whenever a mouse button is pressed/released.
+void MouseEvent(GLFWwindow* window, int button, int action, int mods);
 
 //Functions related to jgl operation.
 void WorldRenderPoll();
 void windowSizeCallback(GLFWwindow* window, int width, int height);
-void glRender();
+//Draws a packet. GL thread only.
+void glRender(const RenderPacket& packet);
 bool glInit();
 bool glLoop();
 void glDeactivate();
@@ -52,7 +66,7 @@ struct jglUserVars {
 struct jglVariables {
 	GLFWwindow* window = NULL;
 	int XY_Resolution[2] = { 1024, 768 };
-	GLuint programID, modelMatID, projCamMatID;
+	GLuint programID, modelMatID, projCamMatID, alphaCutoffID;
 	glm::vec4 bgColor = glm::vec4(0, 0, 0.4, 0); //dark blue
 	float lastTime = 0.0f, deltaTime = 0.0f, secondCt = 0.0f;
 	int frames, msPerFrameAvg;
@@ -71,10 +85,19 @@ class jglCamera {
 		glm::mat4 Projection = glm::mat4(0.0f);
 		glm::mat4 VP = glm::mat4(0.0f);
 		glm::vec3 direction, right, up;
+		glm::vec4 frustum[6]; //Planes (normal, distance) pointing inwards.
+		uint64_t visibleLayers = UINT64_MAX; //LayerMask of what culling lets through.
 		double horizAng = 3.14f;
 		double vertAng = 0.0f;
 		jglCamera(float fov, glm::vec3 posM, glm::vec3 lookAt);
 		void updateView();
+		void updateFrustum();
+		bool sphereVisible(glm::vec3 center, float radius);
+		//Approximate on-screen diameter of a sphere, in pixels.
+		float projectedPixels(glm::vec3 center, float radius);
+		//World-space ray through window pixel (x, y), top-left origin.
+		//dir is normalized.
+		void screenRay(double x, double y, glm::vec3& origin, glm::vec3& dir);
 };
 
 extern jglVariables* glWindow;
@@ -0,0 +1,441 @@
+#include "jgrid.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+#include <glm/common.hpp>
+
+TileGrid mapGrid("map chunk");
+
+static const glm::ivec3 FACE_DIRS[6] = {
+	glm::ivec3(-1, 0, 0), glm::ivec3(1, 0, 0),
+	glm::ivec3(0, -1, 0), glm::ivec3(0, 1, 0),
+	glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1)
+};
+
+static glm::ivec3 chunkOf(glm::ivec3 t) {
+	return glm::ivec3(t.x >> CHUNK_BITS, t.y >> CHUNK_BITS, t.z >> CHUNK_BITS);
+}
+
+#pragma region TileChunk:
+TileChunk::TileChunk(glm::ivec3 coordIn) {
+	coord = coordIn;
+	std::fill(rows, rows + CHUNK_SIZE * CHUNK_SIZE, 0);
+	runs.push_back({ (uint16_t)CHUNK_TILES, 0 });
+}
+
+TileMaterial TileChunk::material(int index) const {
+	auto run = std::upper_bound(runs.begin(), runs.end(), index, [](int i, const MaterialRun& r) { return i < r.end; });
+	return run->material;
+}
+
+void TileChunk::setRange(int begin, int end, TileMaterial m) {
+	auto endsBefore = [](const MaterialRun& r, int i) { return r.end <= i; };
+	//First and last runs the range touches.
+	int a = (int)(std::lower_bound(runs.begin(), runs.end(), begin, endsBefore) - runs.begin());
+	int b = (int)(std::lower_bound(runs.begin(), runs.end(), end - 1, endsBefore) - runs.begin());
+	int startA = a ? runs[a - 1].end : 0;
+
+	MaterialRun pieces[3];
+	int n = 0;
+	if (begin > startA)
+		pieces[n++] = { (uint16_t)begin, runs[a].material };
+	pieces[n++] = { (uint16_t)end, m };
+	if (end < runs[b].end)
+		pieces[n++] = runs[b];
+	runs.erase(runs.begin() + a, runs.begin() + b + 1);
+	runs.insert(runs.begin() + a, pieces, pieces + n);
+
+	//Merge with equal neighbors so runs stay as few as possible.
+	int lo = std::max(a - 1, 0), hi = std::min(a + n, (int)runs.size() - 1);
+	for (int i = hi; i > lo; i--) {
+		if (runs[i].material == runs[i - 1].material) {
+			runs[i - 1].end = runs[i].end;
+			runs.erase(runs.begin() + i);
+		}
+	}
+}
+#pragma endregion
+
+#pragma region TileGrid:
+//Sign extends one 21-bit axis of a chunk key.
+static int keyAxis(uint64_t key, int shift) {
+	return (int32_t)((uint32_t)(key >> shift) << 11) >> 11;
+}
+
+uint64_t TileGrid::chunkKey(glm::ivec3 c) {
+	//21 bits an axis is about 67 million tiles across.
+	return ((uint64_t)(c.x & 0x1FFFFF)) | ((uint64_t)(c.y & 0x1FFFFF) << 21) | ((uint64_t)(c.z & 0x1FFFFF) << 42);
+}
+
+TileChunk* TileGrid::find(glm::ivec3 c) const {
+	uint64_t key = chunkKey(c);
+	if (key == lastKey)
+		return lastChunk;
+	auto it = chunks.find(key);
+	if (it == chunks.end())
+		return NULL;
+	lastKey = key;
+	lastChunk = it->second;
+	return lastChunk;
+}
+
+TileChunk* TileGrid::findOrCreate(glm::ivec3 c) {
+	TileChunk* chunk = find(c);
+	if (chunk)
+		return chunk;
+	chunk = chunkPool.create(c);
+	chunks[chunkKey(c)] = chunk;
+	lastKey = chunkKey(c);
+	lastChunk = chunk;
+	return chunk;
+}
+
+void TileGrid::markDirty(TileChunk* chunk) {
+	if (chunk->dirty)
+		return;
+	chunk->dirty = 1;
+	dirtyKeys.push_back(chunkKey(chunk->coord));
+}
+
+void TileGrid::markDirty(glm::ivec3 c) {
+	TileChunk* chunk = find(c);
+	if (chunk)
+		markDirty(chunk);
+}
+
+void TileGrid::release(TileChunk* chunk) {
+	//Already dirty, so remeshDirty() still hears about it.
+	chunks.erase(chunkKey(chunk->coord));
+	if (lastChunk == chunk) {
+		lastKey = UINT64_MAX;
+		lastChunk = NULL;
+	}
+	chunkPool.destroy(chunk);
+}
+
+void TileGrid::faceNeighbors(const TileChunk& chunk, const TileChunk* out[6]) const {
+	for (int i = 0; i < 6; i++)
+		out[i] = find(chunk.coord + FACE_DIRS[i]);
+}
+
+bool TileGrid::filled(glm::ivec3 t) const {
+	const TileChunk* chunk = find(chunkOf(t));
+	return chunk && chunk->filled(t.x & CHUNK_MASK, t.y & CHUNK_MASK, t.z & CHUNK_MASK);
+}
+
+TileMaterial TileGrid::get(glm::ivec3 t) const {
+	const TileChunk* chunk = find(chunkOf(t));
+	if (!chunk)
+		return 0;
+	return chunk->material(TileChunk::index(t.x & CHUNK_MASK, t.y & CHUNK_MASK, t.z & CHUNK_MASK));
+}
+
+void TileGrid::set(glm::ivec3 t, TileMaterial m) {
+	glm::ivec3 c = chunkOf(t);
+	TileChunk* chunk = m ? findOrCreate(c) : find(c);
+	if (!chunk)
+		return;
+	int x = t.x & CHUNK_MASK, y = t.y & CHUNK_MASK, z = t.z & CHUNK_MASK;
+	int i = TileChunk::index(x, y, z);
+	uint32_t& row = chunk->rows[z + (y << CHUNK_BITS)];
+	bool was = (row >> x) & 1;
+	if (was == (m != 0) && chunk->material(i) == m)
+		return;
+
+	chunk->setRange(i, i + 1, m);
+	markDirty(chunk);
+	if (was != (m != 0)) {
+		row ^= 1u << x;
+		chunk->count += m ? 1 : -1;
+		tiles += m ? 1 : -1;
+		//Faces across a chunk boundary belong to the chunk next door too.
+		if (x == 0)				markDirty(c + FACE_DIRS[0]);
+		if (x == CHUNK_MASK)	markDirty(c + FACE_DIRS[1]);
+		if (y == 0)				markDirty(c + FACE_DIRS[2]);
+		if (y == CHUNK_MASK)	markDirty(c + FACE_DIRS[3]);
+		if (z == 0)				markDirty(c + FACE_DIRS[4]);
+		if (z == CHUNK_MASK)	markDirty(c + FACE_DIRS[5]);
+	}
+	if (!chunk->count)
+		release(chunk);
+}
+
+void TileGrid::fill(glm::ivec3 bMin, glm::ivec3 bMax, TileMaterial m) {
+	glm::ivec3 lo = glm::min(bMin, bMax), hi = glm::max(bMin, bMax);
+	glm::ivec3 cMin = chunkOf(lo), cMax = chunkOf(hi);
+	for (int cy = cMin.y; cy <= cMax.y; cy++)
+	for (int cz = cMin.z; cz <= cMax.z; cz++)
+	for (int cx = cMin.x; cx <= cMax.x; cx++) {
+		glm::ivec3 c(cx, cy, cz);
+		TileChunk* chunk = m ? findOrCreate(c) : find(c);
+		if (!chunk)
+			continue;
+		glm::ivec3 l = glm::max(lo - c * CHUNK_SIZE, glm::ivec3(0));
+		glm::ivec3 h = glm::min(hi - c * CHUNK_SIZE, glm::ivec3(CHUNK_MASK));
+		int width = h.x - l.x + 1;
+		uint32_t mask = (width == CHUNK_SIZE) ? ~0u : ((1u << width) - 1) << l.x;
+
+		//Rows that follow on from each other in run order go in as
+		//one range, so a full-width slab is a single setRange.
+		int pendingBegin = -1, pendingEnd = -1;
+		int changed = 0;
+		for (int y = l.y; y <= h.y; y++) {
+			for (int z = l.z; z <= h.z; z++) {
+				uint32_t& row = chunk->rows[z + (y << CHUNK_BITS)];
+				uint32_t next = m ? (row | mask) : (row & ~mask);
+				changed += std::popcount(next) - std::popcount(row);
+				row = next;
+
+				int begin = TileChunk::index(l.x, y, z), end = TileChunk::index(h.x, y, z) + 1;
+				if (begin != pendingEnd) {
+					if (pendingBegin >= 0)
+						chunk->setRange(pendingBegin, pendingEnd, m);
+					pendingBegin = begin;
+				}
+				pendingEnd = end;
+			}
+		}
+		chunk->setRange(pendingBegin, pendingEnd, m);
+		chunk->count += changed;
+		tiles += changed;
+
+		markDirty(chunk);
+		if (changed) {
+			if (l.x == 0)			markDirty(c + FACE_DIRS[0]);
+			if (h.x == CHUNK_MASK)	markDirty(c + FACE_DIRS[1]);
+			if (l.y == 0)			markDirty(c + FACE_DIRS[2]);
+			if (h.y == CHUNK_MASK)	markDirty(c + FACE_DIRS[3]);
+			if (l.z == 0)			markDirty(c + FACE_DIRS[4]);
+			if (h.z == CHUNK_MASK)	markDirty(c + FACE_DIRS[5]);
+		}
+		if (!chunk->count)
+			release(chunk);
+	}
+}
+
+uint8_t TileGrid::neighbors(glm::ivec3 t) const {
+	uint8_t mask = 0;
+	for (int i = 0; i < 6; i++) {
+		if (filled(t + FACE_DIRS[i]))
+			mask |= 1 << i;
+	}
+	return mask;
+}
+
+void TileGrid::exposedFaces(glm::ivec3 c, std::vector<TileFace>& out) const {
+	const TileChunk* chunk = find(c);
+	if (!chunk)
+		return;
+	const TileChunk* nb[6];
+	faceNeighbors(*chunk, nb);
+	glm::ivec3 base = c * CHUNK_SIZE;
+
+	for (int y = 0; y < CHUNK_SIZE; y++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			uint32_t b = chunk->row(y, z);
+			if (!b)
+				continue;
+			//What is filled next to each tile of the row, per face.
+			uint32_t across[6];
+			across[0] = (b << 1) | (nb[0] ? nb[0]->row(y, z) >> CHUNK_MASK : 0);
+			across[1] = (b >> 1) | (nb[1] ? (nb[1]->row(y, z) & 1) << CHUNK_MASK : 0);
+			across[2] = y > 0 ? chunk->row(y - 1, z) : (nb[2] ? nb[2]->row(CHUNK_MASK, z) : 0);
+			across[3] = y < CHUNK_MASK ? chunk->row(y + 1, z) : (nb[3] ? nb[3]->row(0, z) : 0);
+			across[4] = z > 0 ? chunk->row(y, z - 1) : (nb[4] ? nb[4]->row(y, CHUNK_MASK) : 0);
+			across[5] = z < CHUNK_MASK ? chunk->row(y, z + 1) : (nb[5] ? nb[5]->row(y, 0) : 0);
+
+			for (int f = 0; f < 6; f++) {
+				uint32_t exposed = b & ~across[f];
+				while (exposed) {
+					int x = std::countr_zero(exposed);
+					exposed &= exposed - 1;
+					out.push_back({ base + glm::ivec3(x, y, z), (uint8_t)(1 << f), chunk->material(TileChunk::index(x, y, z)) });
+				}
+			}
+		}
+	}
+}
+
+void TileGrid::remeshDirty(const std::function<void(glm::ivec3, const TileChunk*)>& f) {
+	//Taken out first so f is free to look around the grid.
+	std::vector<uint64_t> keys;
+	keys.swap(dirtyKeys);
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	for (uint64_t key : keys) {
+		auto it = chunks.find(key);
+		if (it != chunks.end()) {
+			it->second->dirty = 0;
+			f(it->second->coord, it->second);
+			continue;
+		}
+		//Freed since, so the coordinate comes from the key.
+		f(glm::ivec3(keyAxis(key, 0), keyAxis(key, 21), keyAxis(key, 42)), NULL);
+	}
+}
+
+void TileGrid::clear() {
+	for (auto& entry : chunks)
+		chunkPool.destroy(entry.second);
+	chunks.clear();
+	dirtyKeys.clear();
+	lastKey = UINT64_MAX;
+	lastChunk = NULL;
+	tiles = 0;
+}
+
+size_t TileGrid::getMemoryUsed() const {
+	//Node and bucket sizes are estimates; they depend on the library.
+	size_t bytes = chunks.bucket_count() * sizeof(void*) + chunks.size() * (sizeof(std::pair<uint64_t, TileChunk*>) + 2 * sizeof(void*));
+	for (auto& entry : chunks)
+		bytes += sizeof(TileChunk) + entry.second->runs.capacity() * sizeof(MaterialRun);
+	return bytes;
+}
+
+void TileGrid::printStats() const {
+	size_t runs = 0;
+	for (auto& entry : chunks)
+		runs += entry.second->runs.size();
+	size_t bytes = getMemoryUsed();
+	std::cout << "GRID: " << tiles << " tiles in " << chunks.size() << " chunks, " << runs << " material runs, "
+		<< bytes / 1024 << " KB (" << (tiles ? (double)bytes / tiles : 0.0) << " bytes/tile)\n";
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void gridBenchmark() {
+	const int SIDE = 80;			//Tiles [-SIDE / 2, SIDE / 2) each axis: chunks -2 to 1
+	const int ROUNDS = 20, SETS = 5000, FILLS = 50, FILL_MAX = 12;
+	std::mt19937 rng(11);
+	TileGrid grid("benchmark chunk");
+	std::vector<TileMaterial> reference(SIDE * SIDE * SIDE, 0);
+	auto inside = [&](glm::ivec3 t) {
+		return glm::all(glm::greaterThanEqual(t, glm::ivec3(-SIDE / 2))) && glm::all(glm::lessThan(t, glm::ivec3(SIDE / 2)));
+	};
+	auto at = [&](glm::ivec3 t) -> TileMaterial& {
+		glm::ivec3 u = t + SIDE / 2;
+		return reference[u.x + SIDE * (u.z + SIDE * u.y)];
+	};
+	auto filledRef = [&](glm::ivec3 t) { return inside(t) && at(t) != 0; };
+	//Same packing as the grid's chunk keys.
+	auto packChunk = [](glm::ivec3 c) {
+		return ((uint64_t)(c.x & 0x1FFFFF)) | ((uint64_t)(c.y & 0x1FFFFF) << 21) | ((uint64_t)(c.z & 0x1FFFFF) << 42);
+	};
+	auto unpackChunk = [](uint64_t key) { return glm::ivec3(keyAxis(key, 0), keyAxis(key, 21), keyAxis(key, 42)); };
+	auto randomTile = [&]() { return glm::ivec3(rng() % SIDE, rng() % SIDE, rng() % SIDE) - SIDE / 2; };
+	auto randomMaterial = [&]() { return (TileMaterial)(rng() % 5 < 2 ? 0 : 1 + rng() % 3); };
+
+	//Chunks that must come out of remeshDirty(): each one a tile
+	//changed in, and across the chunk face from a tile that filled or
+	//emptied, if that chunk has tiles.
+	std::unordered_set<uint64_t> changed, across;
+	auto edit = [&](glm::ivec3 t, TileMaterial m) {
+		TileMaterial& r = at(t);
+		if (r == m)
+			return;
+		changed.insert(packChunk(chunkOf(t)));
+		if ((r != 0) != (m != 0)) {
+			for (int i = 0; i < 6; i++) {
+				if (chunkOf(t + FACE_DIRS[i]) != chunkOf(t))
+					across.insert(packChunk(chunkOf(t + FACE_DIRS[i])));
+			}
+		}
+		r = m;
+	};
+
+	double setting = 0.0, filling = 0.0, remeshing = 0.0;
+	uint64_t tilesFilled = 0, faces = 0;
+	int reported = 0;
+	bool ok = 1;
+	for (int round = 0; round < ROUNDS && ok; round++) {
+		changed.clear();
+		across.clear();
+		std::vector<std::pair<glm::ivec3, TileMaterial>> sets(SETS);
+		for (auto& s : sets)
+			s = { randomTile(), randomMaterial() };
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto& s : sets)
+			grid.set(s.first, s.second);
+		setting += msSince(start);
+		for (auto& s : sets)
+			edit(s.first, s.second);
+
+		for (int f = 0; f < FILLS; f++) {
+			glm::ivec3 a = randomTile();
+			glm::ivec3 b = glm::min(a + glm::ivec3(rng() % FILL_MAX, rng() % FILL_MAX, rng() % FILL_MAX), glm::ivec3(SIDE / 2 - 1));
+			TileMaterial m = randomMaterial();
+			start = std::chrono::high_resolution_clock::now();
+			grid.fill(b, a, m);	//Corners either way round
+			filling += msSince(start);
+			for (int y = a.y; y <= b.y; y++)
+				for (int z = a.z; z <= b.z; z++)
+					for (int x = a.x; x <= b.x; x++)
+						edit(glm::ivec3(x, y, z), m);
+			tilesFilled += (uint64_t)(b.x - a.x + 1) * (b.y - a.y + 1) * (b.z - a.z + 1);
+		}
+
+		//Every tile, and the count.
+		uint64_t count = 0;
+		for (int y = -SIDE / 2; y < SIDE / 2 && ok; y++)
+			for (int z = -SIDE / 2; z < SIDE / 2; z++)
+				for (int x = -SIDE / 2; x < SIDE / 2; x++) {
+					glm::ivec3 t(x, y, z);
+					count += at(t) != 0;
+					if (grid.get(t) != at(t) || grid.filled(t) != (at(t) != 0))
+						ok = 0;
+				}
+		if (count != grid.getTileCount())
+			ok = 0;
+
+		//The dirty chunks, and their faces against the reference.
+		std::unordered_set<uint64_t> seen;
+		std::vector<TileFace> out;
+		start = std::chrono::high_resolution_clock::now();
+		grid.remeshDirty([&](glm::ivec3 c, const TileChunk* chunk) {
+			seen.insert(packChunk(c));
+			if (chunk)
+				grid.exposedFaces(c, out);
+		});
+		remeshing += msSince(start);
+		reported += (int)seen.size();
+		faces += out.size();
+		for (uint64_t key : changed)
+			ok = ok && seen.count(key);
+		for (uint64_t key : across)
+			ok = ok && (seen.count(key) || !grid.chunk(unpackChunk(key)));
+		size_t expected = 0;
+		for (uint64_t key : seen) {
+			glm::ivec3 c = unpackChunk(key);
+			for (int y = 0; y < CHUNK_SIZE; y++)
+				for (int z = 0; z < CHUNK_SIZE; z++)
+					for (int x = 0; x < CHUNK_SIZE; x++) {
+						glm::ivec3 t = c * CHUNK_SIZE + glm::ivec3(x, y, z);
+						if (!filledRef(t))
+							continue;
+						for (int i = 0; i < 6; i++)
+							expected += !filledRef(t + FACE_DIRS[i]);
+					}
+		}
+		for (const TileFace& f : out) {
+			if (!filledRef(f.tile) || filledRef(f.tile + FACE_DIRS[std::countr_zero(f.face)]) || f.material != at(f.tile))
+				ok = 0;
+		}
+		if (out.size() != expected)
+			ok = 0;
+	}
+
+	std::cout << "GRID: " << ROUNDS * SETS << " sets in " << setting << " ms (" << setting * 1e6 / (ROUNDS * SETS) << " ns each), "
+		<< ROUNDS * FILLS << " fills of " << tilesFilled << " tiles in " << filling << " ms\n";
+	std::cout << "GRID: " << reported << " dirty chunks remeshed in " << remeshing << " ms, " << faces << " exposed faces\n";
+	grid.printStats();
+	if (!ok)
+		std::cout << "GRID: the grid and the reference map differ!\n";
+}
+#pragma endregion
@@ -0,0 +1,137 @@
+#ifndef JGRID_H
+#define JGRID_H
+
+#include <functional>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "jalloc.h"
+
+///
+/// The map itself: which 1x1x1 tiles are filled, and with what.
+/// Space is cut into 32^3 chunks kept in a hash map, and a chunk
+/// only exists while it holds a filled tile, so memory follows what
+/// has been built rather than how far apart it is.
+///
+/// Inside a chunk occupancy is one bit per tile, a 32-bit row per
+/// (y, z) with x as the bit, so neighbor tests are shifts and masks.
+/// Materials are run-length encoded in x, z, y order; floors and
+/// walls painted with one material take a handful of runs.
+///
+/// Edits flag their chunk (and the neighbor across a chunk face they
+/// touch) as dirty; remeshDirty() hands those to whatever rebuilds
+/// the chunk's geometry.
+///
+
+const int CHUNK_BITS	= 5;
+const int CHUNK_SIZE	= 1 << CHUNK_BITS;
+const int CHUNK_MASK	= CHUNK_SIZE - 1;
+const int CHUNK_TILES	= CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+//0 is an empty tile.
+typedef uint16_t TileMaterial;
+
+//Bits of TileGrid::neighbors(), one per face.
+enum TileFaceBit : uint8_t {
+	TILE_NEG_X = 1 << 0,
+	TILE_POS_X = 1 << 1,
+	TILE_NEG_Y = 1 << 2,
+	TILE_POS_Y = 1 << 3,
+	TILE_NEG_Z = 1 << 4,
+	TILE_POS_Z = 1 << 5
+};
+
+//A tile face with nothing filled on the other side.
+struct TileFace {
+	glm::ivec3 tile;
+	uint8_t face;			//One TileFaceBit
+	TileMaterial material;
+};
+
+//Tiles [previous run's end, end) in x, z, y order.
+struct MaterialRun {
+	uint16_t end;
+	TileMaterial material;
+};
+
+/// <summary>
+/// TileChunk. One 32^3 block of the grid, in local coordinates.
+/// </summary>
+class TileChunk {
+	public:
+		glm::ivec3 coord;					//In chunks
+		uint32_t rows[CHUNK_SIZE * CHUNK_SIZE];	//Occupancy, bit x of rows[z + y * 32]
+		std::vector<MaterialRun> runs;		//Always covers all CHUNK_TILES
+		uint32_t count = 0;					//Filled tiles
+		bool dirty = 0;
+
+		TileChunk(glm::ivec3 coordIn);
+
+		static int index(int x, int y, int z) { return x | (z << CHUNK_BITS) | (y << (2 * CHUNK_BITS)); }
+		uint32_t row(int y, int z) const { return rows[z + (y << CHUNK_BITS)]; }
+		bool filled(int x, int y, int z) const { return (row(y, z) >> x) & 1; }
+		TileMaterial material(int index) const;
+		//Sets tiles [begin, end) of the run order to m.
+		void setRange(int begin, int end, TileMaterial m);
+};
+
+/// <summary>
+/// TileGrid. Sparse, unbounded grid of tiles. Coordinates are in
+/// tiles; chunk (0, 0, 0) holds tiles 0 to 31 on each axis.
+/// </summary>
+class TileGrid {
+	private:
+		std::unordered_map<uint64_t, TileChunk*> chunks;
+		std::vector<uint64_t> dirtyKeys;
+		Pool<TileChunk, 16> chunkPool;
+		mutable uint64_t lastKey = UINT64_MAX;	//Lookup cache; edits tend to stay in one chunk
+		mutable TileChunk* lastChunk = NULL;
+		uint64_t tiles = 0;
+
+		static uint64_t chunkKey(glm::ivec3 c);
+		TileChunk* find(glm::ivec3 c) const;
+		TileChunk* findOrCreate(glm::ivec3 c);
+		void markDirty(TileChunk* chunk);
+		void markDirty(glm::ivec3 c);
+		void release(TileChunk* chunk);
+		//The chunk's six face neighbors, in TileFaceBit order, NULL where there is none.
+		void faceNeighbors(const TileChunk& chunk, const TileChunk* out[6]) const;
+	public:
+		TileGrid(const char* nameIn = "TileChunk") : chunkPool(nameIn) {}
+		~TileGrid() { clear(); }
+
+		bool filled(glm::ivec3 t) const;
+		TileMaterial get(glm::ivec3 t) const;
+		//m = 0 empties the tile.
+		void set(glm::ivec3 t, TileMaterial m);
+		//Sets every tile in [bMin, bMax], inclusive, a row at a time.
+		void fill(glm::ivec3 bMin, glm::ivec3 bMax, TileMaterial m);
+		//TileFaceBits of the filled face neighbors.
+		uint8_t neighbors(glm::ivec3 t) const;
+		//Appends the faces of chunk c's tiles that touch an empty tile.
+		void exposedFaces(glm::ivec3 c, std::vector<TileFace>& out) const;
+
+		const TileChunk* chunk(glm::ivec3 c) const { return find(c); }
+		//Calls f for each chunk edited since the last call, with NULL
+		//for chunks that have since emptied out and been freed, then
+		//clears the dirty set.
+		void remeshDirty(const std::function<void(glm::ivec3, const TileChunk*)>& f);
+
+		void clear();
+		uint64_t getTileCount() const { return tiles; }
+		size_t getChunkCount() const { return chunks.size(); }
+		size_t getMemoryUsed() const;
+		void printStats() const;
+};
+
+//The open map's tiles. Emptied by closeMap().
+extern TileGrid mapGrid;
+
+//Times random set() and fill() calls on a grid of its own, across
+//chunk boundaries and negative coordinates, and checks it against a
+//plain array of the same edits: every tile, the tile count, the
+//chunks remeshDirty() reports and their exposedFaces().
+void gridBenchmark();
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef JHANDLE_H
+#define JHANDLE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+///
+/// Generational handles. A handle is 32 bits: a slot index in the
+/// low HANDLE_INDEX_BITS and the slot's generation above it. Freeing
+/// a slot bumps its generation, so a handle kept past a delete just
+/// stops resolving instead of pointing at whatever reuses the slot.
+/// Checking one is an index and a compare.
+///
+/// Because everything holding a handle goes through the table, an
+/// object can be moved (pool compaction, a background load swapping
+/// in the real data) by updating one slot with relocate().
+///
+
+const uint32_t HANDLE_INDEX_BITS = 20;
+const uint32_t HANDLE_INDEX_MASK = (1u << HANDLE_INDEX_BITS) - 1;
+const uint32_t HANDLE_GENERATION_MASK = (1u << (32 - HANDLE_INDEX_BITS)) - 1;
+
+inline uint32_t handleIndex(uint32_t value) { return value & HANDLE_INDEX_MASK; }
+inline uint32_t handleGeneration(uint32_t value) { return value >> HANDLE_INDEX_BITS; }
+inline uint32_t makeHandle(uint32_t index, uint32_t generation) { return index | (generation << HANDLE_INDEX_BITS); }
+//Generation 0 is never handed out, so a zero handle is always null.
+inline uint32_t nextGeneration(uint32_t generation) {
+	generation = (generation + 1) & HANDLE_GENERATION_MASK;
+	return generation ? generation : 1;
+}
+
+//Typed so a texture handle can't be passed where a mesh is wanted.
+template<class T> struct Handle {
+	uint32_t value = 0;
+
+	uint32_t index() const { return handleIndex(value); }
+	uint32_t generation() const { return handleGeneration(value); }
+	explicit operator bool() const { return value != 0; }
+	bool operator==(const Handle& rhs) const { return value == rhs.value; }
+	bool operator!=(const Handle& rhs) const { return value != rhs.value; }
+	bool operator<(const Handle& rhs) const { return value < rhs.value; }
+};
+
+/// <summary>
+/// HandleTable. Slot per live object: where it is now and which
+/// generation owns the slot. Doesn't own the objects; whoever frees
+/// one calls remove() first. Holds at most HANDLE_INDEX_MASK objects
+/// (the last index marks the end of the free list); past that,
+/// insert() returns a null handle.
+/// </summary>
+template<class T> class HandleTable {
+	private:
+		struct Slot {
+			T* object = NULL;
+			uint32_t generation = 1;
+			uint32_t nextFree = HANDLE_INDEX_MASK;
+		};
+		std::vector<Slot> slots;
+		uint32_t freeHead = HANDLE_INDEX_MASK;
+		uint32_t live = 0;
+	public:
+		Handle<T> insert(T* obj) {
+			uint32_t i = freeHead;
+			if (i != HANDLE_INDEX_MASK) {
+				freeHead = slots[i].nextFree;
+			}
+			else {
+				if (slots.size() >= HANDLE_INDEX_MASK) {
+					std::cout << "HANDLE: table full at " << HANDLE_INDEX_MASK << " objects\n";
+					return Handle<T>();
+				}
+				i = (uint32_t)slots.size();
+				slots.emplace_back();
+			}
+			slots[i].object = obj;
+			live++;
+			Handle<T> h;
+			h.value = makeHandle(i, slots[i].generation);
+			return h;
+		}
+
+		T* get(Handle<T> h) const {
+			uint32_t i = h.index();
+			if (i >= slots.size() || slots[i].generation != h.generation())
+				return NULL;
+			return slots[i].object;
+		}
+
+		bool valid(Handle<T> h) const { return get(h) != NULL; }
+
+		bool remove(Handle<T> h) {
+			if (!valid(h))
+				return 0;
+			Slot& s = slots[h.index()];
+			s.object = NULL;
+			s.generation = nextGeneration(s.generation);
+			s.nextFree = freeHead;
+			freeHead = h.index();
+			live--;
+			return 1;
+		}
+
+		bool relocate(Handle<T> h, T* obj) {
+			if (!valid(h))
+				return 0;
+			slots[h.index()].object = obj;
+			return 1;
+		}
+
+		uint32_t size() const { return live; }
+};
+
+#endif
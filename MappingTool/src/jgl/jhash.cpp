@@ -0,0 +1,86 @@
+#include "jhash.h"
+#include <string.h>
+
+static const uint64_t PRIME1 = 11400714785074694791ull;
+static const uint64_t PRIME2 = 14029467366897019727ull;
+static const uint64_t PRIME3 = 1609587929392839161ull;
+static const uint64_t PRIME4 = 9650029242287828579ull;
+static const uint64_t PRIME5 = 2870177450012600261ull;
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t read64(const unsigned char* p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+	acc += input * PRIME2;
+	acc = rotl(acc, 31);
+	return acc * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+	acc ^= hashRound(0, val);
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t contentHash64(const void* data, size_t length, uint64_t seed) {
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + length;
+	uint64_t h;
+
+	if (length >= 32) {
+		uint64_t v1 = seed + PRIME1 + PRIME2;
+		uint64_t v2 = seed + PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME1;
+		const unsigned char* limit = end - 32;
+		do {
+			v1 = hashRound(v1, read64(p));
+			v2 = hashRound(v2, read64(p + 8));
+			v3 = hashRound(v3, read64(p + 16));
+			v4 = hashRound(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else {
+		h = seed + PRIME5;
+	}
+	h += (uint64_t)length;
+
+	while (p + 8 <= end) {
+		h ^= hashRound(0, read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,11 @@
+#ifndef JHASH_H
+#define JHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//64-bit content hash (the XXH64 algorithm). Used to key caches by
+//what a file holds rather than where it lives.
+uint64_t contentHash64(const void* data, size_t length, uint64_t seed = 0);
+
+#endif
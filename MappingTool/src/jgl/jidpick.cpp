@@ -0,0 +1,234 @@
+#include "jidpick.h"
+#include "headers/shader.hpp"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <string.h>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+IdPicker idPicker;
+
+static const uint32_t NO_ENTITY = 0xFFFFFFFF;
+
+bool IdPicker::init() {
+	if (fbo)
+		return 1;
+	if (failed)
+		return 0;
+	failed = 1;	//Until everything below works out; no retrying every frame.
+	program = LoadShaders("src/shaders/pickvert.glsl", "src/shaders/pickfrag.glsl");
+	if (!program) {
+		std::cout << "IDPICK: could not load the pick shaders\n";
+		return 0;
+	}
+	modelID = glGetUniformLocation(program, "M");
+	vpID = glGetUniformLocation(program, "VP");
+	entityID = glGetUniformLocation(program, "entity");
+	partID = glGetUniformLocation(program, "part");
+	texID = glGetUniformLocation(program, "tex");
+	cutoffID = glGetUniformLocation(program, "alphaCutoff");
+
+	glGenTextures(1, &idTexture);
+	glBindTexture(GL_TEXTURE_2D, idTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, IDPICK_SIZE, IDPICK_SIZE, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, IDPICK_SIZE, IDPICK_SIZE);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "IDPICK: framebuffer incomplete (" << status << ")\n";
+		release();
+		return 0;
+	}
+
+	//GL_STREAM_READ: written by the GPU once, read by us once.
+	for (Readback& r : readbacks) {
+		glGenBuffers(1, &r.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, IDPICK_SIZE * IDPICK_SIZE * 4 * sizeof(uint32_t), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	failed = 0;
+	return 1;
+}
+
+void IdPicker::render(const RenderPacket& packet) {
+	frame++;
+	if (!packet.pick.active && !fbo)
+		return;
+	if (!init())
+		return;
+	collect();
+	if (!packet.pick.active)
+		return;
+
+	Readback& r = readbacks[next];
+	if (r.fence) {
+		dropped++;
+		return;
+	}
+	next = (next + 1) % IDPICK_READBACKS;
+	draw(packet, r);
+}
+
+void IdPicker::draw(const RenderPacket& packet, Readback& r) {
+	//Region in GL window coordinates (bottom-left origin), cursor
+	//pixel in the middle.
+	int cx = packet.pick.x, cy = packet.height - 1 - packet.pick.y;
+	int x0 = cx - IDPICK_SIZE / 2, y0 = cy - IDPICK_SIZE / 2;
+
+	//Narrow the projection so window pixels [x0, x0 + SIZE) land on
+	//the target's [0, SIZE).
+	float w = (float)std::max(packet.width, 1), h = (float)std::max(packet.height, 1);
+	glm::mat4 region(1.0f);
+	region[0][0] = w / IDPICK_SIZE;
+	region[1][1] = h / IDPICK_SIZE;
+	region[3][0] = (w - 2.0f * x0) / IDPICK_SIZE - 1.0f;
+	region[3][1] = (h - 2.0f * y0) / IDPICK_SIZE - 1.0f;
+	glm::mat4 pickVP = region * packet.VP;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, IDPICK_SIZE, IDPICK_SIZE);
+	const GLuint clearId[4] = { NO_ENTITY, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, clearId);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	//Region pixels off the edge of the window stay empty.
+	int sx0 = std::max(0, -x0), sy0 = std::max(0, -y0);
+	int sx1 = std::min(IDPICK_SIZE, packet.width - x0), sy1 = std::min(IDPICK_SIZE, packet.height - y0);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(sx0, sy0, std::max(0, sx1 - sx0), std::max(0, sy1 - sy0));
+
+	glUseProgram(program);
+	glUniformMatrix4fv(vpID, 1, GL_FALSE, &pickVP[0][0]);
+	glUniform1i(texID, 0);
+	glUniform1f(cutoffID, IDPICK_ALPHA_CUTOFF);
+	glActiveTexture(GL_TEXTURE0);
+	for (const DrawRecord& d : packet.draws) {
+		glUniformMatrix4fv(modelID, 1, GL_FALSE, &d.model[0][0]);
+		glUniform1ui(entityID, d.entity);
+		glUniform1ui(partID, d.part);
+		glBindTexture(GL_TEXTURE_2D, d.texture);
+		glBindVertexArray(d.VAO);
+		glDrawElements(GL_TRIANGLES, d.numIndices, GL_UNSIGNED_SHORT, 0);
+	}
+	glBindVertexArray(0);
+	glDisable(GL_SCISSOR_TEST);
+
+	//Into the pixel buffer; this returns without waiting for the draws.
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	glReadPixels(0, 0, IDPICK_SIZE, IDPICK_SIZE, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	r.x = packet.pick.x;
+	r.y = packet.pick.y;
+	r.width = packet.width;
+	r.height = packet.height;
+	r.invVP = glm::inverse(packet.VP);
+	r.frame = frame;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, packet.width, packet.height);
+}
+
+void IdPicker::collect() {
+	//Oldest first, so results arrive in the order they were asked for.
+	for (int k = 0; k < IDPICK_READBACKS; k++) {
+		Readback& r = readbacks[(next + k) % IDPICK_READBACKS];
+		if (!r.fence)
+			continue;
+		GLenum state = glClientWaitSync(r.fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(r.fence);
+		r.fence = 0;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+		const uint32_t* pixels = (const uint32_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, IDPICK_SIZE * IDPICK_SIZE * 4 * sizeof(uint32_t), GL_MAP_READ_BIT);
+		if (pixels) {
+			resolve(r, pixels);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+void IdPicker::resolve(const Readback& r, const uint32_t* pixels) {
+	//The cursor's pixel if something is there, otherwise the nearest
+	//covered one, so thin edges don't need a pixel-perfect click.
+	const int half = IDPICK_SIZE / 2;
+	int best = -1, bestDist = INT_MAX;
+	for (int py = 0; py < IDPICK_SIZE; py++) {
+		for (int px = 0; px < IDPICK_SIZE; px++) {
+			int i = px + py * IDPICK_SIZE;
+			if (pixels[4 * i] == NO_ENTITY)
+				continue;
+			int dist = (px - half) * (px - half) + (py - half) * (py - half);
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = i;
+			}
+		}
+	}
+
+	IdPickResult result;
+	result.x = r.x;
+	result.y = r.y;
+	result.frame = r.frame;
+	if (best >= 0) {
+		const uint32_t* p = pixels + 4 * best;
+		result.entity = p[0];
+		result.part = p[1];
+		result.triangle = p[2];
+		memcpy(&result.depth, &p[3], sizeof(float));
+		//Back through the inverse of the VP the pick was drawn with.
+		int wx = r.x - half + best % IDPICK_SIZE;
+		int wy = (r.height - 1 - r.y) - half + best / IDPICK_SIZE;
+		glm::vec4 ndc(2.0f * (wx + 0.5f) / r.width - 1.0f, 2.0f * (wy + 0.5f) / r.height - 1.0f, 2.0f * result.depth - 1.0f, 1.0f);
+		glm::vec4 world = r.invVP * ndc;
+		result.position = glm::vec3(world) / world.w;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	latest = result;
+	fresh = 1;
+}
+
+bool IdPicker::poll(IdPickResult& out) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!fresh)
+		return 0;
+	out = latest;
+	fresh = 0;
+	return 1;
+}
+
+void IdPicker::release() {
+	for (Readback& r : readbacks) {
+		if (r.fence)
+			glDeleteSync(r.fence);
+		if (r.pbo)
+			glDeleteBuffers(1, &r.pbo);
+		r = Readback();
+	}
+	if (fbo)
+		glDeleteFramebuffers(1, &fbo);
+	if (depthBuffer)
+		glDeleteRenderbuffers(1, &depthBuffer);
+	if (idTexture)
+		glDeleteTextures(1, &idTexture);
+	if (program)
+		glDeleteProgram(program);
+	fbo = depthBuffer = idTexture = program = 0;
+	next = 0;
+}
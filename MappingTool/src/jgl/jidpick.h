@@ -0,0 +1,90 @@
+#ifndef JIDPICK_H
+#define JIDPICK_H
+
+#include <GL/glew.h>
+#include <mutex>
+#include <stdint.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include "jbufferqueue.h"
+
+///
+/// GPU picking. When a RenderPacket carries a PickRequest, the render
+/// thread draws that frame's draws again into a small unsigned-integer
+/// target covering only the pixels around the cursor: the projection
+/// is narrowed so the region fills the target, and a scissor keeps
+/// anything else from being touched. Each pixel gets (entity, part,
+/// triangle, depth).
+///
+/// The region is copied into a pixel buffer with a fence behind it
+/// and read a frame or two later, once the fence has passed, so the
+/// CPU never waits on the GPU. If every buffer is still in flight the
+/// request is dropped rather than stalling.
+///
+/// Cost depends on the pixels around the cursor, not on how many
+/// triangles are in the scene. The pick shader skips texels under
+/// IDPICK_ALPHA_CUTOFF alpha, which the main one only does for
+/// materials with alphaTest set.
+///
+
+const int IDPICK_SIZE = 9;				//Width and height of the region, centered on the cursor
+const int IDPICK_READBACKS = 3;			//Readbacks that can be in flight at once
+const float IDPICK_ALPHA_CUTOFF = 0.5f;	//Also frag.glsl's, for alphaTest materials
+
+//What was under the cursor.
+struct IdPickResult {
+	uint32_t entity = 0xFFFFFFFF;	//NULL_ENTITY on a miss
+	uint32_t part = 0;				//Which of the entity's draws (DrawRecord::part)
+	uint32_t triangle = 0;			//In the drawn mesh's index order
+	float depth = 1.0f;				//Window depth, 0 near to 1 far
+	glm::vec3 position = glm::vec3(0.0f);	//World position of the pixel
+	int x = 0, y = 0;				//The request's window pixel
+	uint64_t frame = 0;				//Render frame the pick was drawn in
+	bool hit() const { return entity != 0xFFFFFFFF; }
+};
+
+/// <summary>
+/// IdPicker. render() and release() are for the GL thread; poll() is
+/// for the main thread.
+/// </summary>
+class IdPicker {
+	private:
+		struct Readback {
+			GLuint pbo = 0;
+			GLsync fence = 0;		//Nonzero while the copy is in flight
+			int x = 0, y = 0, width = 0, height = 0;
+			glm::mat4 invVP = glm::mat4(1.0f);
+			uint64_t frame = 0;
+		};
+		GLuint fbo = 0, idTexture = 0, depthBuffer = 0, program = 0;
+		GLint modelID = -1, vpID = -1, entityID = -1, partID = -1, texID = -1, cutoffID = -1;
+		Readback readbacks[IDPICK_READBACKS];
+		int next = 0;
+		uint64_t frame = 0;
+		uint64_t dropped = 0;
+		bool failed = 0;
+
+		std::mutex mutex;			//Guards latest and fresh
+		IdPickResult latest;
+		bool fresh = 0;
+
+		bool init();
+		//Reads every readback whose fence has passed.
+		void collect();
+		void draw(const RenderPacket& packet, Readback& r);
+		void resolve(const Readback& r, const uint32_t* pixels);
+	public:
+		//Collects finished readbacks, then draws packet's pick if it
+		//asked for one. Call after the frame's own draws.
+		void render(const RenderPacket& packet);
+		//Newest result since the last call. Returns 0 if nothing new
+		//has come back.
+		bool poll(IdPickResult& out);
+		//Requests dropped because every readback was still busy.
+		uint64_t getDropped() const { return dropped; }
+		void release();
+};
+
+extern IdPicker idPicker;
+
+#endif
@@ -0,0 +1,282 @@
+#include "jjobs.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+JobSystem jobSystem;
+
+//Which worker this thread is, -1 outside the pool.
+static thread_local int workerIndex = -1;
+//Job storage for threads outside the pool.
+static thread_local std::unique_ptr<Job[]> foreignRing;
+static thread_local uint32_t foreignRingNext = 0;
+
+#pragma region JobDeque:
+bool JobDeque::push(Job* job) {
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= JOB_DEQUE_SIZE)
+		return 0;
+	jobs[b & (JOB_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return 1;
+}
+
+Job* JobDeque::pop() {
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+	if (t > b) {
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return NULL; //Empty
+	}
+	Job* job = jobs[b & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+	if (t == b) {
+		//Last one; a thief may be after it too.
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = NULL;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* JobDeque::steal() {
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return NULL;
+	Job* job = jobs[t & (JOB_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return NULL; //Lost the race, the caller will look elsewhere.
+	return job;
+}
+#pragma endregion
+
+#pragma region JobSystem:
+void JobSystem::start(int threadCount) {
+	stop();
+	stopping = 0;
+	if (threadCount <= 0)
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	for (int i = 0; i <= threadCount; i++)
+		workers.push_back(new Worker());
+	workerIndex = 0;
+	bindGLThread();
+	for (int i = 1; i <= threadCount; i++)
+		threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop() {
+	stopping = 1;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	sleepCv.notify_all();
+	for (std::thread& t : threads)
+		t.join();
+	threads.clear();
+	for (Worker* w : workers)
+		delete w;
+	workers.clear();
+	glJobs.clear();
+	foreignJobs.clear();
+	queued = 0;
+	sharedQueued = 0;
+}
+
+JobSystem::Worker* JobSystem::self() {
+	if (workerIndex < 0 || workerIndex >= (int)workers.size())
+		return NULL;
+	return workers[workerIndex];
+}
+
+Job* JobSystem::allocate() {
+	Job* job;
+	Worker* w = self();
+	if (w) {
+		job = &w->ring[w->ringNext++ & (JOB_RING_SIZE - 1)];
+	}
+	else {
+		if (!foreignRing)
+			foreignRing.reset(new Job[JOB_RING_SIZE]());
+		job = &foreignRing[foreignRingNext++ & (JOB_RING_SIZE - 1)];
+	}
+	//The ring has wrapped onto a job that is still queued or running;
+	//help out until it is done rather than overwrite it.
+	while (!isDone(job)) {
+		Job* other = findJob(onGLThread());
+		if (other)
+			execute(other);
+		else
+			std::this_thread::yield();
+	}
+	return job;
+}
+
+void JobSystem::run(Job* job) {
+	Worker* w = self();
+	if (job->glThread || !w) {
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		(job->glThread ? glJobs : foreignJobs).push_back(job);
+		sharedQueued++;
+	}
+	else if (!w->deque.push(job)) {
+		execute(job);
+		return;
+	}
+	queued.fetch_add(1, std::memory_order_release);
+	if (sleeping.load(std::memory_order_acquire) > 0)
+		sleepCv.notify_one();
+}
+
+Job* JobSystem::findJob(bool onGLThread) {
+	if (queued.load(std::memory_order_acquire) <= 0)
+		return NULL;
+
+	Job* job = NULL;
+	Worker* w = self();
+	if (w)
+		job = w->deque.pop();
+	if (!job && sharedQueued.load(std::memory_order_acquire) > 0) {
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		std::vector<Job*>& list = (onGLThread && !glJobs.empty()) ? glJobs : foreignJobs;
+		if (!list.empty()) {
+			job = list.back();
+			list.pop_back();
+			sharedQueued--;
+		}
+	}
+	if (!job && workers.size() > 1) {
+		//Start at a different victim each time so thieves spread out.
+		static thread_local uint32_t seed = 2463534242u;
+		seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+		size_t n = workers.size();
+		for (size_t k = 0; k < n && !job; k++) {
+			Worker* victim = workers[(seed + k) % n];
+			if (victim != w)
+				job = victim->deque.steal();
+		}
+	}
+	if (job)
+		queued.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::execute(Job* job) {
+	job->function(job);
+	finish(job);
+}
+
+void JobSystem::finish(Job* job) {
+	//Read parent first: once unfinished hits 0 the slot can be reused.
+	Job* parent = job->parent;
+	if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1 && parent)
+		finish(parent);
+}
+
+void JobSystem::wait(Job* job) {
+	bool gl = onGLThread();
+	while (!isDone(job)) {
+		Job* other = findJob(gl);
+		if (other)
+			execute(other);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::runGLJobs() {
+	while (1) {
+		Job* job = NULL;
+		{
+			std::lock_guard<std::mutex> lock(sharedMutex);
+			if (glJobs.empty())
+				return;
+			job = glJobs.back();
+			glJobs.pop_back();
+			sharedQueued--;
+		}
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		execute(job);
+	}
+}
+
+void JobSystem::workerLoop(int index) {
+	workerIndex = index;
+	int idle = 0;
+	while (!stopping.load(std::memory_order_acquire)) {
+		Job* job = findJob(0);
+		if (job) {
+			execute(job);
+			idle = 0;
+			continue;
+		}
+		//Spin briefly for the next job, then sleep so an idle editor
+		//doesn't keep every core busy. The timeout covers a wakeup that
+		//lands between the check and the wait.
+		if (++idle < 64) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleeping++;
+		sleepCv.wait_for(lock, std::chrono::milliseconds(2), [this] {
+			return stopping.load() || queued.load() > 0;
+		});
+		sleeping--;
+	}
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double secondsSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void jobBenchmark() {
+	const int BATCH = 1024, BATCHES = 256;
+	const int total = BATCH * BATCHES;
+	std::atomic<int> counter{ 0 };
+	std::atomic<int>* c = &counter;
+
+	//Empty jobs under one parent: create, push, steal/pop, finish.
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int b = 0; b < BATCHES; b++) {
+		Job* root = jobSystem.create([] {});
+		for (int i = 0; i < BATCH; i++)
+			jobSystem.run(jobSystem.create([c] { c->fetch_add(1, std::memory_order_relaxed); }, root));
+		jobSystem.run(root);
+		jobSystem.wait(root);
+	}
+	double fanOut = secondsSince(start);
+
+	//parallelFor at its finest split, one item per piece, which adds
+	//the splitting and the wait on top.
+	uint32_t pieces = (uint32_t)jobSystem.getWorkerCount() * JOB_PIECES_PER_WORKER;
+	int calls = total / pieces;
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < calls; i++) {
+		jobSystem.parallelFor(pieces, 1, [c](uint32_t begin, uint32_t end) {
+			c->fetch_add(end - begin, std::memory_order_relaxed);
+		});
+	}
+	double split = secondsSince(start);
+
+	//Baseline: the same work without the scheduler.
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < total; i++)
+		c->fetch_add(1, std::memory_order_relaxed);
+	double inline_ = secondsSince(start);
+	int splitTotal = calls * pieces;
+
+	std::cout << "JOBS: " << jobSystem.getWorkerCount() << " workers, " << total << " jobs\n";
+	std::cout << "JOBS: fan-out " << (fanOut - inline_) * 1e9 / total << " ns/job overhead\n";
+	std::cout << "JOBS: parallelFor " << (split * 1e9 - inline_ * 1e9 * splitTotal / total) / splitTotal << " ns/piece overhead\n";
+	if (counter.load() != total * 2 + splitTotal)
+		std::cout << "JOBS: Lost jobs! counted " << counter.load() << " of " << total * 2 + splitTotal << "\n";
+}
+#pragma endregion
@@ -0,0 +1,168 @@
+#ifndef JJOBS_H
+#define JJOBS_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+///
+/// Work-stealing job scheduler. One worker thread per core besides
+/// the main thread, which counts as worker 0 whenever it waits.
+/// Each worker pushes and pops its own jobs at the back of its deque
+/// (newest first, still warm in cache) and, when that runs dry,
+/// steals the oldest job from the front of someone else's.
+///
+/// A job can have a parent: the parent only counts as finished once
+/// all its children have, so waiting on one job waits on its whole
+/// tree. Jobs that touch GL are flagged glThread and only run on
+/// whichever thread holds the context (see bindGLThread()), inside
+/// runGLJobs() or a wait() there.
+///
+
+const int JOB_DATA_SIZE = 40;			//Room for a lambda's captures
+const int JOB_DEQUE_SIZE = 4096;		//Per worker, power of two
+const int JOB_RING_SIZE = 4096;			//Jobs each thread can have in flight
+const int JOB_PIECES_PER_WORKER = 16;	//parallelFor never splits finer than this
+
+struct alignas(64) Job {
+	void (*function)(Job*);
+	Job* parent;
+	std::atomic<int32_t> unfinished;	//Itself plus unfinished children
+	bool glThread;
+	alignas(8) unsigned char data[JOB_DATA_SIZE];
+};
+
+/// <summary>
+/// Chase-Lev deque. The owner pushes and pops at the bottom without
+/// locking; thieves take from the top with a CAS. Fixed size: a
+/// full deque makes run() execute the job on the spot instead.
+/// </summary>
+class JobDeque {
+	private:
+		std::atomic<Job*> jobs[JOB_DEQUE_SIZE];
+		alignas(64) std::atomic<int64_t> top{ 0 };
+		alignas(64) std::atomic<int64_t> bottom{ 0 };
+	public:
+		bool push(Job* job);
+		Job* pop();
+		Job* steal();
+};
+
+class JobSystem {
+	private:
+		struct Worker {
+			JobDeque deque;
+			Job ring[JOB_RING_SIZE];
+			uint32_t ringNext = 0;
+		};
+		std::vector<Worker*> workers;	//[0] belongs to the main thread
+		std::vector<std::thread> threads;
+		std::mutex sharedMutex;			//Guards glJobs and foreignJobs
+		std::vector<Job*> glJobs;		//Jobs only the GL thread may run
+		std::vector<Job*> foreignJobs;	//Queued by threads outside the pool
+		std::atomic<int> queued{ 0 };		//Hint for idle workers, not exact
+		std::atomic<int> sharedQueued{ 0 };	//glJobs + foreignJobs
+		std::atomic<std::thread::id> glThreadID;
+		std::atomic<int> sleeping{ 0 };
+		std::mutex sleepMutex;
+		std::condition_variable sleepCv;
+		std::atomic<bool> stopping{ false };
+
+		Worker* self();
+		Job* allocate();
+		Job* findJob(bool onGLThread);
+		bool onGLThread() { return std::this_thread::get_id() == glThreadID.load(std::memory_order_relaxed); }
+		void execute(Job* job);
+		void finish(Job* job);
+		void workerLoop(int index);
+
+		template<class F> static void trampoline(Job* job) {
+			(*(F*)job->data)();
+		}
+	public:
+		~JobSystem() { stop(); }
+		//threadCount 0 means one per core minus the main thread.
+		void start(int threadCount = 0);
+		void stop();
+		int getWorkerCount() { return (int)workers.size(); }
+
+		//A job that runs f() once run() is called on it. f must be
+		//trivially copyable and fit in JOB_DATA_SIZE. Jobs come from
+		//a per-thread ring, so a thread must wait on what it made
+		//before it has made JOB_RING_SIZE more.
+		template<class F> Job* create(const F& f, Job* parent = NULL, bool glThread = 0) {
+			static_assert(sizeof(F) <= JOB_DATA_SIZE, "Job lambda captures too much");
+			static_assert(std::is_trivially_copyable<F>::value, "Job lambda must be trivially copyable");
+			Job* job = allocate();
+			job->function = &trampoline<F>;
+			job->parent = parent;
+			job->unfinished.store(1, std::memory_order_relaxed);
+			job->glThread = glThread;
+			if (parent)
+				parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+			new (job->data) F(f);
+			return job;
+		}
+		void run(Job* job);
+		//Runs other jobs until job and all its children are done.
+		void wait(Job* job);
+		bool isDone(Job* job) { return job->unfinished.load(std::memory_order_acquire) == 0; }
+		//Marks the calling thread as the one holding the GL context.
+		void bindGLThread() { glThreadID = std::this_thread::get_id(); }
+		//Call once a frame from the GL thread.
+		void runGLJobs();
+
+		//Calls f(begin, end) over [0, count) in pieces of about grain,
+		//spread across all workers, and returns once every piece is done.
+		//grain is raised if it would make more than JOB_PIECES_PER_WORKER
+		//pieces per worker, which is plenty to balance the load.
+		template<class F> void parallelFor(uint32_t count, uint32_t grain, const F& f);
+};
+
+extern JobSystem jobSystem;
+
+//Times scheduling overhead and prints ns per job.
+void jobBenchmark();
+
+template<class F> void JobSystem::parallelFor(uint32_t count, uint32_t grain, const F& f) {
+	if (count == 0)
+		return;
+	uint32_t maxPieces = (uint32_t)workers.size() * JOB_PIECES_PER_WORKER;
+	grain = std::max(std::max(grain, 1u), (count + maxPieces - 1) / std::max(maxPieces, 1u));
+	if (count <= grain || workers.size() < 2) {
+		f(0u, count);
+		return;
+	}
+
+	//Each piece splits itself in two until it is small enough, so
+	//idle workers steal big halves instead of queueing every piece here.
+	struct Split {
+		JobSystem* system;
+		const F* f;
+		uint32_t begin, end, grain;
+		Job* parent;
+		void operator()() const {
+			uint32_t b = begin, e = end;
+			while (e - b > grain) {
+				uint32_t mid = b + (e - b) / 2;
+				Split right = { system, f, mid, e, grain, parent };
+				system->run(system->create(right, parent));
+				e = mid;
+			}
+			(*f)(b, e);
+		}
+	};
+	Job* root = create([] {});
+	Split all = { this, &f, 0, count, grain, root };
+	run(create(all, root));
+	run(root);
+	wait(root);
+}
+
+#endif
@@ -1,41 +1,120 @@
 #include "jmodule.h"
+#include "jrender.h"
+#include "jresidency.h"
+#include "jhash.h"
+#include "jgrid.h"
+#include "jbvh.h"
+#include "jsnap.h"
+#include "jundo.h"
+#include "jthumbs.h"
+#include <algorithm>
 #include <fstream>
 #include <assimp/postprocess.h>
 #include <iostream>
+#include <iterator>
+#include <map>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+DedupStats dedupStats;
+
+Pool<WorldObject> worldObjectPool("WorldObject");
+Pool<Model> modelPool("Model");
+Pool<Material> materialPool("Material");
+Pool<BufferContainer> bufferPool("BufferContainer");
+
+HandleTable<WorldObject> worldObjects;
+HandleTable<Mesh> meshHandles;
+HandleTable<Texture> textureHandles;
+HandleTable<Material> materialHandles;
+HandleTable<BufferContainer> bufferHandles;
+
+void DedupStats::print() {
+	std::cout << "DEDUP: textures " << texturesLoaded << " loaded, " << texturesShared << " shared ("
+		<< textureBytesSaved / 1024 << " KB saved)\n";
+	std::cout << "DEDUP: meshes " << meshesLoaded << " loaded, " << meshesShared << " shared ("
+		<< meshBytesSaved / 1024 << " KB saved)\n";
+	std::cout << "DEDUP: models " << modelsLoaded << " imported, " << modelsShared << " reused\n";
+}
+
 #pragma region WorldObject:
 
 WorldObject::WorldObject() {
-	worldMatrix = glm::mat4(0.0f);
+	worldMatrix = glm::mat4(1.0f);
+	handle = worldObjects.insert(this);
 }
 
-bool WorldObject::insertModule(Module* in) {
-	for (Module* temp : modules) {
-		if (temp->getType() == in->getType())
-			return 0; //Module of that type already here.
+WorldObject::~WorldObject() {
+	worldObjects.remove(handle);
+	for (Module* m : modules) {
+		if (m)
+			m->release();
 	}
-	modules.push_back(in);
+}
+
+void WorldObject::setLocalMatrix(const glm::mat4& m) {
+	if (entity == NULL_ENTITY)
+		worldMatrix = m;
+	else
+		scene.transforms.setLocal(entity, m);
+}
+
+void WorldObject::setLayers(LayerMask mask) {
+	layers = mask;
+	if (entity != NULL_ENTITY)
+		scene.setLayers(entity, mask);
+}
+
+glm::mat4 WorldObject::getWorldMatrix() {
+	if (entity == NULL_ENTITY || !scene.transforms.has(entity))
+		return worldMatrix;
+	return scene.transforms.world[scene.transforms.indexOf(entity)];
+}
+
+bool WorldObject::setParent(WorldObject* parentIn) {
+	if (entity == NULL_ENTITY || (parentIn && parentIn->entity == NULL_ENTITY))
+		return 0;
+	return scene.transforms.setParent(entity, parentIn ? parentIn->entity : NULL_ENTITY);
+}
+
+WorldObject* Module::getParent() {
+	return worldObjects.get(parent);
+}
+
+ModuleID nextModuleID() {
+	static ModuleID count = 0;
+	if (count >= MAX_MODULE_TYPES) {
+		std::cout << "MODULE: More than " << MAX_MODULE_TYPES << " module types, raise MAX_MODULE_TYPES\n";
+		return NO_MODULE_ID;
+	}
+	return count++;
+}
+
+bool WorldObject::insertModule(Module* in) {
+	ModuleID id = in->getTypeID();
+	if (id == NO_MODULE_ID)
+		return 0; //Type didn't get an ID.
+	if (modules[id])
+		return 0; //Module of that type already here.
+	modules[id] = in;
+	moduleMask |= 1u << id;
 	in->setParent(this);
 	return 1;
 }
 
 bool WorldObject::removeModule(Module* in) {
-	for (int i = 0; i < modules.size(); i++) {
-		Module* temp = modules[i];
-		if (temp->getType() == in->getType()) {
-			modules.erase(modules.begin()+i);
-			return 1;
-		}
-	}
-	return 0; //Module of that type not here.
+	ModuleID id = in->getTypeID();
+	if (id == NO_MODULE_ID || !modules[id])
+		return 0; //Module of that type not here.
+	modules[id] = NULL;
+	moduleMask &= ~(1u << id);
+	return 1;
 }
 
-Module* WorldObject::findModule(std::string type) {
+Module* WorldObject::findModule(const std::string& type) {
 	for (Module* temp : modules) {
-		if (temp->getType() == type)
+		if (temp && temp->getType() == type)
 			return temp;
 	}
 	return NULL; //If none found
@@ -43,45 +122,115 @@ Module* WorldObject::findModule(std::string type) {
 #pragma endregion
 
 #pragma region Model:
+bool Model::getBounds(glm::vec3& minOut, glm::vec3& maxOut) {
+	if (!scene || scene->mNumMeshes == 0)
+		return 0;
+	minOut = boundsMin;
+	maxOut = boundsMax;
+	return 1;
+}
+
+//Keyed by (content hash, file size). The first Model to load a
+//file is the one later copies are made from; they share its importer,
+//and with it the scene.
+std::map<std::pair<uint64_t, size_t>, Model*> modelCache;
+
 bool Model::loadModel(std::string modelPathM) {
 	modelPath = modelPathM;
-	std::ifstream file(modelPath);
+	std::ifstream file(modelPath, std::ios::binary);
 	if (!file.good())
 		return 0; //File can't be found
 
-	scene = importer.ReadFile(modelPath, aiProcess_Triangulate |
+	std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	std::pair<uint64_t, size_t> key(contentHash64(bytes.data(), bytes.size()), bytes.size());
+	auto cached = modelCache.find(key);
+	if (cached != modelCache.end() && cached->second != this) {
+		Model* source = cached->second;
+		importer = source->importer;
+		scene = source->scene;
+		vertexBuffers = source->vertexBuffers;
+		indexBuffers = source->indexBuffers;
+		materialIndices = source->materialIndices;
+		indexCts = source->indexCts;
+		meshes = source->meshes;
+		boundsMin = source->boundsMin;
+		boundsMax = source->boundsMax;
+		dedupStats.modelsShared++;
+		return 1;
+	}
+
+	importer = std::make_shared<Assimp::Importer>();
+	scene = importer->ReadFile(modelPath, aiProcess_Triangulate |
 		aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
 		aiProcess_JoinIdenticalVertices);
 
 	if (scene) {
+		modelCache[key] = this;
+		dedupStats.modelsLoaded++;
 		for (unsigned int j = 0; j < scene->mNumMeshes; j++) {
-			Mesh* temp = new Mesh(scene->mMeshes[j]);
+			MeshHandle h = getMesh(scene->mMeshes[j]);
+			Mesh* temp = meshHandles.get(h);
+			if (!temp)
+				continue;	//No handle left for it.
+			meshes.push_back(h);
 			vertexBuffers.push_back(temp->getVertexBuffer());
 			indexBuffers.push_back(temp->getIndexBuffer());
-			materialIndices.push_back(temp->getMaterialIndex());
+			materialIndices.push_back(scene->mMeshes[j]->mMaterialIndex);
 			indexCts.push_back(temp->getIndexCt());
+			if (meshes.size() == 1) {
+				boundsMin = temp->getBoundsMin();
+				boundsMax = temp->getBoundsMax();
+			}
+			else {
+				boundsMin = glm::min(boundsMin, temp->getBoundsMin());
+				boundsMax = glm::max(boundsMax, temp->getBoundsMax());
+			}
 		}
 		return 1;
 	}
 	else {
+		importer.reset();
 		return 0; //Scene couldn't be read.
 	}
 }
 
+void Model::forgetCached() {
+	//Copies keep their share of the importer, so their scene stays;
+	//later loads of the file just stop being made from this one.
+	for (auto it = modelCache.begin(); it != modelCache.end(); ++it) {
+		if (it->second == this) {
+			modelCache.erase(it);
+			break;
+		}
+	}
+}
+
 void Model::reset() {
+	forgetCached();
 	vertexBuffers.clear();
 	indexBuffers.clear();
 	materialIndices.clear();
 	meshes.clear();
 	textures.clear();
 	scene = NULL;
+	importer.reset();
 	modelPath = "";
+	boundsMin = boundsMax = glm::vec3(0.0f);
 
 }
 
 Model::Model() {
 	reset();
 	moduleType = MOD_MODEL;
+	typeID = moduleID<Model>();
+}
+
+Model::~Model() {
+	forgetCached();
+}
+
+void Model::release() {
+	modelPool.destroy(this);
 }
 
 #pragma endregion
@@ -89,11 +238,33 @@ Model::Model() {
 #pragma region Material:
 Material::Material() {
 	moduleType = MOD_MATERIAL;
+	typeID = moduleID<Material>();
+	handle = materialHandles.insert(this);
+}
+
+Material::~Material() {
+	materialHandles.remove(handle);
+	for (BufferHandle h : bVec) {
+		BufferContainer* b = bufferHandles.get(h);
+		bufferHandles.remove(h);
+		//While the render thread has the context, the VAO goes with
+		//the next frame, after the packets already drawing it.
+		if (renderThread.running())
+			renderThread.packet().deadVAOs.push_back(b->VAO);
+		else
+			glDeleteVertexArrays(1, &b->VAO);
+		bufferPool.destroy(b);
+	}
+}
+
+void Material::release() {
+	materialPool.destroy(this);
 }
 
 bool Material::loadModel(GLint progID) {
-	Module* model = parent->findModule(MOD_MODEL);
-	if (!model || model->getType() != MOD_MODEL) {
+	WorldObject* owner = getParent();
+	Model* model = owner ? owner->findModule<Model>() : NULL;
+	if (!model) {
 		std::cout << "Model module not found\n";
 		return 0;
 	} //Model component could not be found
@@ -106,27 +277,17 @@ bool Material::loadModel(GLint progID) {
 	indexBuffers = model->getIndexBuffers();
 	materialIndices = model->getMaterialIndices();
 
-	int lastSlash = filepath.find_last_of('/');
-	std::string dir;
-	if (lastSlash == std::string::npos)
-		dir = ".";
-	else if (lastSlash == 0)
-		dir = "/";
-	else {
-		dir = filepath.substr(0, lastSlash);
-	}
-
 	textures.resize(scene->mNumMaterials);
+	texturePaths.clear();
 
 	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
-		const aiMaterial* material = scene->mMaterials[i];
-		textures[i] = NULL;
-		if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-			aiString path;
-			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-				std::string absoluteFilePath = dir + "/" + path.data;
-				textures[i] = new Texture(absoluteFilePath);
-			}
+		textures[i] = TextureHandle();
+		std::string absoluteFilePath = materialTexturePath(filepath, scene->mMaterials[i]);
+		if (!absoluteFilePath.empty()) {
+			textures[i] = getTexture(absoluteFilePath);
+			texturePaths.push_back(absoluteFilePath);
+			//The palette shows the textures the map uses.
+			thumbnailService.request(absoluteFilePath);
 		}
 	}
 
@@ -160,8 +321,9 @@ void Material::render(GLint progID) {
 		SetupAttribute(2, 2, GL_FLOAT, Vertex, uv);
 
 		
-		if (materialIndices[i] < textures.size() && textures[materialIndices[i]]) {
-			bind(textures[materialIndices[i]], GL_TEXTURE0);
+		Texture* tex = (materialIndices[i] < textures.size()) ? textureHandles.get(textures[materialIndices[i]]) : NULL;
+		if (tex) {
+			bind(tex, GL_TEXTURE0);
 		}
 
 		GLint uniformA = glGetUniformLocation(progID, "tex");
@@ -169,7 +331,17 @@ void Material::render(GLint progID) {
 		glUniform1i(uniformA, 0);
 		std::cout << "uniformAfter   " << glGetError() << std::endl; // returns 0 (no error)
 		
-		bVec.push_back(new BufferContainer(VAOid, indexCounts[i]));
+		BufferContainer* b = bufferPool.create(VAOid, indexCounts[i]);
+		if (tex)
+			b->texture = tex->texture;
+		b->alphaTest = alphaTest;
+		BufferHandle h = bufferHandles.insert(b);
+		if (h)
+			bVec.push_back(h);
+		else {
+			glDeleteVertexArrays(1, &VAOid);
+			bufferPool.destroy(b);
+		}
 
 		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -180,12 +352,11 @@ void Material::render(GLint progID) {
 		glDisableVertexAttribArray(n);
 }
 
-void Material::pushVAO() {
-	//I know this is janky, I'll work out something
-	//more elegant later but there's a final I should
-	//be studying for tonight.
-	for (int i = 0; i < bVec.size(); i++) {
-		glVAOs.push(bVec[i]);
+void Material::requestMips(float screenPixels, std::vector<MipRequest>& out) {
+	for (TextureHandle t : textures) {
+		Texture* tex = textureHandles.get(t);
+		if (tex)
+			out.push_back({ tex, screenPixels });
 	}
 }
 
@@ -201,51 +372,237 @@ void Material::unbind(GLuint inp) {
 #pragma endregion
 
 #pragma region Mesh:
-bool Mesh::makeVertexBuffer() {
+void Mesh::readMesh() {
+	vertexCount = mesh->mNumVertices;
+	indexCount = 0;
+	for (unsigned int t = 0; t < mesh->mNumFaces; ++t)
+		indexCount += (mesh->mFaces[t].mNumIndices == 4) ? 6 : 3;
+	vertices = mapArena.allocArray<Vertex>(vertexCount);
+	indices = mapArena.allocArray<unsigned short>(indexCount);
+
 	for (unsigned int t = 0; t < mesh->mNumVertices; ++t) {
-		Vertex v;
+		Vertex& v = vertices[t];
 		memcpy(&v.position, &mesh->mVertices[t], sizeof(glm::vec3));
 		memcpy(&v.normal, &mesh->mNormals[t], sizeof(glm::vec3));
-		memcpy(&v.uv, &mesh->mTextureCoords[0][t], sizeof(glm::vec2));
-		vertices.push_back(v);
-
-		glGenBuffers(1, &vertexBuffer);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (mesh->mTextureCoords[0])
+			memcpy(&v.uv, &mesh->mTextureCoords[0][t], sizeof(glm::vec2));
+		else
+			v.uv = glm::vec2(0.0f);
+		if (t == 0)
+			boundsMin = boundsMax = v.position;
+		boundsMin = glm::min(boundsMin, v.position);
+		boundsMax = glm::max(boundsMax, v.position);
 	}
-	return 1;
-}
 
-bool Mesh::makeIndexBuffer() {
+	unsigned int n = 0;
 	for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
 		const struct aiFace* face = &mesh->mFaces[t];
 		for (int i = 0; i < 3; i++) {
-			indices.push_back(face->mIndices[i]);
+			indices[n++] = face->mIndices[i];
 		}
 		if (face->mNumIndices == 4) {
-			indices.push_back(face->mIndices[0]);
-			indices.push_back(face->mIndices[2]);
-			indices.push_back(face->mIndices[3]);
+			indices[n++] = face->mIndices[0];
+			indices[n++] = face->mIndices[2];
+			indices[n++] = face->mIndices[3];
 		}
 	}
 
+	contentHash = contentHash64(vertices, vertexCount * sizeof(Vertex),
+		contentHash64(indices, indexCount * sizeof(unsigned short)));
+}
+
+static void uncacheMesh(Mesh* m);
+
+void Mesh::writeVertices(uint32_t first, uint32_t count, const Vertex* source) {
+	if (first >= vertexCount)
+		return;
+	//The cache maps the file's content to this mesh; once edited it
+	//must stop handing it out for fresh loads of that file.
+	if (!edited) {
+		uncacheMesh(this);
+		edited = 1;
+	}
+	count = std::min(count, vertexCount - first);
+	memcpy(vertices + first, source, count * sizeof(Vertex));
+	boundsMin = boundsMax = vertices[0].position;
+	for (unsigned int t = 1; t < vertexCount; ++t) {
+		boundsMin = glm::min(boundsMin, vertices[t].position);
+		boundsMax = glm::max(boundsMax, vertices[t].position);
+	}
+	contentHash = contentHash64(vertices, vertexCount * sizeof(Vertex),
+		contentHash64(indices, indexCount * sizeof(unsigned short)));
+}
+
+size_t Mesh::getByteSize() {
+	return vertexCount * sizeof(Vertex) + indexCount * sizeof(unsigned short);
+}
+
+bool Mesh::makeVertexBuffer() {
+	if (vertexCount == 0)
+		return 0;
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return 1;
+}
+
+bool Mesh::makeIndexBuffer() {
+	if (indexCount == 0)
+		return 0;
 	glGenBuffers(1, &indexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned short), indices, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	return 1;
 }
 
+void Mesh::releaseBuffers() {
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	vertexBuffer = indexBuffer = 0;
+}
+
+std::map<std::pair<uint64_t, size_t>, MeshHandle> meshCache;
+//Meshes writeVertices() took out of meshCache; closeMap() frees them too.
+std::vector<MeshHandle> editedMeshes;
+
+static void uncacheMesh(Mesh* m) {
+	auto it = meshCache.find(std::pair<uint64_t, size_t>(m->getContentHash(), m->getByteSize()));
+	if (it == meshCache.end() || meshHandles.get(it->second) != m)
+		return;	//Not from getMesh(), like the benchmarks' meshes.
+	MeshHandle h = it->second;
+	editedMeshes.push_back(h);
+	meshCache.erase(it);
+	//Models deduplicated by file would hand the edited mesh out too.
+	for (auto model = modelCache.begin(); model != modelCache.end();) {
+		const std::vector<MeshHandle>& meshes = model->second->getMeshes();
+		if (std::find(meshes.begin(), meshes.end(), h) != meshes.end())
+			model = modelCache.erase(model);
+		else
+			++model;
+	}
+}
+
+MeshHandle getMesh(aiMesh* meshM) {
+	//A duplicate is thrown away again, so remember where the arena was.
+	ArenaMark mark = mapArena.mark();
+	Mesh* m = mapArena.create<Mesh>(meshM);
+	std::pair<uint64_t, size_t> key(m->getContentHash(), m->getByteSize());
+	auto it = meshCache.find(key);
+	if (it != meshCache.end()) {
+		dedupStats.meshesShared++;
+		dedupStats.meshBytesSaved += 2 * m->getByteSize();
+		mapArena.rewind(mark);
+		return it->second;
+	}
+	MeshHandle h = meshHandles.insert(m);
+	if (!h) {
+		mapArena.rewind(mark);
+		return h;
+	}
+	m->upload();
+	meshCache[key] = h;
+	dedupStats.meshesLoaded++;
+	return h;
+}
+
+void closeMap() {
+	//Handles to this map's meshes stop resolving from here on.
+	for (auto& entry : meshCache) {
+		meshHandles.get(entry.second)->releaseBuffers();
+		meshHandles.remove(entry.second);
+	}
+	for (MeshHandle h : editedMeshes) {
+		meshHandles.get(h)->releaseBuffers();
+		meshHandles.remove(h);
+	}
+	meshCache.clear();
+	editedMeshes.clear();
+	modelCache.clear();
+	mapGrid.clear();
+	scenePicker.clear();
+	vertexSnapper.clear();
+	undoStack.clear();
+	thumbnailService.releaseAll();
+	mapArena.reset();
+}
+
 #pragma endregion
 
 #pragma region Texture:
 Texture::Texture(std::string filenameM) {
+	filename = filenameM;
 	unsigned char* image = stbi_load(filenameM.c_str(), &width, &height, &channels, 0);
+	upload(image);
+	stbi_image_free(image);
+}
+
+Texture::Texture(std::string filenameM, const unsigned char* fileData, size_t fileSize) {
+	filename = filenameM;
+	unsigned char* image = stbi_load_from_memory(fileData, (int)fileSize, &width, &height, &channels, 0);
+	upload(image);
+	stbi_image_free(image);
+}
+
+bool Texture::useSRGB = 0;
+
+void textureFormat(int channels, bool srgb, GLenum& internalFormat, GLenum& format) {
+	switch (channels) {
+		case 1:
+			internalFormat = GL_R8;
+			format = GL_RED;
+			break;
+		case 2:
+			internalFormat = GL_RG8;
+			format = GL_RG;
+			break;
+		case 3:
+			internalFormat = srgb ? GL_SRGB8 : GL_RGB8;
+			format = GL_RGB;
+			break;
+		default:
+			internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+			format = GL_RGBA;
+			break;
+	}
+}
+
+void textureSwizzle(int channels) {
+	//Greyscale is stored as one or two channels; spread it back out
+	//so the shader still samples grey (and alpha) rather than red.
+	if (channels == 1) {
+		GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+	else if (channels == 2) {
+		GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+}
+
+void Texture::upload(unsigned char* image) {
 	if (image) {
+		GLenum internalFormat, format;
+		textureFormat(channels, useSRGB, internalFormat, format);
+		int levels = 1;
+		while ((std::max(width, height) >> levels) > 0)
+			levels++;
+
 		glGenTextures(1, &texture);
 		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+		//stbi rows are tightly packed, which only matches the default
+		//alignment of 4 when a row happens to be a multiple of 4 bytes.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, (width * channels) % 4 == 0 ? 4 : 1);
+		if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage) {
+			glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, image);
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, image);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		textureSwizzle(channels);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -256,6 +613,95 @@ Texture::Texture(std::string filenameM) {
 	else {
 		std::cout << "TEXTURE: Error loading texture\n";
 	}
-	stbi_image_free(image);
+}
+
+Texture::Texture(const TexturePack& pack, const TexPackEntry* entry) {
+	filename = pack.getName(entry);
+	width = entry->width;
+	height = entry->height;
+	channels = entry->format;
+
+	//Streamed textures keep mutable storage: residency has to be able
+	//to free individual levels, which glTexStorage2D doesn't allow.
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	textureSwizzle(channels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	//Only the small mips are uploaded here, the rest are streamed in
+	//once culling says the texture is big enough on screen to need them.
+	textureResidency.track(this, entry);
+}
+
+std::map<std::string, TextureHandle> textureCache;
+//Identical files share a Texture: loose files by (content hash, size),
+//pack entries by data offset, since TexPacker stores duplicates once.
+std::map<std::pair<uint64_t, size_t>, Texture*> textureByContent;
+std::map<uint64_t, Texture*> textureByPackData;
+
+TextureHandle getTexture(std::string filepath) {
+	std::string key = texPackNormalize(filepath);
+	auto it = textureCache.find(key);
+	if (it != textureCache.end())
+		return it->second;
+
+	Texture* t = NULL;
+	const TexPackEntry* entry = texturePack.find(key);
+	if (entry) {
+		auto shared = textureByPackData.find(entry->dataOffset);
+		if (shared != textureByPackData.end()) {
+			t = shared->second;
+			dedupStats.texturesShared++;
+			dedupStats.textureBytesSaved += entry->dataSize;
+		}
+		else {
+			t = new Texture(texturePack, entry);
+			t->handle = textureHandles.insert(t);
+			textureByPackData[entry->dataOffset] = t;
+			dedupStats.texturesLoaded++;
+		}
+	}
+	else {
+		std::ifstream file(filepath, std::ios::binary);
+		std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		std::pair<uint64_t, size_t> content(contentHash64(bytes.data(), bytes.size()), bytes.size());
+		auto shared = textureByContent.find(content);
+		if (!bytes.empty() && shared != textureByContent.end()) {
+			t = shared->second;
+			dedupStats.texturesShared++;
+			//The upload plus the mip chain glGenerateMipmap would add.
+			dedupStats.textureBytesSaved += (size_t)t->width * t->height * t->channels * 4 / 3;
+		}
+		else {
+			t = new Texture(filepath, bytes.data(), bytes.size());
+			t->handle = textureHandles.insert(t);
+			if (!bytes.empty())
+				textureByContent[content] = t;
+			dedupStats.texturesLoaded++;
+		}
+	}
+	textureCache[key] = t->handle;
+	return t->handle;
+}
+
+std::string materialTexturePath(const std::string& modelPath, const aiMaterial* material) {
+	if (material->GetTextureCount(aiTextureType_DIFFUSE) == 0)
+		return "";
+	aiString path;
+	if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path, NULL, NULL, NULL, NULL, NULL) != AI_SUCCESS)
+		return "";
+	size_t lastSlash = modelPath.find_last_of('/');
+	std::string dir;
+	if (lastSlash == std::string::npos)
+		dir = ".";
+	else if (lastSlash == 0)
+		dir = "/";
+	else
+		dir = modelPath.substr(0, lastSlash);
+	return dir + "/" + path.data;
 }
 #pragma endregion
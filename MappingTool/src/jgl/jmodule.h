@@ -1,6 +1,8 @@
 #ifndef JMODULE_H
 #define JMODULE_H
 
+#include <cassert>
+#include <memory>
 #include <string>
 #include <vector>
 #include <GL/glew.h>
@@ -10,10 +12,32 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include "jbufferqueue.h"
+#include "jtexpack.h"
+#include "jecs.h"
+#include "jalloc.h"
+#include "jhandle.h"
 
 const std::string MOD_MODEL		= "mod_model"		;
 const std::string MOD_MATERIAL	= "mod_material"	;
 
+///
+/// Every Module subclass gets a small integer ID the first time
+/// moduleID<T>() is used. WorldObjects keep one slot per ID, so
+/// findModule<T>() is an array index instead of a string search.
+/// Types past MAX_MODULE_TYPES get NO_MODULE_ID, which WorldObjects
+/// refuse to hold.
+///
+typedef unsigned int ModuleID;
+const int MAX_MODULE_TYPES = 32; //One bit each in WorldObject's mask.
+const ModuleID NO_MODULE_ID = MAX_MODULE_TYPES;
+
+//NO_MODULE_ID once MAX_MODULE_TYPES IDs have been handed out.
+ModuleID nextModuleID();
+template<class T> ModuleID moduleID() {
+	static const ModuleID id = nextModuleID();
+	return id;
+}
+
 //Declaring these classes and structs so they can be used regardless of definition order:
 class WorldObject;
 class Module;
@@ -24,23 +48,59 @@ struct Mesh;
 struct Vertex;
 struct Texture;
 
+//Hold these instead of pointers to anything that can be deleted
+//while the map is being edited; resolve them through the tables
+//at the bottom of this file.
+typedef Handle<WorldObject> WorldObjectHandle;
+typedef Handle<Mesh> MeshHandle;
+typedef Handle<Texture> TextureHandle;
+typedef Handle<Material> MaterialHandle;
+
 // Classes first: 
 
 /// <summary>
 /// WorldObject(). Contains modules. Think of it as a Unity 
 /// GameObject. Also contains the worldspace transform of
-/// the object. Defaults to (0,0,0,0)
+/// the object. Defaults to the identity matrix.
+/// Owns its modules: destroying it releases them. Make both
+/// through worldObjectPool and the module's own pool.
 /// </summary>
 class WorldObject {
 	private:
-		std::vector<Module*> modules;
+		Module* modules[MAX_MODULE_TYPES] = {};
+		unsigned int moduleMask = 0;
+		WorldObjectHandle handle;
 	public:
+		//Placement until the object is attached to the scene; after
+		//that use the methods below, which go through its entity.
 		glm::mat4 worldMatrix;
+		LayerMask layers = LAYER_DEFAULT;
+		Entity entity = NULL_ENTITY;
+		void setLocalMatrix(const glm::mat4& m);
+		void setLayers(LayerMask mask);
+		glm::mat4 getWorldMatrix();
+		//Moves with parentIn from now on. NULL detaches. Both objects
+		//must be attached. Returns 0 if it would make a cycle.
+		bool setParent(WorldObject* parentIn);
+
 		bool insertModule(Module* mIn);
 		bool removeModule(Module* mIn);
-		Module* findModule(std::string type);
+		//Slow path for when only the type name is known.
+		Module* findModule(const std::string& type);
+		template<class T> T* findModule() {
+			ModuleID id = moduleID<T>();
+			return id == NO_MODULE_ID ? NULL : static_cast<T*>(modules[id]);
+		}
+		template<class T> bool hasModule() {
+			ModuleID id = moduleID<T>();
+			return id != NO_MODULE_ID && ((moduleMask >> id) & 1);
+		}
+		//Bit n is set when the module with ID n is present.
+		unsigned int getModuleMask() { return moduleMask; }
+		WorldObjectHandle getHandle() { return handle; }
 
 		WorldObject();
+		~WorldObject();
 };
 
 /// <summary>
@@ -53,26 +113,28 @@ class WorldObject {
 class Module {
 protected:
 	std::string moduleType = "";
-	WorldObject* parent;
+	ModuleID typeID = NO_MODULE_ID;	//Subclass constructors set it to moduleID<T>()
+	WorldObjectHandle parent;
 public:
 	Module() {}
-	void setParent(WorldObject* parentIn) { parent = parentIn; }
+	void setParent(WorldObject* parentIn) { parent = parentIn ? parentIn->getHandle() : WorldObjectHandle(); }
+	//NULL once the owning WorldObject is gone.
+	WorldObject* getParent();
 	std::string getType() { return moduleType; }
+	ModuleID getTypeID() {
+		//Still NO_MODULE_ID: the subclass never set it, or it ran out of
+		//IDs. Release builds let WorldObjects refuse the module.
+		assert(typeID != NO_MODULE_ID && "Module type ID never set");
+		return typeID;
+	}
 	
-	//For polymorphism:
+	virtual ~Module() {}
+
+	//Everything type specific lives on the subclass; get at it
+	//through WorldObject::findModule<T>().
 	virtual void reset() = 0;
-	virtual bool loadModel(std::string) = 0;				//Model
-	virtual std::string getFilepath() = 0;					//Model
-	virtual std::vector<GLuint> getVertexBuffers() = 0;		//Model
-	virtual std::vector<GLuint> getIndexBuffers() = 0;		//Model
-	virtual std::vector<GLuint> getMaterialIndices() = 0;	//Model
-	virtual std::vector<GLuint> getIndexCounts() = 0;		//Model
-	virtual const aiScene* getScene() = 0;					//Model
-	virtual bool loadModel(GLint progID) = 0;				//Material
-	virtual void render(GLint progID) = 0;					//Material
-	virtual void bind(Texture* t, GLuint inp) = 0;			//Material
-	virtual void unbind(GLuint inp) = 0;					//Material
-	virtual void pushVAO() = 0;								//Material
+	//Destroys the module through the pool it came from.
+	virtual void release() = 0;
 };
 
 /// <summary>
@@ -82,15 +144,21 @@ public:
 class Model : public Module {
 	private:
 		std::vector<GLuint> vertexBuffers, indexBuffers, materialIndices, indexCts				;
-		std::vector<Mesh> meshes;
+		std::vector<MeshHandle> meshes;
 		std::vector<Texture*> textures;
-		Assimp::Importer importer;
+		//Owns scene. Shared with every Model deduplicated onto this one,
+		//so the scene lasts as long as any of them.
+		std::shared_ptr<Assimp::Importer> importer;
 		const aiScene* scene;
+		void forgetCached();
 		std::string modelPath;
+		glm::vec3 boundsMin, boundsMax;
 
 	public:
 		Model();
+		~Model();
 		void reset();
+		void release();
 		bool loadModel(std::string modelPathM);
 		std::vector<GLuint> getVertexBuffers() { return vertexBuffers; }
 		std::vector<GLuint> getIndexBuffers() { return indexBuffers; }
@@ -98,12 +166,8 @@ class Model : public Module {
 		std::vector<GLuint> getIndexCounts() { return indexCts; }
 		std::string getFilepath() { return modelPath; }
 		const aiScene* getScene() { return scene; }
-
-		bool loadModel(GLint progID) { return 0; }
-		void render(GLint progID) { }
-		void bind(Texture* t, GLuint inp) { }
-		void unbind(GLuint inp) { }
-		void pushVAO() { }							
+		const std::vector<MeshHandle>& getMeshes() { return meshes; }
+		bool getBounds(glm::vec3& minOut, glm::vec3& maxOut);
 };
 
 /// <summary>
@@ -123,67 +187,92 @@ class Brush : public Module {
 class Material : public  Module {
 	private:
 		std::vector<GLuint> vertexBuffers, indexBuffers, materialIndices, indexCounts;
-		std::vector<Texture*> textures;
+		std::vector<TextureHandle> textures;
+		std::vector<std::string> texturePaths;	//What loadModel() asked getTexture() for
 		std::string filepath = "";
 		const aiScene* scene;
 		void bind(Texture* t, GLuint inp);
 		void unbind(GLuint inp);
-		std::vector<BufferContainer*> bVec;
+		std::vector<BufferHandle> bVec;
+		MaterialHandle handle;
 	public:
+		//Cut out texels under IDPICK_ALPHA_CUTOFF alpha in the view too,
+		//as picking does. Set before loadModel().
+		bool alphaTest = 0;
+
 		Material();
+		~Material();
 		bool loadModel(GLint progID);
 		void render(GLint progID); //returns number of vertices (indices) rendered.
-		void pushVAO();
+		//Tells the residency manager how large this object is on screen.
+		void requestMips(float screenPixels, std::vector<MipRequest>& out);
 
 		void reset() { }
-		bool loadModel(std::string strIn) { return 0; }
+		void release();
 		std::string getFilepath() { return filepath; }
-		std::vector<GLuint> getVertexBuffers() { 
-			std::vector<GLuint> temp;
-			return temp; 
-		}
-		std::vector<GLuint> getIndexBuffers() {
-			std::vector<GLuint> temp;
-			return temp;
-		}
-		std::vector<GLuint> getMaterialIndices() {
-			std::vector<GLuint> temp;
-			return temp;
-		}
-		std::vector<GLuint> getIndexCounts() {
-			std::vector<GLuint> temp;
-			return temp;
-		}
-		const aiScene* getScene() { return NULL; }
+		const std::vector<BufferHandle>& getBuffers() { return bVec; }
+		const std::vector<std::string>& getTexturePaths() { return texturePaths; }
+		MaterialHandle getHandle() { return handle; }
 };
 
 // Now onto the supplementaries:
 
+/// <summary>
+/// Mesh. Its vertex and index arrays live in mapArena, so a Mesh
+/// only lasts until closeMap() and must be made with
+/// mapArena.create<Mesh>() (getMesh() does this).
+/// </summary>
 class Mesh {
 	private:
 		aiMesh* mesh;
-		GLuint vertexBuffer, indexBuffer, materialIndex;
+		GLuint vertexBuffer = 0, indexBuffer = 0, materialIndex;
+		uint64_t contentHash = 0;
+		bool edited = 0;	//Taken out of the mesh cache by writeVertices()
+		void readMesh();
 		bool makeVertexBuffer();
 		bool makeIndexBuffer();
-		std::vector<Vertex> vertices;
-		std::vector<unsigned short> indices;
+		Vertex* vertices = NULL;
+		unsigned short* indices = NULL;
+		unsigned int vertexCount = 0, indexCount = 0;
+		glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
 	public:
+		//Only reads the aiMesh into CPU arrays; upload() makes the
+		//GL buffers. getMesh() does both and shares duplicates.
 		Mesh(aiMesh* meshM) {
 			mesh = meshM;
 			materialIndex = mesh->mMaterialIndex;
-			makeVertexBuffer();
-			makeIndexBuffer();
+			readMesh();
 		}
 		bool setMesh(aiMesh* meshM) {
 			mesh = meshM;
 			materialIndex = mesh->mMaterialIndex;
+			readMesh();
+			return upload();
+		}
+		bool upload() {
 			bool ret = makeVertexBuffer();
-			return ret * makeIndexBuffer();
+			return ret && makeIndexBuffer();
 		}
-		int getIndexCt() { return indices.size(); }
+		//Deletes the GL buffers. The arrays go with the arena.
+		void releaseBuffers();
+		int getIndexCt() { return indexCount; }
+		const Vertex* getVertices() { return vertices; }
+		const unsigned short* getIndices() { return indices; }
+		uint32_t getTriangleCount() { return indexCount / 3; }
+		uint32_t getVertexCount() { return vertexCount; }
+		//Overwrites vertices [first, first + count) of the CPU copy and
+		//redoes the bounds and content hash; the GL buffer is the caller's
+		//to update. Every object sharing the mesh sees the change, but
+		//loads after it no longer share the mesh. Go through undoStack
+		//rather than calling this directly.
+		void writeVertices(uint32_t first, uint32_t count, const Vertex* source);
 		GLuint getVertexBuffer() { return vertexBuffer; }
 		GLuint getIndexBuffer() { return indexBuffer; }
 		GLuint getMaterialIndex() { return materialIndex; }
+		glm::vec3 getBoundsMin() { return boundsMin; }
+		glm::vec3 getBoundsMax() { return boundsMax; }
+		uint64_t getContentHash() { return contentHash; }
+		size_t getByteSize();
 };
 
 struct Vertex {
@@ -195,11 +284,68 @@ struct Texture {
 	std::string filename;
 	int width = 0, height = 0, channels = 0;
 	unsigned int texture = 0;
+	int residencySlot = -1; //Index in textureResidency, -1 if not streamed.
+	TextureHandle handle;
+	//Store colour textures as sRGB. Only turn on together with
+	//GL_FRAMEBUFFER_SRGB, or everything will render too dark.
+	static bool useSRGB;
 
 	Texture(std::string filenameM);
+	Texture(std::string filenameM, const unsigned char* fileData, size_t fileSize);
+	Texture(const TexturePack& pack, const TexPackEntry* entry);
+	void upload(unsigned char* image);
 	void getImageSize(int& widthM, int& heightM) {
 		widthM = width; heightM = height;
 	}
 };
 
+//Sized internal format and upload format for a channel count.
+void textureFormat(int channels, bool srgb, GLenum& internalFormat, GLenum& format);
+//Makes 1 and 2 channel textures sample as grey / grey+alpha.
+//Applies to the texture bound to GL_TEXTURE_2D.
+void textureSwizzle(int channels);
+
+//Returns the texture for filepath, loading it on first request.
+//The mounted texturePack is tried before the loose file. Files
+//with identical contents share one Texture.
+TextureHandle getTexture(std::string filepath);
+//The path a Material asks getTexture() for: material's diffuse
+//texture, next to the model file. "" if it has none.
+std::string materialTexturePath(const std::string& modelPath, const aiMaterial* material);
+
+//Returns an uploaded Mesh for meshM, or an existing one with the
+//same vertex and index data.
+MeshHandle getMesh(aiMesh* meshM);
+
+//Frees everything loaded for the current map: mesh buffers, the
+//mesh and model caches, mapGrid, scenePicker's trees, the undo history
+//and mapArena. Destroy the map's WorldObjects first.
+void closeMap();
+
+extern Pool<WorldObject> worldObjectPool;
+extern Pool<Model> modelPool;
+extern Pool<Material> materialPool;
+
+extern HandleTable<WorldObject> worldObjects;
+extern HandleTable<Mesh> meshHandles;
+extern HandleTable<Texture> textureHandles;
+extern HandleTable<Material> materialHandles;
+
+/// <summary>
+/// What content-hash deduplication has saved so far. Mesh bytes are
+/// counted twice, for the CPU arrays meshes keep and the GPU copy.
+/// Texture bytes are counted once: pack textures are mapped rather
+/// than copied, and loose ones free their decoded image after upload,
+/// so only the GPU copy is saved.
+/// </summary>
+struct DedupStats {
+	int texturesLoaded = 0, texturesShared = 0;
+	int meshesLoaded = 0, meshesShared = 0;
+	int modelsLoaded = 0, modelsShared = 0;
+	size_t textureBytesSaved = 0, meshBytesSaved = 0;
+	void print();
+};
+
+extern DedupStats dedupStats;
+
 #endif
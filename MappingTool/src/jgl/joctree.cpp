@@ -0,0 +1,478 @@
+#include "joctree.h"
+#include "jhandle.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const uint32_t NO_NODE = UINT32_MAX;
+static const Entity NULL_OCTREE_ENTITY = 0xFFFFFFFF;
+
+void frustumPlanes(const glm::mat4& VP, glm::vec4 planes[6]) {
+	//Gribb/Hartmann: each plane is a sum/difference of VP's rows.
+	glm::mat4 m = glm::transpose(VP);
+	planes[0] = m[3] + m[0]; //left
+	planes[1] = m[3] - m[0]; //right
+	planes[2] = m[3] + m[1]; //bottom
+	planes[3] = m[3] - m[1]; //top
+	planes[4] = m[3] + m[2]; //near
+	planes[5] = m[3] - m[2]; //far
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+#pragma region Structure:
+Octree::Octree(glm::vec3 center, float halfSize) {
+	reset(center, halfSize);
+}
+
+void Octree::reset(glm::vec3 center, float halfSize) {
+	nodes.clear();
+	lookup.clear();
+	objectCount = 0;
+	freeNodes.clear();
+	Node root;
+	root.center = center;
+	root.halfSize = halfSize;
+	root.parent = NO_NODE;
+	std::fill(root.children, root.children + 8, 0);
+	root.count = 0;
+	root.depth = 0;
+	nodes.push_back(root);
+}
+
+uint32_t Octree::child(uint32_t node, int octant, bool create) {
+	uint32_t c = nodes[node].children[octant];
+	if (c || !create)
+		return c;
+
+	Node n;
+	n.halfSize = nodes[node].halfSize * 0.5f;
+	n.center = nodes[node].center + glm::vec3(
+		(octant & 1) ? n.halfSize : -n.halfSize,
+		(octant & 2) ? n.halfSize : -n.halfSize,
+		(octant & 4) ? n.halfSize : -n.halfSize);
+	n.parent = node;
+	std::fill(n.children, n.children + 8, 0);
+	n.count = 0;
+	n.depth = nodes[node].depth + 1;
+	if (!freeNodes.empty()) {
+		c = freeNodes.back();
+		freeNodes.pop_back();
+		n.items.swap(nodes[c].items); //Keep the old allocation.
+		nodes[c] = std::move(n);
+	}
+	else {
+		c = (uint32_t)nodes.size();
+		nodes.push_back(std::move(n));
+	}
+	nodes[node].children[octant] = c;
+	return c;
+}
+
+int Octree::fitDepth(const Object& o) const {
+	const Node& root = nodes[0];
+	glm::vec3 d = glm::abs(o.center - root.center);
+	if (d.x > root.halfSize || d.y > root.halfSize || d.z > root.halfSize)
+		return 0;
+	//Deepest level whose cell half size still covers the radius; the
+	//loose box then holds the whole sphere.
+	if (o.radius <= 0.0f)
+		return OCTREE_MAX_DEPTH;
+	return std::clamp((int)floorf(log2f(root.halfSize / o.radius)), 0, OCTREE_MAX_DEPTH);
+}
+
+int Octree::octantOf(uint32_t node, glm::vec3 p) const {
+	const glm::vec3& c = nodes[node].center;
+	return (p.x >= c.x) | ((p.y >= c.y) << 1) | ((p.z >= c.z) << 2);
+}
+
+uint32_t Octree::targetNode(const Object& o) const {
+	int depth = fitDepth(o);
+	uint32_t n = 0;
+	for (int i = 0; i < depth; i++) {
+		uint32_t next = nodes[n].children[octantOf(n, o.center)];
+		if (!next)
+			break;
+		n = next;
+	}
+	return n;
+}
+
+void Octree::link(const Object& o, uint32_t node) {
+	Location& loc = lookup[handleIndex(o.entity)];
+	loc.node = node;
+	loc.slot = (uint32_t)nodes[node].items.size();
+	nodes[node].items.push_back(o);
+	for (uint32_t n = node; n != NO_NODE; n = nodes[n].parent)
+		nodes[n].count++;
+	if (nodes[node].items.size() > OCTREE_SPLIT && nodes[node].depth < OCTREE_MAX_DEPTH)
+		split(node);
+}
+
+void Octree::split(uint32_t node) {
+	//Back to front, so what unlink() swaps into the hole has already
+	//been looked at. No references into nodes: child() can grow it.
+	for (size_t i = nodes[node].items.size(); i-- > 0;) {
+		Object o = nodes[node].items[i];
+		if (fitDepth(o) <= nodes[node].depth)
+			continue;
+		unlink(lookup[handleIndex(o.entity)]);
+		link(o, child(node, octantOf(node, o.center), 1));
+	}
+}
+
+void Octree::unlink(Location& loc) {
+	std::vector<Object>& items = nodes[loc.node].items;
+	if (loc.slot != items.size() - 1) {
+		items[loc.slot] = items.back();
+		lookup[handleIndex(items[loc.slot].entity)].slot = loc.slot;
+	}
+	items.pop_back();
+	for (uint32_t n = loc.node; n != NO_NODE; n = nodes[n].parent)
+		nodes[n].count--;
+}
+
+void Octree::prune(uint32_t node) {
+	while (node != 0 && nodes[node].count == 0) {
+		uint32_t parent = nodes[node].parent;
+		for (int i = 0; i < 8; i++) {
+			if (nodes[parent].children[i] == node)
+				nodes[parent].children[i] = 0;
+		}
+		freeNodes.push_back(node);
+		node = parent;
+	}
+}
+
+const Octree::Location* Octree::find(Entity e) const {
+	uint32_t i = handleIndex(e);
+	if (i >= lookup.size() || lookup[i].node == NO_NODE || lookup[i].entity != e)
+		return NULL;
+	return &lookup[i];
+}
+
+void Octree::update(Entity e, glm::vec3 center, float radius, uint64_t mask) {
+	Object o = { center, radius, mask, e };
+	uint32_t target = targetNode(o);
+	uint32_t i = handleIndex(e);
+	if (!find(e)) {
+		if (i >= lookup.size())
+			lookup.resize(i + 1, { NULL_OCTREE_ENTITY, NO_NODE, 0 });
+		lookup[i].entity = e;
+		link(o, target);
+		objectCount++;
+		return;
+	}
+
+	Location& loc = lookup[i];
+	if (target == loc.node) {
+		nodes[loc.node].items[loc.slot] = o; //Common case: moved within its cell.
+		return;
+	}
+	uint32_t old = loc.node;
+	unlink(loc);
+	link(o, target);
+	prune(old);
+}
+
+void Octree::setMask(Entity e, uint64_t mask) {
+	const Location* loc = find(e);
+	if (loc)
+		nodes[loc->node].items[loc->slot].mask = mask;
+}
+
+void Octree::remove(Entity e) {
+	if (!find(e))
+		return;
+	Location& loc = lookup[handleIndex(e)];
+	uint32_t node = loc.node;
+	unlink(loc);
+	prune(node);
+	loc.node = NO_NODE;
+	objectCount--;
+}
+#pragma endregion
+
+#pragma region Queries:
+//Node tests return 0 if nothing in the node can pass, 2 if everything
+//in it passes without a test, and 1 if objects need testing.
+template<class NodeTest, class ObjectTest>
+void Octree::query(NodeTest nodeTest, ObjectTest objectTest, uint64_t mask, std::vector<Entity>& out) const {
+	uint32_t stack[8 * (OCTREE_MAX_DEPTH + 1) + 1];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		uint32_t n = stack[--top];
+		const Node& node = nodes[n];
+		if (node.count == 0)
+			continue;
+		//The root also holds everything outside it, so it is always open.
+		int result = (n == 0) ? 1 : nodeTest(node.center, node.halfSize * 2.0f);
+		if (result == 0)
+			continue;
+		if (result == 2) {
+			collect(n, mask, out);
+			continue;
+		}
+		for (const Object& o : node.items) {
+			//The mask goes first: hidden layers cost one AND.
+			if ((o.mask & mask) && objectTest(o))
+				out.push_back(o.entity);
+		}
+		for (int i = 0; i < 8; i++) {
+			if (node.children[i])
+				stack[top++] = node.children[i];
+		}
+	}
+}
+
+void Octree::collect(uint32_t n, uint64_t mask, std::vector<Entity>& out) const {
+	for (const Object& o : nodes[n].items) {
+		if (o.mask & mask)
+			out.push_back(o.entity);
+	}
+	for (int i = 0; i < 8; i++) {
+		if (nodes[n].children[i])
+			collect(nodes[n].children[i], mask, out);
+	}
+}
+
+void Octree::queryFrustum(const glm::vec4 planes[6], std::vector<Entity>& out, uint64_t mask) const {
+	query([planes](glm::vec3 c, float h) {
+		int result = 2;
+		for (int p = 0; p < 6; p++) {
+			glm::vec3 n(planes[p]);
+			float d = glm::dot(n, c) + planes[p].w;
+			float r = h * (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+			if (d < -r)
+				return 0;
+			if (d < r)
+				result = 1;
+		}
+		return result;
+	}, [planes](const Object& o) {
+		for (int p = 0; p < 6; p++) {
+			if (glm::dot(glm::vec3(planes[p]), o.center) + planes[p].w < -o.radius)
+				return 0;
+		}
+		return 1;
+	}, mask, out);
+}
+
+void Octree::queryRegion(const std::function<int(glm::vec3, glm::vec3)>& boxTest, const std::function<int(glm::vec3, float)>& sphereTest,
+	std::vector<Entity>& inside, std::vector<Entity>& partial, uint64_t mask) const {
+	uint32_t stack[8 * (OCTREE_MAX_DEPTH + 1) + 1];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		uint32_t n = stack[--top];
+		const Node& node = nodes[n];
+		if (node.count == 0)
+			continue;
+		int result = (n == 0) ? 1 : boxTest(node.center - node.halfSize * 2.0f, node.center + node.halfSize * 2.0f);
+		if (result == 0)
+			continue;
+		if (result == 2) {
+			collect(n, mask, inside);
+			continue;
+		}
+		for (const Object& o : node.items) {
+			if (!(o.mask & mask))
+				continue;
+			int r = sphereTest(o.center, o.radius);
+			if (r == 2)
+				inside.push_back(o.entity);
+			else if (r == 1)
+				partial.push_back(o.entity);
+		}
+		for (int i = 0; i < 8; i++) {
+			if (node.children[i])
+				stack[top++] = node.children[i];
+		}
+	}
+}
+
+void Octree::queryAABB(glm::vec3 bMin, glm::vec3 bMax, std::vector<Entity>& out, uint64_t mask) const {
+	query([bMin, bMax](glm::vec3 c, float h) {
+		glm::vec3 lo = c - h, hi = c + h;
+		if (glm::any(glm::lessThan(hi, bMin)) || glm::any(glm::greaterThan(lo, bMax)))
+			return 0;
+		return (glm::all(glm::greaterThanEqual(lo, bMin)) && glm::all(glm::lessThanEqual(hi, bMax))) ? 2 : 1;
+	}, [bMin, bMax](const Object& o) {
+		glm::vec3 closest = glm::clamp(o.center, bMin, bMax);
+		glm::vec3 d = o.center - closest;
+		return glm::dot(d, d) <= o.radius * o.radius;
+	}, mask, out);
+}
+
+void Octree::querySphere(glm::vec3 center, float radius, std::vector<Entity>& out, uint64_t mask) const {
+	float r2 = radius * radius;
+	query([center, r2](glm::vec3 c, float h) {
+		glm::vec3 d = glm::max(glm::abs(center - c) - h, glm::vec3(0.0f));
+		if (glm::dot(d, d) > r2)
+			return 0;
+		glm::vec3 corner = glm::abs(center - c) + h;
+		return glm::dot(corner, corner) <= r2 ? 2 : 1;
+	}, [center, radius](const Object& o) {
+		glm::vec3 d = o.center - center;
+		float r = radius + o.radius;
+		return glm::dot(d, d) <= r * r;
+	}, mask, out);
+}
+
+void Octree::queryRay(glm::vec3 origin, glm::vec3 dir, float maxDist, std::vector<std::pair<float, Entity>>& out, uint64_t mask) const {
+	glm::vec3 inv = 1.0f / dir;
+	size_t first = out.size();
+	std::vector<Entity> hits;
+	query([origin, inv, maxDist](glm::vec3 c, float h) {
+		//Slab test against the loose box.
+		glm::vec3 t0 = (c - h - origin) * inv, t1 = (c + h - origin) * inv;
+		glm::vec3 tMin = glm::min(t0, t1), tMax = glm::max(t0, t1);
+		float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+		float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDist));
+		return enter <= exit ? 1 : 0;
+	}, [&out, origin, dir, maxDist](const Object& o) {
+		glm::vec3 oc = origin - o.center;
+		float b = glm::dot(oc, dir);
+		float c = glm::dot(oc, oc) - o.radius * o.radius;
+		float disc = b * b - c;
+		if (disc < 0.0f)
+			return 0;
+		float t = -b - sqrtf(disc);
+		if (t < 0.0f)
+			t = (c <= 0.0f) ? 0.0f : -b + sqrtf(disc); //Origin inside, or sphere behind.
+		if (t < 0.0f || t > maxDist)
+			return 0;
+		out.push_back({ t, o.entity });
+		return 0; //Already recorded with its distance.
+	}, mask, hits);
+	std::sort(out.begin() + first, out.end());
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void octreeBenchmark() {
+	const int COUNT = 100000, QUERIES = 100;
+	const float EXTENT = 2000.0f;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> pos(-EXTENT, EXTENT), rad(0.25f, 4.0f), jitter(-0.5f, 0.5f), unit(-1.0f, 1.0f);
+
+	std::vector<glm::vec3> centers(COUNT);
+	std::vector<float> radii(COUNT);
+	for (int i = 0; i < COUNT; i++) {
+		centers[i] = glm::vec3(pos(rng), pos(rng) * 0.1f, pos(rng));
+		radii[i] = rad(rng);
+	}
+
+	Octree tree(glm::vec3(0.0f), EXTENT);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < COUNT; i++)
+		tree.update((Entity)i, centers[i], radii[i]);
+	double build = msSince(start);
+
+	//Small moves mostly stay in their node; big ones always relink.
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < COUNT; i++) {
+		centers[i] += glm::vec3(jitter(rng), 0.0f, jitter(rng));
+		tree.update((Entity)i, centers[i], radii[i]);
+	}
+	double nudge = msSince(start);
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < COUNT; i += 10) {
+		centers[i] = glm::vec3(pos(rng), pos(rng) * 0.1f, pos(rng));
+		tree.update((Entity)i, centers[i], radii[i]);
+	}
+	double teleport = msSince(start);
+
+	//Frustums like the editor camera's, looking around from inside the map.
+	std::vector<Entity> found;
+	size_t frustumHits = 0, mismatches = 0;
+	double frustum = 0.0;
+	for (int q = 0; q < QUERIES; q++) {
+		glm::vec3 eye(pos(rng) * 0.5f, 50.0f, pos(rng) * 0.5f);
+		glm::vec3 look = glm::normalize(glm::vec3(unit(rng), -0.2f, unit(rng)));
+		glm::mat4 VP = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 500.0f) * glm::lookAt(eye, eye + look, glm::vec3(0, 1, 0));
+		glm::vec4 planes[6];
+		frustumPlanes(VP, planes);
+
+		found.clear();
+		start = std::chrono::high_resolution_clock::now();
+		tree.queryFrustum(planes, found);
+		frustum += msSince(start);
+		frustumHits += found.size();
+
+		//Brute force on a few to check the tree against.
+		if (q < 5) {
+			size_t brute = 0;
+			for (int i = 0; i < COUNT; i++) {
+				bool inside = 1;
+				for (int p = 0; p < 6 && inside; p++)
+					inside = glm::dot(glm::vec3(planes[p]), centers[i]) + planes[p].w >= -radii[i];
+				brute += inside;
+			}
+			mismatches += (brute != found.size());
+		}
+	}
+
+	double box = 0.0, sphere = 0.0, ray = 0.0;
+	size_t boxHits = 0, sphereHits = 0, rayHits = 0;
+	std::vector<std::pair<float, Entity>> rayFound;
+	for (int q = 0; q < QUERIES; q++) {
+		glm::vec3 c(pos(rng), 0.0f, pos(rng));
+		found.clear();
+		start = std::chrono::high_resolution_clock::now();
+		tree.queryAABB(c - 50.0f, c + 50.0f, found);
+		box += msSince(start);
+		boxHits += found.size();
+
+		found.clear();
+		start = std::chrono::high_resolution_clock::now();
+		tree.querySphere(c, 50.0f, found);
+		sphere += msSince(start);
+		sphereHits += found.size();
+
+		rayFound.clear();
+		glm::vec3 dir = glm::normalize(glm::vec3(unit(rng), unit(rng) * 0.05f, unit(rng)));
+		start = std::chrono::high_resolution_clock::now();
+		tree.queryRay(c, dir, 1000.0f, rayFound);
+		ray += msSince(start);
+		rayHits += rayFound.size();
+	}
+
+	//Half the objects go on a second layer, then that layer is hidden
+	//from a view that takes in most of the map.
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < COUNT; i += 2)
+		tree.setMask((Entity)i, 2);
+	double relayer = msSince(start);
+	glm::vec4 planes[6];
+	frustumPlanes(glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 5000.0f) * glm::lookAt(glm::vec3(0.0f, 2500.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0, 0, 1)), planes);
+	found.clear();
+	start = std::chrono::high_resolution_clock::now();
+	tree.queryFrustum(planes, found);
+	double allLayers = msSince(start);
+	size_t allHits = found.size();
+	found.clear();
+	start = std::chrono::high_resolution_clock::now();
+	tree.queryFrustum(planes, found, 1);
+	double oneLayer = msSince(start);
+
+	std::cout << "OCTREE: " << COUNT << " objects, build " << build << " ms, " << COUNT / build << " inserts/ms\n";
+	std::cout << "OCTREE: nudge all " << nudge << " ms, relink 10% " << teleport << " ms\n";
+	std::cout << "OCTREE: frustum " << frustum / QUERIES << " ms/query (" << frustumHits / QUERIES << " hits avg)\n";
+	std::cout << "OCTREE: aabb " << box / QUERIES << " ms, sphere " << sphere / QUERIES << " ms, ray "
+		<< ray / QUERIES << " ms/query (" << boxHits / QUERIES << ", " << sphereHits / QUERIES << ", " << rayHits / QUERIES << " hits avg)\n";
+	std::cout << "OCTREE: " << COUNT / 2 << " objects relayered in " << relayer << " ms; wide frustum " << allLayers << " ms ("
+		<< allHits << " hits), layer hidden " << oneLayer << " ms (" << found.size() << " hits)\n";
+	if (mismatches)
+		std::cout << "OCTREE: " << mismatches << " frustum queries disagree with brute force!\n";
+}
+#pragma endregion
@@ -0,0 +1,111 @@
+#ifndef JOCTREE_H
+#define JOCTREE_H
+
+#include <functional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+typedef uint32_t Entity; //As in jecs.h, which includes this
+
+const int OCTREE_MAX_DEPTH = 10;
+//A node only gets children once it holds more objects than this, so
+//sparse areas don't grow chains of nodes with one object each.
+const int OCTREE_SPLIT = 16;
+
+//Frustum planes (normal, distance) pointing inwards, from a
+//view-projection matrix.
+void frustumPlanes(const glm::mat4& VP, glm::vec4 planes[6]);
+
+/// <summary>
+/// Loose octree over bounding spheres. Every node's box is doubled
+/// for membership, so an object belongs in the node that holds its
+/// center at the depth matching its radius, or as close to that as
+/// the tree has been split. Where it goes is walked straight down
+/// rather than searched for, and an object that moves a little stays
+/// in the same node and just has its sphere rewritten.
+///
+/// Objects whose center is outside the root go in the root, which
+/// every query visits.
+/// </summary>
+class Octree {
+	private:
+		//Stored in the node itself so a query reads its objects in order.
+		struct Object {
+			glm::vec3 center;
+			float radius;
+			uint64_t mask;				//Queries skip objects that share no bit with theirs
+			Entity entity;
+		};
+		struct Node {
+			glm::vec3 center;
+			float halfSize;				//Of the tight cell; the loose box is twice this
+			uint32_t parent;
+			uint32_t children[8];		//0 = none (the root is never a child)
+			uint32_t count;				//Objects in this node and below
+			int depth;
+			std::vector<Object> items;
+		};
+		struct Location {
+			Entity entity;				//To reject stale ids
+			uint32_t node, slot;		//Which node's items, and where
+		};
+		std::vector<Node> nodes;
+		std::vector<Location> lookup;	//By entity index; node is UINT32_MAX when absent
+		std::vector<uint32_t> freeNodes;
+		uint32_t objectCount = 0;
+
+		//Deepest level o could go, by its radius; 0 if outside the root.
+		int fitDepth(const Object& o) const;
+		int octantOf(uint32_t node, glm::vec3 p) const;
+		//Deepest existing node on the way to o's level.
+		uint32_t targetNode(const Object& o) const;
+		uint32_t child(uint32_t node, int octant, bool create);
+		//Adds o to node, splitting node if that makes it too crowded.
+		void link(const Object& o, uint32_t node);
+		void split(uint32_t node);
+		void unlink(Location& loc);
+		void prune(uint32_t node);
+		//NULL when e is not in the tree.
+		const Location* find(Entity e) const;
+
+		template<class NodeTest, class ObjectTest>
+		void query(NodeTest nodeTest, ObjectTest objectTest, uint64_t mask, std::vector<Entity>& out) const;
+		void collect(uint32_t node, uint64_t mask, std::vector<Entity>& out) const;
+	public:
+		Octree(glm::vec3 center = glm::vec3(0.0f), float halfSize = 4096.0f);
+		//Drops everything and sets the area the tree covers.
+		void reset(glm::vec3 center, float halfSize);
+
+		//Inserts e, or moves it if it is already in the tree.
+		void update(Entity e, glm::vec3 center, float radius, uint64_t mask = UINT64_MAX);
+		//Changes e's mask in place; nothing moves.
+		void setMask(Entity e, uint64_t mask);
+		void remove(Entity e);
+		bool contains(Entity e) const { return find(e) != NULL; }
+		uint32_t size() const { return objectCount; }
+
+		//Each query appends the entities whose sphere passes, and whose
+		//mask shares a bit with the query's, to out.
+		void queryFrustum(const glm::vec4 planes[6], std::vector<Entity>& out, uint64_t mask = UINT64_MAX) const;
+		void queryAABB(glm::vec3 bMin, glm::vec3 bMax, std::vector<Entity>& out, uint64_t mask = UINT64_MAX) const;
+		void querySphere(glm::vec3 center, float radius, std::vector<Entity>& out, uint64_t mask = UINT64_MAX) const;
+		//Hits sorted nearest first, as (distance along dir, entity).
+		//dir must be normalized.
+		void queryRay(glm::vec3 origin, glm::vec3 dir, float maxDist, std::vector<std::pair<float, Entity>>& out, uint64_t mask = UINT64_MAX) const;
+		//For regions only the caller knows how to test, like a lasso.
+		//Both tests return 0 outside, 1 partly inside, 2 inside;
+		//boxTest gets a node's loose box. Objects known to be inside,
+		//by their node or their own test, go in inside and the rest
+		//that touch go in partial.
+		void queryRegion(const std::function<int(glm::vec3, glm::vec3)>& boxTest, const std::function<int(glm::vec3, float)>& sphereTest,
+			std::vector<Entity>& inside, std::vector<Entity>& partial, uint64_t mask = UINT64_MAX) const;
+};
+
+//Times build, update and the queries over 100k random objects.
+void octreeBenchmark();
+
+#endif
@@ -0,0 +1,94 @@
+#include "jrender.h"
+#include "jgl.h"
+
+RenderThread renderThread;
+
+bool RenderThread::start(GLFWwindow* windowIn) {
+	stop();
+	window = windowIn;
+	stopping = 0;
+	pending = 0;
+	glfwMakeContextCurrent(NULL);
+	thread = std::thread(&RenderThread::threadLoop, this);
+	return 1;
+}
+
+void RenderThread::stop() {
+	if (!thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = 1;
+	}
+	cv.notify_all();
+	thread.join();
+	glfwMakeContextCurrent(window);
+	jobSystem.bindGLThread();
+}
+
+void RenderThread::submit() {
+	if (!running()) {
+		drawFrame(packets[writeIndex]);
+		packets[writeIndex].clear();
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return !pending; });
+		pending = 1;
+		writeIndex ^= 1;
+	}
+	cv.notify_all();
+	//The render thread finished with this one before pending dropped.
+	packets[writeIndex].clear();
+}
+
+void RenderThread::threadLoop() {
+	glfwMakeContextCurrent(window);
+	jobSystem.bindGLThread();
+	while (1) {
+		int readIndex;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] { return pending || stopping; });
+			if (!pending)
+				break; //Stopping with nothing left to draw.
+			readIndex = writeIndex ^ 1;
+		}
+		drawFrame(packets[readIndex]);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending = 0;
+		}
+		cv.notify_all();
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+void RenderThread::drawFrame(RenderPacket& p) {
+	//GL work queued by everyone else goes first, so what it uploads
+	//is there for this frame's draws.
+	jobSystem.runGLJobs();
+	for (const BufferWrite& w : p.bufferWrites) {
+		glBindBuffer(GL_ARRAY_BUFFER, w.buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, w.offset, w.size, p.writeData.data() + w.dataStart);
+	}
+	if (!p.bufferWrites.empty())
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	for (MipRequest& r : p.mipRequests)
+		textureResidency.request(r.texture, r.screenPixels);
+	textureResidency.update();
+	thumbnailService.poll();
+
+	streamRing.beginFrame();
+	glRender(p);
+	referenceGrid.render(p);
+	previewRenderer.render(p);
+	ghostGrid.render(p);
+	streamRing.endFrame();
+	idPicker.render(p);
+	if (!p.deadVAOs.empty())
+		glDeleteVertexArrays((GLsizei)p.deadVAOs.size(), p.deadVAOs.data());
+	glfwSwapBuffers(window);
+}
@@ -0,0 +1,54 @@
+#ifndef JRENDER_H
+#define JRENDER_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "jbufferqueue.h"
+
+/// <summary>
+/// RenderThread. Owns the GL context while the loop runs. The main
+/// thread fills packet() with the frame it just simulated and hands
+/// it over with submit(); the render thread then uploads, draws and
+/// waits on glfwSwapBuffers while the main thread is already on the
+/// next frame. Two packets swap roles each frame, so the main thread
+/// is never more than one frame ahead.
+///
+/// Everything else that needs GL during the loop (residency,
+/// thumbnail uploads, glThread jobs) runs here at the start of each
+/// frame. Without a render thread, submit() draws on the spot.
+/// </summary>
+class RenderThread {
+	private:
+		RenderPacket packets[2];
+		int writeIndex = 0;
+		bool pending = 0;		//packets[writeIndex ^ 1] waits to be drawn
+		bool stopping = 0;
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::thread thread;
+		GLFWwindow* window = NULL;
+
+		void threadLoop();
+		void drawFrame(RenderPacket& p);
+	public:
+		~RenderThread() { stop(); }
+		//Takes the context off the calling thread and starts drawing.
+		bool start(GLFWwindow* windowIn);
+		//Draws whatever is pending, then gives the context back to the
+		//calling thread.
+		void stop();
+		bool running() { return thread.joinable(); }
+
+		//The packet the main thread is filling this frame.
+		RenderPacket& packet() { return packets[writeIndex]; }
+		//Hands packet() to the render thread. Blocks only while the
+		//previous frame is still being drawn.
+		void submit();
+};
+
+extern RenderThread renderThread;
+
+#endif
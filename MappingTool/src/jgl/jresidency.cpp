@@ -0,0 +1,140 @@
+#include "jresidency.h"
+#include "jmodule.h"
+#include <algorithm>
+#include <math.h>
+
+TextureResidency textureResidency;
+
+//Frames a texture can go unrequested before it falls back to its tail.
+static const unsigned int UNSEEN_FRAMES = 120;
+
+size_t TextureResidency::levelBytes(const Tracked& t, int level) const {
+	return texPackMipSize(t.entry->width, t.entry->height, t.entry->format, level);
+}
+
+size_t TextureResidency::rangeBytes(const Tracked& t, int top) const {
+	size_t total = 0;
+	for (int level = top; level < (int)t.entry->mipCount; level++)
+		total += levelBytes(t, level);
+	return total;
+}
+
+void TextureResidency::makeResident(Tracked& t, int top) {
+	if (top == t.residentTop)
+		return;
+
+	GLenum internalFormat, format;
+	textureFormat(t.entry->format, Texture::useSRGB, internalFormat, format);
+	glBindTexture(GL_TEXTURE_2D, t.texture->texture);
+	if (top < t.residentTop) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (int level = top; level < t.residentTop; level++) {
+			int w, h;
+			const unsigned char* data = texturePack.getMipData(t.entry, level, w, h);
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, data);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, top);
+	}
+	else {
+		//Clamp first so the texture never samples a level being dropped.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, top);
+		for (int level = t.residentTop; level < top; level++)
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	residentBytes -= t.residentBytes;
+	t.residentBytes = rangeBytes(t, top);
+	residentBytes += t.residentBytes;
+	t.residentTop = top;
+}
+
+int TextureResidency::track(Texture* t, const TexPackEntry* entry) {
+	Tracked tr;
+	tr.texture = t;
+	tr.entry = entry;
+	tr.tailTop = entry->mipCount - 1;
+	while (tr.tailTop > 0 && std::max(entry->width >> (tr.tailTop - 1), entry->height >> (tr.tailTop - 1)) <= (uint32_t)TAIL_SIZE)
+		tr.tailTop--;
+	tr.residentTop = entry->mipCount; //Nothing uploaded yet.
+	tr.wantedTop = tr.tailTop;
+	tr.residentBytes = 0;
+	tr.lastSeen = frame;
+
+	glBindTexture(GL_TEXTURE_2D, t->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry->mipCount - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	t->residencySlot = (int)tracked.size();
+	tracked.push_back(tr);
+	makeResident(tracked.back(), tr.tailTop);
+	return tr.tailTop;
+}
+
+void TextureResidency::request(Texture* t, float screenPixels) {
+	if (!t || t->residencySlot < 0)
+		return;
+	Tracked& tr = tracked[t->residencySlot];
+
+	int level = tr.tailTop;
+	if (screenPixels > 0.0f) {
+		float texels = (float)std::max(tr.entry->width, tr.entry->height);
+		level = std::clamp((int)floorf(log2f(texels / screenPixels)), 0, tr.tailTop);
+	}
+
+	//Several objects can share a texture; the closest one wins.
+	if (tr.lastSeen != frame || level < tr.wantedTop)
+		tr.wantedTop = level;
+	tr.lastSeen = frame;
+}
+
+void TextureResidency::update() {
+	std::vector<int> order;
+	size_t wantedBytes = 0;
+	for (int i = 0; i < (int)tracked.size(); i++) {
+		Tracked& t = tracked[i];
+		if (frame - t.lastSeen > UNSEEN_FRAMES)
+			t.wantedTop = t.tailTop;
+		wantedBytes += rangeBytes(t, t.wantedTop);
+		order.push_back(i);
+	}
+
+	//Over budget: take levels away from whatever has gone unseen the
+	//longest, and among those from the largest mips first.
+	if (wantedBytes > budgetBytes) {
+		std::sort(order.begin(), order.end(), [this](int a, int b) {
+			if (tracked[a].lastSeen != tracked[b].lastSeen)
+				return tracked[a].lastSeen < tracked[b].lastSeen;
+			return tracked[a].wantedTop < tracked[b].wantedTop;
+		});
+		for (int i : order) {
+			Tracked& t = tracked[i];
+			while (wantedBytes > budgetBytes && t.wantedTop < t.tailTop) {
+				wantedBytes -= levelBytes(t, t.wantedTop);
+				t.wantedTop++;
+			}
+			if (wantedBytes <= budgetBytes)
+				break;
+		}
+	}
+
+	//Evictions are free, do them all. Loads go one level at a time
+	//so a texture sharpens over a few frames instead of stalling one.
+	for (Tracked& t : tracked) {
+		if (t.wantedTop > t.residentTop)
+			makeResident(t, t.wantedTop);
+	}
+	size_t uploaded = 0;
+	for (Tracked& t : tracked) {
+		if (t.wantedTop >= t.residentTop)
+			continue;
+		size_t next = levelBytes(t, t.residentTop - 1);
+		if (uploaded > 0 && uploaded + next > uploadBytesPerFrame)
+			break;
+		makeResident(t, t.residentTop - 1);
+		uploaded += next;
+	}
+
+	frame++;
+}
@@ -0,0 +1,64 @@
+#ifndef JRESIDENCY_H
+#define JRESIDENCY_H
+
+#include <stddef.h>
+#include <vector>
+#include "jtexpack.h"
+
+struct Texture;
+
+/// <summary>
+/// TextureResidency. Decides how many of each texture's top
+/// (largest) mip levels are on the GPU. Culling reports how big
+/// every visible texture is on screen through request(), and
+/// update() then loads or drops levels so the total stays under
+/// the budget. Only textures from the texturePack are streamed,
+/// since their mips can be re-read from the mapping at any time.
+///
+/// Levels outside the resident range are kept out of sampling
+/// with GL_TEXTURE_BASE_LEVEL/GL_TEXTURE_MAX_LEVEL and their
+/// storage is released by respecifying them at size 0.
+/// </summary>
+class TextureResidency {
+	private:
+		struct Tracked {
+			Texture* texture;
+			const TexPackEntry* entry;
+			int residentTop;		//Finest mip currently on the GPU
+			int wantedTop;			//Finest mip culling asked for this frame
+			int tailTop;			//Coarse levels from here down never leave
+			size_t residentBytes;
+			unsigned int lastSeen;
+		};
+		std::vector<Tracked> tracked;
+		size_t budgetBytes = 256u << 20;
+		size_t uploadBytesPerFrame = 8u << 20;
+		size_t residentBytes = 0;
+		unsigned int frame = 0;
+
+		size_t levelBytes(const Tracked& t, int level) const;
+		size_t rangeBytes(const Tracked& t, int top) const;
+		void makeResident(Tracked& t, int top);
+	public:
+		static const int TAIL_SIZE = 64; //Mips this size or smaller are always resident.
+
+		void setBudget(size_t bytes) { budgetBytes = bytes; }
+		void setUploadLimit(size_t bytesPerFrame) { uploadBytesPerFrame = bytesPerFrame; }
+		size_t getResidentBytes() const { return residentBytes; }
+		size_t getBudget() const { return budgetBytes; }
+
+		//Starts managing a texture created from the pack. Uploads the
+		//always-resident tail and returns the base level it set.
+		int track(Texture* t, const TexPackEntry* entry);
+
+		//screenPixels is how many pixels the texture spans on screen
+		//along its longest axis, as estimated during culling.
+		void request(Texture* t, float screenPixels);
+
+		//Once per frame, after culling.
+		void update();
+};
+
+extern TextureResidency textureResidency;
+
+#endif
@@ -0,0 +1,453 @@
+#include "jselect.h"
+#include "jbvh.h"
+#include "jmodule.h"
+#include "joctree.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+//Lasso points closer together than this, in pixels, are merged.
+static const float LASSO_SPACING = 3.0f;
+static const int LASSO_BANDS = 64;
+
+#pragma region 2D:
+//> 0 if c is left of a->b.
+static inline float cross2(glm::vec2 a, glm::vec2 b, glm::vec2 c) {
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static inline bool segmentsCross(glm::vec2 a, glm::vec2 b, glm::vec2 c, glm::vec2 d) {
+	float d1 = cross2(c, d, a), d2 = cross2(c, d, b);
+	float d3 = cross2(a, b, c), d4 = cross2(a, b, d);
+	return ((d1 > 0.0f) != (d2 > 0.0f)) && ((d3 > 0.0f) != (d4 > 0.0f));
+}
+
+//Whether a ray from p towards +x crosses edge a->b.
+static inline bool crossesRight(glm::vec2 p, glm::vec2 a, glm::vec2 b) {
+	return (a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x;
+}
+
+//Even-odd rule, so it works for any simple or self-crossing outline.
+static bool pointInPolygon(glm::vec2 p, const glm::vec2* poly, int count) {
+	bool in = 0;
+	for (int i = 0, j = count - 1; i < count; j = i++) {
+		if (crossesRight(p, poly[j], poly[i]))
+			in = !in;
+	}
+	return in;
+}
+#pragma endregion
+
+#pragma region SelectionRegion:
+void SelectionRegion::setRect(const glm::mat4& VPIn, int widthIn, int heightIn, glm::vec2 a, glm::vec2 b) {
+	VP = VPIn;
+	width = (float)std::max(widthIn, 1);
+	height = (float)std::max(heightIn, 1);
+	//To GL window coordinates (bottom-left origin), at least a pixel wide.
+	float x0 = std::min(a.x, b.x), x1 = std::max(std::max(a.x, b.x), x0 + 1.0f);
+	float y0 = height - std::max(a.y, b.y), y1 = height - std::min(a.y, b.y);
+	y1 = std::max(y1, y0 + 1.0f);
+
+	//Stretch the rectangle over the whole of clip space; the frustum
+	//of that is the rectangle's sub-frustum.
+	glm::mat4 region(1.0f);
+	region[0][0] = width / (x1 - x0);
+	region[1][1] = height / (y1 - y0);
+	region[3][0] = (width - 2.0f * x0) / (x1 - x0) - 1.0f;
+	region[3][1] = (height - 2.0f * y0) / (y1 - y0) - 1.0f;
+	frustumPlanes(region * VP, planes);
+}
+
+void SelectionRegion::setBox(const glm::mat4& VPIn, int widthIn, int heightIn, glm::vec2 a, glm::vec2 b) {
+	lasso.clear();
+	setRect(VPIn, widthIn, heightIn, a, b);
+}
+
+void SelectionRegion::setLasso(const glm::mat4& VPIn, int widthIn, int heightIn, const std::vector<glm::vec2>& points) {
+	lasso.clear();
+	for (glm::vec2 p : points) {
+		if (lasso.empty() || glm::length(p - lasso.back()) >= LASSO_SPACING)
+			lasso.push_back(p);
+	}
+	if (lasso.size() < 3) {
+		//Nothing with an inside; select nothing rather than everything.
+		glm::vec2 p = points.empty() ? glm::vec2(0.0f) : points[0];
+		lasso.assign(3, p);
+	}
+	lassoMin = lassoMax = lasso[0];
+	for (glm::vec2 p : lasso) {
+		lassoMin = glm::min(lassoMin, p);
+		lassoMax = glm::max(lassoMax, p);
+	}
+	setRect(VPIn, widthIn, heightIn, lassoMin, lassoMax);
+
+	//Counting pass, then filling, so the bands share one array.
+	uint32_t n = (uint32_t)lasso.size();
+	bandScale = LASSO_BANDS / std::max(lassoMax.y - lassoMin.y, 1.0f);
+	bandStart.assign(LASSO_BANDS + 1, 0);
+	for (uint32_t i = 0; i < n; i++) {
+		glm::vec2 a = lasso[i], b = lasso[(i + 1) % n];
+		for (int k = bandOf(std::min(a.y, b.y)); k <= bandOf(std::max(a.y, b.y)); k++)
+			bandStart[k + 1]++;
+	}
+	for (int k = 0; k < LASSO_BANDS; k++)
+		bandStart[k + 1] += bandStart[k];
+	bandEdges.resize(bandStart[LASSO_BANDS]);
+	std::vector<uint32_t> fill(bandStart.begin(), bandStart.end() - 1);
+	for (uint32_t i = 0; i < n; i++) {
+		glm::vec2 a = lasso[i], b = lasso[(i + 1) % n];
+		for (int k = bandOf(std::min(a.y, b.y)); k <= bandOf(std::max(a.y, b.y)); k++)
+			bandEdges[fill[k]++] = i;
+	}
+}
+
+int SelectionRegion::bandOf(float y) const {
+	return std::clamp((int)((y - lassoMin.y) * bandScale), 0, LASSO_BANDS - 1);
+}
+
+glm::vec2 SelectionRegion::toWindow(glm::vec3 p) const {
+	glm::vec4 clip = VP * glm::vec4(p, 1.0f);
+	glm::vec2 ndc = glm::vec2(clip) / clip.w;
+	return glm::vec2((ndc.x + 1.0f) * 0.5f * width, (1.0f - ndc.y) * 0.5f * height);
+}
+
+bool SelectionRegion::inLasso(glm::vec2 p) const {
+	if (p.x < lassoMin.x || p.y < lassoMin.y || p.x > lassoMax.x || p.y > lassoMax.y)
+		return 0;
+	//Only edges spanning p.y can cross the ray, and they are all in
+	//p's band, once each.
+	int k = bandOf(p.y);
+	uint32_t n = (uint32_t)lasso.size();
+	bool in = 0;
+	for (uint32_t e = bandStart[k]; e < bandStart[k + 1]; e++) {
+		uint32_t i = bandEdges[e];
+		if (crossesRight(p, lasso[i], lasso[(i + 1) % n]))
+			in = !in;
+	}
+	return in;
+}
+
+int SelectionRegion::lassoOverlap(const glm::vec2* poly, int count) const {
+	glm::vec2 pMin = poly[0], pMax = poly[0];
+	for (int i = 1; i < count; i++) {
+		pMin = glm::min(pMin, poly[i]);
+		pMax = glm::max(pMax, poly[i]);
+	}
+	if (pMax.x < lassoMin.x || pMax.y < lassoMin.y || pMin.x > lassoMax.x || pMin.y > lassoMax.y)
+		return 0;
+	//Outlines that cross overlap. If they don't, one is inside the
+	//other or they are apart, which one point of each tells.
+	//An edge spanning several bands is tried once per band; that
+	//costs less than keeping track.
+	uint32_t n = (uint32_t)lasso.size();
+	for (uint32_t e = bandStart[bandOf(pMin.y)]; e < bandStart[bandOf(pMax.y) + 1]; e++) {
+		uint32_t i = bandEdges[e];
+		glm::vec2 a = lasso[i], b = lasso[(i + 1) % n];
+		if (std::max(a.x, b.x) < pMin.x || std::min(a.x, b.x) > pMax.x || std::max(a.y, b.y) < pMin.y || std::min(a.y, b.y) > pMax.y)
+			continue;
+		for (int k = 0, l = count - 1; k < count; l = k++) {
+			if (segmentsCross(a, b, poly[l], poly[k]))
+				return 1;
+		}
+	}
+	if (inLasso(poly[0]))
+		return 2;
+	return pointInPolygon(lasso[0], poly, count) ? 1 : 0;
+}
+
+bool SelectionRegion::contains(glm::vec3 p) const {
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.0f)
+			return 0;
+	}
+	return !isLasso() || inLasso(toWindow(p));
+}
+
+int SelectionRegion::testBox(glm::vec3 bMin, glm::vec3 bMax, const glm::mat4& m) const {
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 c((i & 1) ? bMax.x : bMin.x, (i & 2) ? bMax.y : bMin.y, (i & 4) ? bMax.z : bMin.z);
+		corners[i] = glm::vec3(m * glm::vec4(c, 1.0f));
+	}
+	bool straddles = 0;
+	for (int p = 0; p < 6; p++) {
+		glm::vec3 n(planes[p]);
+		int in = 0;
+		for (int i = 0; i < 8; i++)
+			in += glm::dot(n, corners[i]) + planes[p].w >= 0.0f;
+		if (in == 0)
+			return 0;
+		straddles |= in < 8;
+	}
+	//Corners behind the camera don't project, so a box across the
+	//sub-frustum's sides waits for its children.
+	if (straddles)
+		return 1;
+	if (!isLasso())
+		return 2;
+	glm::vec2 sMin(FLT_MAX), sMax(-FLT_MAX);
+	for (int i = 0; i < 8; i++) {
+		glm::vec2 s = toWindow(corners[i]);
+		sMin = glm::min(sMin, s);
+		sMax = glm::max(sMax, s);
+	}
+	glm::vec2 rect[4] = { sMin, glm::vec2(sMax.x, sMin.y), sMax, glm::vec2(sMin.x, sMax.y) };
+	return lassoOverlap(rect, 4);
+}
+
+int SelectionRegion::testSphere(glm::vec3 center, float radius) const {
+	bool straddles = 0;
+	for (int p = 0; p < 6; p++) {
+		float d = glm::dot(glm::vec3(planes[p]), center) + planes[p].w;
+		if (d < -radius)
+			return 0;
+		straddles |= d < radius;
+	}
+	if (straddles)
+		return 1;
+	//The sphere's box settles it both ways when it is clear-cut.
+	return isLasso() ? testBox(center - radius, center + radius) : 2;
+}
+
+bool SelectionRegion::triangleInside(glm::vec3 a, glm::vec3 b, glm::vec3 c) const {
+	glm::vec3 v[3] = { a, b, c };
+	for (int p = 0; p < 6; p++) {
+		glm::vec3 n(planes[p]);
+		for (int i = 0; i < 3; i++) {
+			if (glm::dot(n, v[i]) + planes[p].w < 0.0f)
+				return 0;
+		}
+	}
+	if (!isLasso())
+		return 1;
+	//A concave lasso can cut an edge between two points inside it.
+	glm::vec2 s[3] = { toWindow(a), toWindow(b), toWindow(c) };
+	return lassoOverlap(s, 3) == 2;
+}
+
+bool SelectionRegion::triangleTouches(glm::vec3 a, glm::vec3 b, glm::vec3 c) const {
+	//Clip to the sub-frustum; each plane adds at most one point.
+	glm::vec3 bufA[9], bufB[9];
+	glm::vec3* in = bufA;
+	glm::vec3* out = bufB;
+	in[0] = a;
+	in[1] = b;
+	in[2] = c;
+	int count = 3;
+	for (int p = 0; p < 6 && count > 0; p++) {
+		glm::vec3 n(planes[p]);
+		int kept = 0;
+		for (int i = 0; i < count; i++) {
+			glm::vec3 cur = in[i], prev = in[(i + count - 1) % count];
+			float dc = glm::dot(n, cur) + planes[p].w, dp = glm::dot(n, prev) + planes[p].w;
+			if ((dc >= 0.0f) != (dp >= 0.0f))
+				out[kept++] = prev + (cur - prev) * (dp / (dp - dc));
+			if (dc >= 0.0f)
+				out[kept++] = cur;
+		}
+		std::swap(in, out);
+		count = kept;
+	}
+	if (count == 0)
+		return 0;
+	if (!isLasso())
+		return 1;
+	glm::vec2 s[9];
+	for (int i = 0; i < count; i++)
+		s[i] = toWindow(in[i]);
+	return lassoOverlap(s, count) != 0;
+}
+#pragma endregion
+
+#pragma region Selection:
+//Whether tree, placed by m, is touching or inside region, a box at a
+//time: a box wholly in or out settles everything under it.
+static bool treeSelected(const TriangleBVH& tree, const glm::mat4& m, const SelectionRegion& region, SelectMode mode) {
+	uint32_t stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const BVHNode& n = tree.nodes[stack[--top]];
+		int r = region.testBox(n.bMin, n.bMax, m);
+		if (mode == SELECT_TOUCHING) {
+			if (r == 0)
+				continue;
+			if (r == 2)
+				return 1;
+		}
+		else {
+			if (r == 2)
+				continue;
+			if (r == 0)
+				return 0;
+		}
+		if (!n.count) {
+			stack[top++] = n.first;
+			stack[top++] = n.first + 1;
+			continue;
+		}
+		const TrianglePacket8& p = tree.packets[n.first];
+		for (uint32_t lane = 0; lane < n.count; lane++) {
+			glm::vec3 v0(p.v0[0][lane], p.v0[1][lane], p.v0[2][lane]);
+			glm::vec3 v1 = v0 + glm::vec3(p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]);
+			glm::vec3 v2 = v0 + glm::vec3(p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]);
+			glm::vec3 a = glm::vec3(m * glm::vec4(v0, 1.0f));
+			glm::vec3 b = glm::vec3(m * glm::vec4(v1, 1.0f));
+			glm::vec3 c = glm::vec3(m * glm::vec4(v2, 1.0f));
+			if (mode == SELECT_TOUCHING && region.triangleTouches(a, b, c))
+				return 1;
+			if (mode == SELECT_INSIDE && !region.triangleInside(a, b, c))
+				return 0;
+		}
+	}
+	return mode == SELECT_INSIDE;
+}
+
+//For an object whose bounding sphere is partly in the region.
+static bool objectSelected(EntityStore& store, const ScenePicker& picker, const SelectionRegion& region, SelectMode mode, Entity e) {
+	int trees = 0;
+	if (store.models.has(e) && store.transforms.has(e)) {
+		uint32_t i = store.models.indexOf(e);
+		const glm::mat4& m = store.transforms.world[store.transforms.indexOf(e)];
+		for (uint32_t k = 0; k < store.models.meshCount[i]; k++) {
+			const TriangleBVH* tree = picker.meshTree(store.meshList[store.models.firstMesh[i] + k]);
+			if (!tree || !tree->nodeCount)
+				continue;
+			trees++;
+			bool selected = treeSelected(*tree, m, region, mode);
+			if (mode == SELECT_TOUCHING && selected)
+				return 1;
+			if (mode == SELECT_INSIDE && !selected)
+				return 0;
+		}
+	}
+	//No triangles to go by: the sphere touches, but isn't inside.
+	if (!trees)
+		return mode == SELECT_TOUCHING;
+	return mode == SELECT_INSIDE;
+}
+
+void selectRegion(EntityStore& store, const ScenePicker& picker, const SelectionRegion& region, SelectMode mode, LayerMask layers, std::vector<Entity>& out) {
+	std::vector<Entity> partial;
+	store.octree.queryRegion([&region](glm::vec3 bMin, glm::vec3 bMax) { return region.testBox(bMin, bMax); },
+		[&region](glm::vec3 center, float radius) { return region.testSphere(center, radius); }, out, partial, layers);
+	for (Entity e : partial) {
+		if (objectSelected(store, picker, region, mode, e))
+			out.push_back(e);
+	}
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//Every triangle of e, for checking selectRegion against.
+static bool bruteSelected(EntityStore& store, const ScenePicker& picker, const SelectionRegion& region, SelectMode mode, Entity e) {
+	uint32_t i = store.models.indexOf(e);
+	const glm::mat4& m = store.transforms.world[store.transforms.indexOf(e)];
+	const TriangleBVH* tree = picker.meshTree(store.meshList[store.models.firstMesh[i]]);
+	for (uint32_t k = 0; k < tree->packetCount * PACKET_WIDTH; k++) {
+		if (tree->triIds[k] == UINT32_MAX)
+			continue;
+		const TrianglePacket8& p = tree->packets[k / PACKET_WIDTH];
+		int lane = k % PACKET_WIDTH;
+		glm::vec3 v0(p.v0[0][lane], p.v0[1][lane], p.v0[2][lane]);
+		glm::vec3 a = glm::vec3(m * glm::vec4(v0, 1.0f));
+		glm::vec3 b = glm::vec3(m * glm::vec4(v0 + glm::vec3(p.e1[0][lane], p.e1[1][lane], p.e1[2][lane]), 1.0f));
+		glm::vec3 c = glm::vec3(m * glm::vec4(v0 + glm::vec3(p.e2[0][lane], p.e2[1][lane], p.e2[2][lane]), 1.0f));
+		if (mode == SELECT_TOUCHING && region.triangleTouches(a, b, c))
+			return 1;
+		if (mode == SELECT_INSIDE && !region.triangleInside(a, b, c))
+			return 0;
+	}
+	return mode == SELECT_INSIDE;
+}
+
+void selectionBenchmark() {
+	const int SIDE = 224, WIDTH = 1024, HEIGHT = 768, CHECK_EVERY = 97;
+	const float SPACING = 10.0f;
+	ArenaMark mark = mapArena.mark();
+
+	//One small terrain patch (98 triangles), placed about 50k times.
+	aiMesh* source = makeTestTerrain(8, 0.3f);
+	Mesh* mesh = mapArena.create<Mesh>(source);
+	delete source;
+	MeshHandle handle = meshHandles.insert(mesh);
+
+	EntityStore store;
+	ScenePicker picker;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Entity> entities;
+	for (int z = 0; z < SIDE; z++) {
+		for (int x = 0; x < SIDE; x++) {
+			Entity e = store.create();
+			glm::vec3 at(x * SPACING + unit(rng) * 3.0f, unit(rng) * 20.0f, z * SPACING + unit(rng) * 3.0f);
+			glm::mat4 m = glm::translate(glm::mat4(1.0f), at);
+			m = glm::rotate(m, unit(rng) * 6.28f, glm::vec3(0.0f, 1.0f, 0.0f));
+			m = glm::scale(m, glm::vec3(0.5f + unit(rng)));
+			store.transforms.add(e, m);
+			store.bounds.add(e, mesh->getBoundsMin(), mesh->getBoundsMax());
+			store.addMeshes(e, &handle, 1);
+			entities.push_back(e);
+		}
+	}
+	store.transforms.update();
+	boundsSystem(store);
+	picker.update(store);
+
+	//Looking down at the whole field from above one edge.
+	float extent = SIDE * SPACING;
+	glm::vec3 target(extent * 0.5f, 0.0f, extent * 0.5f);
+	glm::vec3 eye = target + glm::vec3(0.0f, extent * 0.9f, -extent * 0.6f);
+	glm::mat4 VP = glm::perspective(glm::radians(45.0f), (float)WIDTH / HEIGHT, 1.0f, extent * 4.0f) * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	struct Drag { const char* name; SelectionRegion region; };
+	std::vector<Drag> drags(3);
+	drags[0].name = "big box";
+	drags[0].region.setBox(VP, WIDTH, HEIGHT, glm::vec2(60.0f, 40.0f), glm::vec2(980.0f, 730.0f));
+	drags[1].name = "small box";
+	drags[1].region.setBox(VP, WIDTH, HEIGHT, glm::vec2(480.0f, 360.0f), glm::vec2(560.0f, 420.0f));
+	//A five-pointed star, as a concave lasso, sampled the way a mouse would.
+	std::vector<glm::vec2> star;
+	for (int i = 0; i < 200; i++) {
+		float a = i * 6.2832f / 200.0f;
+		float r = 330.0f * (0.6f + 0.4f * cosf(5.0f * a));
+		star.push_back(glm::vec2(512.0f + r * sinf(a), 384.0f - r * cosf(a)));
+	}
+	drags[2].name = "star lasso";
+	drags[2].region.setLasso(VP, WIDTH, HEIGHT, star);
+
+	int mismatches = 0;
+	std::vector<Entity> selected;
+	for (Drag& d : drags) {
+		for (int mode = SELECT_TOUCHING; mode <= SELECT_INSIDE; mode++) {
+			selected.clear();
+			auto start = std::chrono::high_resolution_clock::now();
+			selectRegion(store, picker, d.region, (SelectMode)mode, LAYER_ALL, selected);
+			double ms = msSince(start);
+			std::cout << "SELECT: " << d.name << (mode == SELECT_TOUCHING ? ", touching: " : ", inside: ") << selected.size()
+				<< " of " << entities.size() << " in " << ms << " ms\n";
+
+			std::sort(selected.begin(), selected.end());
+			for (size_t i = 0; i < entities.size(); i += CHECK_EVERY) {
+				bool brute = bruteSelected(store, picker, d.region, (SelectMode)mode, entities[i]);
+				mismatches += brute != std::binary_search(selected.begin(), selected.end(), entities[i]);
+			}
+		}
+	}
+	if (mismatches)
+		std::cout << "SELECT: " << mismatches << " sampled objects disagree with testing every triangle!\n";
+
+	meshHandles.remove(handle);
+	picker.clear();
+	mapArena.rewind(mark);
+}
+#pragma endregion
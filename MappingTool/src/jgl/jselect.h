@@ -0,0 +1,76 @@
+#ifndef JSELECT_H
+#define JSELECT_H
+
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "jecs.h"
+
+///
+/// Drag selection. A box drag is the sub-frustum behind the screen
+/// rectangle. A lasso is the sub-frustum behind the lasso's bounding
+/// rectangle, with points then also checked against the polygon on
+/// screen, which makes it a prism of any shape.
+///
+/// The region is tested against the octree first; whole nodes are
+/// accepted or rejected at once, so only objects on the region's edge
+/// go on to the second step. There, their triangle trees are walked
+/// the same way (a box at a time) down to the triangles.
+///
+
+class ScenePicker;
+
+enum SelectMode {
+	SELECT_TOUCHING,	//Any part of the object is in the region
+	SELECT_INSIDE		//All of it is
+};
+
+/// <summary>
+/// SelectionRegion. What a drag covers, in world space. Window
+/// coordinates are pixels from the top-left, as GLFW gives them.
+/// The tests return 0 outside, 1 partly inside and 2 inside.
+/// </summary>
+class SelectionRegion {
+	private:
+		glm::vec4 planes[6];			//Inwards, as frustumPlanes() makes them
+		std::vector<glm::vec2> lasso;	//Window pixels; empty for a box
+		glm::vec2 lassoMin, lassoMax;
+		//Lasso edges (i to i + 1) by horizontal band, so a test only
+		//looks at the edges level with it.
+		std::vector<uint32_t> bandStart, bandEdges;
+		float bandScale = 0.0f;
+		glm::mat4 VP = glm::mat4(1.0f);
+		float width = 1.0f, height = 1.0f;
+
+		void setRect(const glm::mat4& VPIn, int widthIn, int heightIn, glm::vec2 a, glm::vec2 b);
+		glm::vec2 toWindow(glm::vec3 p) const;
+		int bandOf(float y) const;
+		bool inLasso(glm::vec2 p) const;
+		//Lasso against a screen polygon: 0 apart, 1 overlapping,
+		//2 the polygon is inside the lasso.
+		int lassoOverlap(const glm::vec2* poly, int count) const;
+	public:
+		void setBox(const glm::mat4& VPIn, int widthIn, int heightIn, glm::vec2 a, glm::vec2 b);
+		//points is the lasso's outline, closed back to the first point.
+		void setLasso(const glm::mat4& VPIn, int widthIn, int heightIn, const std::vector<glm::vec2>& points);
+		bool isLasso() const { return !lasso.empty(); }
+
+		bool contains(glm::vec3 p) const;
+		//The box spanned by corners, each put through m first.
+		int testBox(glm::vec3 bMin, glm::vec3 bMax, const glm::mat4& m = glm::mat4(1.0f)) const;
+		int testSphere(glm::vec3 center, float radius) const;
+		bool triangleInside(glm::vec3 a, glm::vec3 b, glm::vec3 c) const;
+		bool triangleTouches(glm::vec3 a, glm::vec3 b, glm::vec3 c) const;
+};
+
+//Appends the entities on a visible layer that region selects. Objects
+//without a triangle tree in picker are judged by their bounding sphere.
+void selectRegion(EntityStore& store, const ScenePicker& picker, const SelectionRegion& region, SelectMode mode, LayerMask layers, std::vector<Entity>& out);
+
+//Drags boxes and lassos over 50k objects and checks a sample of the
+//results against testing every triangle.
+void selectionBenchmark();
+
+#endif
@@ -0,0 +1,298 @@
+#include "jsimd.h"
+#include <algorithm>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define JGL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//MSVC lets any function use any intrinsic; GCC and Clang want to be
+//told which functions may use instructions beyond the build's target.
+#if defined(JGL_X86) && !defined(_MSC_VER)
+#define JGL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define JGL_TARGET(isa)
+#endif
+
+static const float DET_EPSILON = 1e-12f;
+
+void TrianglePacket8::set(int lane, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+	for (int k = 0; k < 3; k++) {
+		v0[k][lane] = a[k];
+		e1[k][lane] = b[k] - a[k];
+		e2[k][lane] = c[k] - a[k];
+	}
+}
+
+void BoxPacket8::set(int lane, glm::vec3 lo, glm::vec3 hi) {
+	for (int k = 0; k < 3; k++) {
+		bMin[k][lane] = lo[k];
+		bMax[k][lane] = hi[k];
+	}
+}
+
+static inline uint32_t laneMask(int count) {
+	return count >= PACKET_WIDTH ? (1u << PACKET_WIDTH) - 1 : (1u << count) - 1;
+}
+
+//Keeps the nearest of the lanes in mask, given their t, u and v.
+static inline int closestLane(uint32_t mask, int laneOffset, const float* t, const float* u, const float* v, int lane, float& bestT, float& bestU, float& bestV) {
+	for (int i = 0; mask; i++, mask >>= 1) {
+		if ((mask & 1) && t[i] < bestT) {
+			bestT = t[i];
+			bestU = u[i];
+			bestV = v[i];
+			lane = laneOffset + i;
+		}
+	}
+	return lane;
+}
+
+#pragma region Scalar:
+//Moller-Trumbore, lane by lane.
+static int rayTriangles8Scalar(const TrianglePacket8& p, int count, const KernelRay& ray, float maxT, float& t, float& u, float& v) {
+	int lane = -1;
+	float bestT = maxT;
+	for (int i = 0; i < std::min(count, PACKET_WIDTH); i++) {
+		glm::vec3 e1(p.e1[0][i], p.e1[1][i], p.e1[2][i]);
+		glm::vec3 e2(p.e2[0][i], p.e2[1][i], p.e2[2][i]);
+		glm::vec3 pv(ray.dir.y * e2.z - ray.dir.z * e2.y, ray.dir.z * e2.x - ray.dir.x * e2.z, ray.dir.x * e2.y - ray.dir.y * e2.x);
+		float det = e1.x * pv.x + e1.y * pv.y + e1.z * pv.z;
+		if (fabsf(det) < DET_EPSILON)
+			continue;
+		float invDet = 1.0f / det;
+		glm::vec3 s = ray.origin - glm::vec3(p.v0[0][i], p.v0[1][i], p.v0[2][i]);
+		float lu = (s.x * pv.x + s.y * pv.y + s.z * pv.z) * invDet;
+		if (lu < 0.0f || lu > 1.0f)
+			continue;
+		glm::vec3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+		float lv = (ray.dir.x * q.x + ray.dir.y * q.y + ray.dir.z * q.z) * invDet;
+		if (lv < 0.0f || lu + lv > 1.0f)
+			continue;
+		float lt = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * invDet;
+		if (lt > 0.0f && lt < bestT) {
+			bestT = lt;
+			u = lu;
+			v = lv;
+			lane = i;
+		}
+	}
+	if (lane >= 0)
+		t = bestT;
+	return lane;
+}
+
+static uint32_t rayBoxes8Scalar(const BoxPacket8& p, int count, const KernelRay& ray, float maxT, float* tEnter) {
+	uint32_t mask = 0;
+	for (int i = 0; i < std::min(count, PACKET_WIDTH); i++) {
+		float enter = 0.0f, exit = maxT;
+		for (int k = 0; k < 3; k++) {
+			float t0 = (p.bMin[k][i] - ray.origin[k]) * ray.invDir[k];
+			float t1 = (p.bMax[k][i] - ray.origin[k]) * ray.invDir[k];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		tEnter[i] = enter;
+		if (enter <= exit)
+			mask |= 1u << i;
+	}
+	return mask;
+}
+#pragma endregion
+
+#ifdef JGL_X86
+#pragma region SSE2:
+//The packet in two 4-lane halves.
+static JGL_TARGET("sse2") int rayTriangles8SSE2(const TrianglePacket8& p, int count, const KernelRay& ray, float maxT, float& t, float& u, float& v) {
+	const __m128 dx = _mm_set1_ps(ray.dir.x), dy = _mm_set1_ps(ray.dir.y), dz = _mm_set1_ps(ray.dir.z);
+	const __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), eps = _mm_set1_ps(DET_EPSILON);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	int lane = -1;
+	float bestT = maxT;
+	for (int h = 0; h < count && h < PACKET_WIDTH; h += 4) {
+		__m128 e1x = _mm_load_ps(&p.e1[0][h]), e1y = _mm_load_ps(&p.e1[1][h]), e1z = _mm_load_ps(&p.e1[2][h]);
+		__m128 e2x = _mm_load_ps(&p.e2[0][h]), e2y = _mm_load_ps(&p.e2[1][h]), e2z = _mm_load_ps(&p.e2[2][h]);
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 ok = _mm_cmpge_ps(_mm_and_ps(det, absMask), eps);
+		if (!(_mm_movemask_ps(ok) & laneMask(count - h)))
+			continue;
+		__m128 invDet = _mm_div_ps(one, det);
+		__m128 sx = _mm_sub_ps(ox, _mm_load_ps(&p.v0[0][h]));
+		__m128 sy = _mm_sub_ps(oy, _mm_load_ps(&p.v0[1][h]));
+		__m128 sz = _mm_sub_ps(oz, _mm_load_ps(&p.v0[2][h]));
+		__m128 lu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		__m128 lv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+		__m128 lt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+		ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(lu, zero), _mm_cmple_ps(lu, one)));
+		ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(lv, zero), _mm_cmple_ps(_mm_add_ps(lu, lv), one)));
+		ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpgt_ps(lt, zero), _mm_cmplt_ps(lt, _mm_set1_ps(bestT))));
+		uint32_t mask = _mm_movemask_ps(ok) & laneMask(count - h);
+		if (!mask)
+			continue;
+		alignas(16) float ts[4], us[4], vs[4];
+		_mm_store_ps(ts, lt);
+		_mm_store_ps(us, lu);
+		_mm_store_ps(vs, lv);
+		lane = closestLane(mask, h, ts, us, vs, lane, bestT, u, v);
+	}
+	if (lane >= 0)
+		t = bestT;
+	return lane;
+}
+
+static JGL_TARGET("sse2") uint32_t rayBoxes8SSE2(const BoxPacket8& p, int count, const KernelRay& ray, float maxT, float* tEnter) {
+	const __m128 o[3] = { _mm_set1_ps(ray.origin.x), _mm_set1_ps(ray.origin.y), _mm_set1_ps(ray.origin.z) };
+	const __m128 inv[3] = { _mm_set1_ps(ray.invDir.x), _mm_set1_ps(ray.invDir.y), _mm_set1_ps(ray.invDir.z) };
+	uint32_t mask = 0;
+	for (int h = 0; h < count && h < PACKET_WIDTH; h += 4) {
+		__m128 enter = _mm_setzero_ps(), exit = _mm_set1_ps(maxT);
+		for (int k = 0; k < 3; k++) {
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&p.bMin[k][h]), o[k]), inv[k]);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&p.bMax[k][h]), o[k]), inv[k]);
+			enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+			exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+		}
+		_mm_storeu_ps(tEnter + h, enter);
+		mask |= (_mm_movemask_ps(_mm_cmple_ps(enter, exit)) & laneMask(count - h)) << h;
+	}
+	return mask;
+}
+#pragma endregion
+
+#pragma region AVX2:
+//All 8 lanes at once, with fused multiply-adds for the dot and cross
+//products.
+static JGL_TARGET("avx2,fma") int rayTriangles8AVX2(const TrianglePacket8& p, int count, const KernelRay& ray, float maxT, float& t, float& u, float& v) {
+	const __m256 dx = _mm256_set1_ps(ray.dir.x), dy = _mm256_set1_ps(ray.dir.y), dz = _mm256_set1_ps(ray.dir.z);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 e1x = _mm256_load_ps(p.e1[0]), e1y = _mm256_load_ps(p.e1[1]), e1z = _mm256_load_ps(p.e1[2]);
+	__m256 e2x = _mm256_load_ps(p.e2[0]), e2y = _mm256_load_ps(p.e2[1]), e2z = _mm256_load_ps(p.e2[2]);
+	__m256 px = _mm256_fmsub_ps(dy, e2z, _mm256_mul_ps(dz, e2y));
+	__m256 py = _mm256_fmsub_ps(dz, e2x, _mm256_mul_ps(dx, e2z));
+	__m256 pz = _mm256_fmsub_ps(dx, e2y, _mm256_mul_ps(dy, e2x));
+	__m256 det = _mm256_fmadd_ps(e1x, px, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1z, pz)));
+	__m256 ok = _mm256_cmp_ps(_mm256_and_ps(det, absMask), _mm256_set1_ps(DET_EPSILON), _CMP_GE_OQ);
+	if (!(_mm256_movemask_ps(ok) & laneMask(count)))
+		return -1;
+	__m256 invDet = _mm256_div_ps(one, det);
+	__m256 sx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(p.v0[0]));
+	__m256 sy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(p.v0[1]));
+	__m256 sz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(p.v0[2]));
+	__m256 lu = _mm256_mul_ps(_mm256_fmadd_ps(sx, px, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sz, pz))), invDet);
+	__m256 qx = _mm256_fmsub_ps(sy, e1z, _mm256_mul_ps(sz, e1y));
+	__m256 qy = _mm256_fmsub_ps(sz, e1x, _mm256_mul_ps(sx, e1z));
+	__m256 qz = _mm256_fmsub_ps(sx, e1y, _mm256_mul_ps(sy, e1x));
+	__m256 lv = _mm256_mul_ps(_mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz))), invDet);
+	__m256 lt = _mm256_mul_ps(_mm256_fmadd_ps(e2x, qx, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2z, qz))), invDet);
+	ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(lu, zero, _CMP_GE_OQ), _mm256_cmp_ps(lu, one, _CMP_LE_OQ)));
+	ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(lv, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(lu, lv), one, _CMP_LE_OQ)));
+	ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(lt, zero, _CMP_GT_OQ), _mm256_cmp_ps(lt, _mm256_set1_ps(maxT), _CMP_LT_OQ)));
+	uint32_t mask = _mm256_movemask_ps(ok) & laneMask(count);
+	if (!mask)
+		return -1;
+	alignas(32) float ts[8], us[8], vs[8];
+	_mm256_store_ps(ts, lt);
+	_mm256_store_ps(us, lu);
+	_mm256_store_ps(vs, lv);
+	float bestT = maxT;
+	int lane = closestLane(mask, 0, ts, us, vs, -1, bestT, u, v);
+	t = bestT;
+	return lane;
+}
+
+static JGL_TARGET("avx2,fma") uint32_t rayBoxes8AVX2(const BoxPacket8& p, int count, const KernelRay& ray, float maxT, float* tEnter) {
+	const float* o = &ray.origin.x;
+	const float* inv = &ray.invDir.x;
+	__m256 enter = _mm256_setzero_ps(), exit = _mm256_set1_ps(maxT);
+	for (int k = 0; k < 3; k++) {
+		//Not b * inv - o * inv: along an axis the ray is parallel to, inv
+		//is infinite and that is inf - inf.
+		__m256 vo = _mm256_set1_ps(o[k]), vi = _mm256_set1_ps(inv[k]);
+		__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(p.bMin[k]), vo), vi);
+		__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(p.bMax[k]), vo), vi);
+		enter = _mm256_max_ps(enter, _mm256_min_ps(t0, t1));
+		exit = _mm256_min_ps(exit, _mm256_max_ps(t0, t1));
+	}
+	_mm256_storeu_ps(tEnter, enter);
+	return _mm256_movemask_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ)) & laneMask(count);
+}
+#pragma endregion
+#endif
+
+#pragma region Dispatch:
+static const RayKernels kernelTable[] = {
+	{ "scalar", SIMD_SCALAR, rayTriangles8Scalar, rayBoxes8Scalar },
+#ifdef JGL_X86
+	{ "SSE2", SIMD_SSE2, rayTriangles8SSE2, rayBoxes8SSE2 },
+	{ "AVX2", SIMD_AVX2, rayTriangles8AVX2, rayBoxes8AVX2 },
+#endif
+};
+static const int KERNEL_LEVELS = sizeof(kernelTable) / sizeof(kernelTable[0]);
+
+#ifdef JGL_X86
+static void cpuid(int out[4], int leaf) {
+#ifdef _MSC_VER
+	__cpuidex(out, leaf, 0);
+#else
+	__cpuid_count(leaf, 0, out[0], out[1], out[2], out[3]);
+#endif
+}
+
+//Which register sets the OS saves on a context switch.
+static uint64_t osSavedState() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+#endif
+
+SimdLevel detectSimdLevel() {
+#ifdef JGL_X86
+	int r[4];
+	cpuid(r, 0);
+	int maxLeaf = r[0];
+	cpuid(r, 1);
+	bool sse2 = (r[3] >> 26) & 1;
+	bool fma = (r[2] >> 12) & 1;
+	bool osxsave = (r[2] >> 27) & 1;
+	bool avx = (r[2] >> 28) & 1;
+	if (!sse2)
+		return SIMD_SCALAR;
+	//AVX registers are only usable if the OS saves them (XMM and YMM
+	//state bits of XCR0).
+	if (avx && fma && osxsave && (osSavedState() & 6) == 6 && maxLeaf >= 7) {
+		cpuid(r, 7);
+		if ((r[1] >> 5) & 1)
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+const RayKernels& rayKernelsFor(SimdLevel level) {
+	int i = std::min((int)level, KERNEL_LEVELS - 1);
+	return kernelTable[i];
+}
+
+const RayKernels* rayKernels = &rayKernelsFor(detectSimdLevel());
+#pragma endregion
@@ -0,0 +1,74 @@
+#ifndef JSIMD_H
+#define JSIMD_H
+
+#include <stdint.h>
+#include <glm/vec3.hpp>
+
+///
+/// 8-wide ray kernels: one ray against 8 triangles or 8 boxes at a
+/// time. The data is laid out structure-of-arrays, one float per lane,
+/// so a packet is exactly a BVH leaf of up to 8 triangles or the
+/// child boxes of an 8-wide BVH node.
+///
+/// There are scalar, SSE2 (two 4-lane halves) and AVX2 versions.
+/// rayKernels is set at startup to the best one the CPU and OS allow,
+/// and the others stay reachable for comparison.
+///
+
+const int PACKET_WIDTH = 8;
+
+//Triangles as v0 and the edges v1 - v0 and v2 - v0. Unused lanes
+//should be zero, which no ray hits.
+struct alignas(32) TrianglePacket8 {
+	float v0[3][PACKET_WIDTH];
+	float e1[3][PACKET_WIDTH];
+	float e2[3][PACKET_WIDTH];
+
+	void set(int lane, glm::vec3 a, glm::vec3 b, glm::vec3 c);
+};
+
+//Boxes, e.g. the children of a wide BVH node.
+struct alignas(32) BoxPacket8 {
+	float bMin[3][PACKET_WIDTH];
+	float bMax[3][PACKET_WIDTH];
+
+	void set(int lane, glm::vec3 lo, glm::vec3 hi);
+};
+
+//A ray with what the kernels need precomputed.
+struct KernelRay {
+	glm::vec3 origin, dir, invDir;
+	KernelRay(glm::vec3 originIn, glm::vec3 dirIn) : origin(originIn), dir(dirIn), invDir(1.0f / dirIn) {}
+};
+
+//Closest of the first count triangles hit at 0 < t < maxT, both
+//faces. Returns its lane and fills t and the barycentrics u, v (of
+//v1 and v2), or returns -1.
+typedef int (*RayTriangles8Fn)(const TrianglePacket8& p, int count, const KernelRay& ray, float maxT, float& t, float& u, float& v);
+//Bit per box, of the first count, that the ray enters before maxT.
+//tEnter (8 floats) gets each lane's entry distance, 0 if the ray
+//starts inside.
+typedef uint32_t(*RayBoxes8Fn)(const BoxPacket8& p, int count, const KernelRay& ray, float maxT, float* tEnter);
+
+enum SimdLevel {
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+struct RayKernels {
+	const char* name;
+	SimdLevel level;
+	RayTriangles8Fn triangles8;
+	RayBoxes8Fn boxes8;
+};
+
+//Best level this CPU and OS support, and built into this binary.
+SimdLevel detectSimdLevel();
+//Kernels of a level, or the best available below it.
+const RayKernels& rayKernelsFor(SimdLevel level);
+
+//What everything should call. Picked by detectSimdLevel() at startup.
+extern const RayKernels* rayKernels;
+
+#endif
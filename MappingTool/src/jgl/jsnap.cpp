@@ -0,0 +1,615 @@
+#include "jsnap.h"
+#include "jjobs.h"
+#include "jmodule.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+VertexSnapper vertexSnapper;
+
+//Clip w below this is treated as at or behind the camera.
+static const float SNAP_MIN_W = 1e-6f;
+
+#pragma region Build:
+static bool positionLess(const glm::vec3& a, const glm::vec3& b) {
+	if (a.x != b.x)
+		return a.x < b.x;
+	if (a.y != b.y)
+		return a.y < b.y;
+	return a.z < b.z;
+}
+
+static void buildSnapNode(std::vector<BVHNode>& nodes, std::vector<SnapPoint>& points, uint32_t node, uint32_t begin, uint32_t end) {
+	glm::vec3 bMin(FLT_MAX), bMax(-FLT_MAX);
+	for (uint32_t i = begin; i < end; i++) {
+		bMin = glm::min(bMin, points[i].position);
+		bMax = glm::max(bMax, points[i].position);
+	}
+	nodes[node].bMin = bMin;
+	nodes[node].bMax = bMax;
+	if (end - begin <= SNAP_LEAF) {
+		nodes[node].first = begin;
+		nodes[node].count = end - begin;
+		return;
+	}
+	glm::vec3 extent = bMax - bMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	uint32_t mid = (begin + end) / 2;
+	std::nth_element(points.begin() + begin, points.begin() + mid, points.begin() + end,
+		[axis](const SnapPoint& a, const SnapPoint& b) { return a.position[axis] < b.position[axis]; });
+	uint32_t child = (uint32_t)nodes.size();
+	nodes.resize(child + 2);
+	nodes[node].first = child;
+	nodes[node].count = 0;
+	buildSnapNode(nodes, points, child, begin, mid);
+	buildSnapNode(nodes, points, child + 1, mid, end);
+}
+
+void buildSnapTree(const Vertex* vertices, const unsigned short* indices, uint32_t triCount, std::vector<BVHNode>& nodes, std::vector<SnapPoint>& points) {
+	nodes.clear();
+	points.clear();
+	if (!triCount)
+		return;
+
+	//Meshes split a vertex wherever its normal or uv changes; those
+	//copies are one point. canon maps a vertex index to its point.
+	std::vector<uint32_t> used(indices, indices + 3 * (size_t)triCount);
+	std::sort(used.begin(), used.end());
+	used.erase(std::unique(used.begin(), used.end()), used.end());
+	std::vector<uint32_t> canon(used.back() + 1);
+	std::sort(used.begin(), used.end(), [vertices](uint32_t a, uint32_t b) { return positionLess(vertices[a].position, vertices[b].position); });
+	for (size_t i = 0; i < used.size(); i++) {
+		const glm::vec3& p = vertices[used[i]].position;
+		if (points.empty() || p != points.back().position)
+			points.push_back({ p, SNAP_VERTEX });
+		canon[used[i]] = (uint32_t)points.size() - 1;
+	}
+
+	//Edges by their end points, so the two triangles on an edge (and
+	//any split copies of its vertices) give one midpoint.
+	std::vector<uint64_t> edges;
+	edges.reserve(3 * (size_t)triCount);
+	for (uint32_t t = 0; t < triCount; t++) {
+		for (int k = 0; k < 3; k++) {
+			uint64_t a = canon[indices[3 * t + k]], b = canon[indices[3 * t + (k + 1) % 3]];
+			if (a != b)
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	size_t vertexPoints = points.size();
+	points.reserve(vertexPoints + edges.size());
+	for (uint64_t e : edges) {
+		glm::vec3 a = points[(size_t)(e >> 32)].position, b = points[(size_t)(e & 0xFFFFFFFF)].position;
+		points.push_back({ (a + b) * 0.5f, SNAP_EDGE_MIDPOINT });
+	}
+
+	nodes.reserve(2 * (points.size() / SNAP_LEAF + 1));
+	nodes.resize(1);
+	buildSnapNode(nodes, points, 0, 0, (uint32_t)points.size());
+}
+#pragma endregion
+
+#pragma region Search:
+//Squared distance from p to the box, 0 inside it.
+static inline float boxDistance2(glm::vec3 p, glm::vec3 bMin, glm::vec3 bMax) {
+	glm::vec3 d = glm::max(glm::max(bMin - p, p - bMax), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+//World box of a local box (Arvo's method).
+static inline void worldBox(const glm::mat4& m, glm::vec3 bMin, glm::vec3 bMax, glm::vec3& outMin, glm::vec3& outMax) {
+	outMin = outMax = glm::vec3(m[3]);
+	for (int col = 0; col < 3; col++) {
+		glm::vec3 a = glm::vec3(m[col]) * bMin[col];
+		glm::vec3 b = glm::vec3(m[col]) * bMax[col];
+		outMin += glm::min(a, b);
+		outMax += glm::max(a, b);
+	}
+}
+
+//Where a clip-space point lands, in window pixels from the top-left.
+static inline glm::vec2 toWindow(glm::vec4 clip, glm::vec2 size) {
+	return glm::vec2((clip.x / clip.w + 1.0f) * 0.5f * size.x, (1.0f - clip.y / clip.w) * 0.5f * size.y);
+}
+
+//Squared pixel distance from cursor to the box's projection. 0 if the
+//box reaches behind the camera, since then its projection is unbounded.
+static float screenDistance2(const glm::mat4& MVP, glm::vec3 bMin, glm::vec3 bMax, glm::vec2 cursor, glm::vec2 size) {
+	//Corners are c0 plus any of the three edges, so four products
+	//instead of eight.
+	glm::vec4 c0 = MVP * glm::vec4(bMin, 1.0f);
+	glm::vec3 d = bMax - bMin;
+	glm::vec4 ex = MVP[0] * d.x, ey = MVP[1] * d.y, ez = MVP[2] * d.z;
+	glm::vec2 sMin(FLT_MAX), sMax(-FLT_MAX);
+	int behind = 0;
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 c = c0;
+		if (i & 1)
+			c += ex;
+		if (i & 2)
+			c += ey;
+		if (i & 4)
+			c += ez;
+		if (c.w <= SNAP_MIN_W) {
+			behind++;
+			continue;
+		}
+		glm::vec2 s = toWindow(c, size);
+		sMin = glm::min(sMin, s);
+		sMax = glm::max(sMax, s);
+	}
+	if (behind == 8)
+		return FLT_MAX;
+	if (behind)
+		return 0.0f;
+	glm::vec2 out = glm::max(glm::max(sMin - cursor, cursor - sMax), glm::vec2(0.0f));
+	return glm::dot(out, out);
+}
+
+//Walks a tree nearest box first. bound(node) is a lower bound on the
+//distance to anything under node, in whatever units leaf(first,
+//count) lowers best in; boxes further than best are skipped.
+template<class Bound, class Leaf> static void nearestWalk(const BVHNode* nodes, const float& best, Bound bound, Leaf leaf) {
+	struct Entry { uint32_t node; float d; };
+	Entry stack[64];
+	int top = 0;
+	float d = bound(nodes[0]);
+	if (d > best)
+		return;
+	stack[top++] = { 0, d };
+	while (top > 0) {
+		Entry e = stack[--top];
+		if (e.d > best)
+			continue;
+		const BVHNode& n = nodes[e.node];
+		if (n.count) {
+			leaf(n.first, n.count);
+			continue;
+		}
+		float d0 = bound(nodes[n.first]), d1 = bound(nodes[n.first + 1]);
+		Entry nearer = { n.first, d0 }, farther = { n.first + 1, d1 };
+		if (d1 < d0)
+			std::swap(nearer, farther);
+		if (farther.d <= best)
+			stack[top++] = farther;
+		if (nearer.d <= best)
+			stack[top++] = nearer;
+	}
+}
+#pragma endregion
+
+#pragma region VertexSnapper:
+void VertexSnapper::buildMeshTrees() {
+	//Each new mesh once, even if meshList has it many times.
+	std::vector<MeshHandle> handles;
+	std::vector<Mesh*> meshes;
+	for (MeshHandle h : store->meshList) {
+		if (meshTrees.count(h.value))
+			continue;
+		Mesh* mesh = meshHandles.get(h);
+		if (!mesh)
+			continue;
+		meshTrees[h.value] = NULL;
+		handles.push_back(h);
+		meshes.push_back(mesh);
+	}
+	if (handles.empty())
+		return;
+
+	//Built side by side into vectors, then copied into mapArena here,
+	//since the arena is only for this thread.
+	uint32_t count = (uint32_t)handles.size();
+	std::vector<std::vector<BVHNode>> builtNodes(count);
+	std::vector<std::vector<SnapPoint>> builtPoints(count);
+	jobSystem.parallelFor(count, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			buildSnapTree(meshes[i]->getVertices(), meshes[i]->getIndices(), meshes[i]->getTriangleCount(), builtNodes[i], builtPoints[i]);
+	});
+	for (uint32_t i = 0; i < count; i++) {
+		SnapTree* tree = mapArena.create<SnapTree>();
+		tree->nodeCount = (uint32_t)builtNodes[i].size();
+		tree->pointCount = (uint32_t)builtPoints[i].size();
+		tree->nodes = mapArena.allocArray<BVHNode>(tree->nodeCount);
+		tree->points = mapArena.allocArray<SnapPoint>(tree->pointCount);
+		std::copy(builtNodes[i].begin(), builtNodes[i].end(), tree->nodes);
+		std::copy(builtPoints[i].begin(), builtPoints[i].end(), tree->points);
+		meshTrees[handles[i].value] = tree;
+	}
+}
+
+void VertexSnapper::updateInstance(uint32_t i) {
+	Instance& inst = instances[i];
+	inst.world = store->transforms.world[store->transforms.indexOf(inst.entity)];
+	worldBox(inst.world, inst.tree->nodes[0].bMin, inst.tree->nodes[0].bMax, boxMin[i], boxMax[i]);
+}
+
+bool VertexSnapper::known(Entity e) const {
+	uint32_t i = handleIndex(e);
+	return i < firstInstance.size() && firstInstance[i] != UINT32_MAX && instances[firstInstance[i]].entity == e;
+}
+
+bool VertexSnapper::live(const Instance& inst) const {
+	return store->alive(inst.entity) && store->models.has(inst.entity);
+}
+
+uint32_t VertexSnapper::gatherInstances(bool onlyNew) {
+	if (!onlyNew) {
+		instances.clear();
+		firstInstance.assign(firstInstance.size(), UINT32_MAX);
+	}
+	uint32_t kept = 0;
+	size_t before = instances.size();
+	const ModelRefPool& models = store->models;
+	for (uint32_t i = 0; i < models.size(); i++) {
+		Entity e = models.entityAt(i);
+		if (!store->transforms.has(e))
+			continue;
+		if (onlyNew && known(e)) {
+			for (uint32_t k = firstInstance[handleIndex(e)]; k < instances.size() && instances[k].entity == e; k++)
+				kept++;
+			continue;
+		}
+		uint32_t first = (uint32_t)instances.size();
+		for (uint32_t m = 0; m < models.meshCount[i]; m++) {
+			MeshHandle h = store->meshList[models.firstMesh[i] + m];
+			auto it = meshTrees.find(h.value);
+			if (it == meshTrees.end() || !it->second || !it->second->nodeCount)
+				continue;
+			instances.push_back({ e, h, it->second, glm::mat4(1.0f) });
+		}
+		if (instances.size() > first) {
+			if (handleIndex(e) >= firstInstance.size())
+				firstInstance.resize(handleIndex(e) + 1, UINT32_MAX);
+			firstInstance[handleIndex(e)] = first;
+		}
+	}
+	boxMin.resize(instances.size());
+	boxMax.resize(instances.size());
+	for (size_t i = before; i < instances.size(); i++)
+		updateInstance((uint32_t)i);
+	return kept;
+}
+
+void VertexSnapper::rebuild() {
+	gatherInstances(0);
+	buildBoxTree(boxMin.data(), boxMax.data(), (uint32_t)instances.size(), nodes, order);
+	treeCount = (uint32_t)instances.size();
+}
+
+void VertexSnapper::refit() {
+	//Children always come after their parent.
+	for (size_t i = nodes.size(); i-- > 0;) {
+		BVHNode& n = nodes[i];
+		if (n.count) {
+			n.bMin = glm::vec3(FLT_MAX);
+			n.bMax = glm::vec3(-FLT_MAX);
+			for (uint32_t k = n.first; k < n.first + n.count; k++) {
+				n.bMin = glm::min(n.bMin, boxMin[order[k]]);
+				n.bMax = glm::max(n.bMax, boxMax[order[k]]);
+			}
+		}
+		else {
+			n.bMin = glm::min(nodes[n.first].bMin, nodes[n.first + 1].bMin);
+			n.bMax = glm::max(nodes[n.first].bMax, nodes[n.first + 1].bMax);
+		}
+	}
+}
+
+void VertexSnapper::update(EntityStore& storeIn) {
+	store = &storeIn;
+	buildMeshTrees();
+
+	//Entities came or went. New ones go on the end, outside the tree,
+	//and destroyed ones are skipped, until either is enough to be
+	//worth building the tree again.
+	if (builtVersion != store->version) {
+		if (builtVersion == UINT32_MAX || nodes.empty()) {
+			rebuild();
+		}
+		else {
+			uint32_t before = (uint32_t)instances.size();
+			uint32_t dead = before - gatherInstances(1);
+			uint32_t loose = (uint32_t)instances.size() - treeCount;
+			if (loose > SNAP_LOOSE_MAX || dead * 4 > instances.size())
+				rebuild();
+		}
+		builtVersion = store->version;
+	}
+
+	//Moved: only their boxes are redone, then the tree is refit.
+	if (store->transforms.changed.empty() || instances.empty())
+		return;
+	bool moved = 0;
+	for (Entity e : store->transforms.changed) {
+		uint32_t i = handleIndex(e);
+		if (i >= firstInstance.size())
+			continue;
+		for (uint32_t k = firstInstance[i]; k < instances.size() && instances[k].entity == e; k++) {
+			updateInstance(k);
+			moved |= k < treeCount;
+		}
+	}
+	if (moved)
+		refit();
+}
+
+void VertexSnapper::invalidate(MeshHandle h) {
+	if (meshTrees.erase(h.value))
+		builtVersion = UINT32_MAX;	//Instances still point at the old tree.
+}
+
+bool VertexSnapper::nearestWorld(glm::vec3 p, float maxDist, SnapHit& hit, uint32_t kinds, LayerMask layers) const {
+	if (instances.empty() || !store)
+		return 0;
+	float best = maxDist * maxDist;
+	const Instance* bestInst = NULL;
+	SnapPoint bestPoint = {};
+	auto search = [&](const Instance& inst) {
+		if (!(store->getLayers(inst.entity) & layers) || !live(inst))
+			return;
+		const glm::mat4& m = inst.world;
+		nearestWalk(inst.tree->nodes, best, [&](const BVHNode& n) {
+			glm::vec3 bMin, bMax;
+			worldBox(m, n.bMin, n.bMax, bMin, bMax);
+			return boxDistance2(p, bMin, bMax);
+		}, [&](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				const SnapPoint& sp = inst.tree->points[i];
+				if (!(sp.kind & kinds))
+					continue;
+				glm::vec3 w = glm::vec3(m * glm::vec4(sp.position, 1.0f));
+				float d = glm::dot(w - p, w - p);
+				if (d < best) {
+					best = d;
+					bestInst = &inst;
+					bestPoint = { w, sp.kind };
+				}
+			}
+		});
+	};
+	if (!nodes.empty()) {
+		nearestWalk(nodes.data(), best, [&](const BVHNode& n) { return boxDistance2(p, n.bMin, n.bMax); },
+			[&](uint32_t first, uint32_t count) {
+			for (uint32_t k = first; k < first + count; k++)
+				search(instances[order[k]]);
+		});
+	}
+	for (size_t i = treeCount; i < instances.size(); i++) {
+		if (boxDistance2(p, boxMin[i], boxMax[i]) <= best)
+			search(instances[i]);
+	}
+
+	if (!bestInst)
+		return 0;
+	hit.entity = bestInst->entity;
+	hit.mesh = bestInst->mesh;
+	hit.kind = bestPoint.kind;
+	hit.position = bestPoint.position;
+	hit.distance = sqrtf(best);
+	return 1;
+}
+
+bool VertexSnapper::nearestScreen(glm::vec2 cursor, const glm::mat4& VP, int width, int height, float maxPixels, SnapHit& hit, uint32_t kinds, LayerMask layers) const {
+	if (instances.empty() || !store)
+		return 0;
+	glm::vec2 size((float)std::max(width, 1), (float)std::max(height, 1));
+	float best = maxPixels * maxPixels, bestDepth = FLT_MAX;
+	const Instance* bestInst = NULL;
+	SnapPoint bestPoint = {};
+	auto search = [&](const Instance& inst) {
+		if (!(store->getLayers(inst.entity) & layers) || !live(inst))
+			return;
+		glm::mat4 MVP = VP * inst.world;
+		nearestWalk(inst.tree->nodes, best, [&](const BVHNode& n) { return screenDistance2(MVP, n.bMin, n.bMax, cursor, size); },
+			[&](uint32_t first, uint32_t count) {
+			for (uint32_t i = first; i < first + count; i++) {
+				const SnapPoint& sp = inst.tree->points[i];
+				if (!(sp.kind & kinds))
+					continue;
+				glm::vec4 clip = MVP * glm::vec4(sp.position, 1.0f);
+				//Between the near and far planes only.
+				if (clip.w <= SNAP_MIN_W || clip.z < -clip.w || clip.z > clip.w)
+					continue;
+				glm::vec2 s = toWindow(clip, size) - cursor;
+				float d = glm::dot(s, s), depth = clip.z / clip.w;
+				if (d < best || (d == best && depth < bestDepth)) {
+					best = d;
+					bestDepth = depth;
+					bestInst = &inst;
+					bestPoint = sp;
+				}
+			}
+		});
+	};
+	if (!nodes.empty()) {
+		nearestWalk(nodes.data(), best, [&](const BVHNode& n) { return screenDistance2(VP, n.bMin, n.bMax, cursor, size); },
+			[&](uint32_t first, uint32_t count) {
+			for (uint32_t k = first; k < first + count; k++)
+				search(instances[order[k]]);
+		});
+	}
+	for (size_t i = treeCount; i < instances.size(); i++) {
+		if (screenDistance2(VP, boxMin[i], boxMax[i], cursor, size) <= best)
+			search(instances[i]);
+	}
+
+	if (!bestInst)
+		return 0;
+	hit.entity = bestInst->entity;
+	hit.mesh = bestInst->mesh;
+	hit.kind = bestPoint.kind;
+	hit.position = glm::vec3(bestInst->world * glm::vec4(bestPoint.position, 1.0f));
+	hit.distance = sqrtf(best);
+	return 1;
+}
+
+void VertexSnapper::clear() {
+	meshTrees.clear();
+	instances.clear();
+	boxMin.clear();
+	boxMax.clear();
+	firstInstance.clear();
+	nodes.clear();
+	order.clear();
+	treeCount = 0;
+	builtVersion = UINT32_MAX;
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//Every point of every object, for checking the searches against.
+//Returns squared world units, or squared pixels if VP is given.
+static float bruteNearest(const EntityStore& store, const std::vector<Entity>& entities, const std::vector<SnapPoint>& points,
+	glm::vec3 p, const glm::mat4* VP, glm::vec2 cursor, glm::vec2 size, float best) {
+	for (Entity e : entities) {
+		const glm::mat4& m = store.transforms.world[store.transforms.indexOf(e)];
+		for (const SnapPoint& sp : points) {
+			glm::vec3 local = sp.position;
+			if (!VP) {
+				glm::vec3 w = glm::vec3(m * glm::vec4(local, 1.0f));
+				best = std::min(best, glm::dot(w - p, w - p));
+				continue;
+			}
+			glm::vec4 clip = (*VP) * m * glm::vec4(local, 1.0f);
+			if (clip.w <= SNAP_MIN_W || clip.z < -clip.w || clip.z > clip.w)
+				continue;
+			glm::vec2 s = toWindow(clip, size) - cursor;
+			best = std::min(best, glm::dot(s, s));
+		}
+	}
+	return best;
+}
+
+void snapBenchmark() {
+	const int SIDE = 224, WIDTH = 1024, HEIGHT = 768, QUERIES = 10000, MOVES = 500, EDITS = 200, CHECKS = 10;
+	const float SPACING = 10.0f, WORLD_RADIUS = 2.0f, PIXEL_RADIUS = 10.0f;
+	ArenaMark mark = mapArena.mark();
+
+	//The same field of small terrain patches the selection benchmark uses.
+	aiMesh* source = makeTestTerrain(8, 0.3f);
+	Mesh* mesh = mapArena.create<Mesh>(source);
+	delete source;
+	MeshHandle handle = meshHandles.insert(mesh);
+
+	EntityStore store;
+	VertexSnapper snapper;
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Entity> entities;
+	auto placement = [&](int x, int z) {
+		glm::vec3 at(x * SPACING + unit(rng) * 3.0f, unit(rng) * 20.0f, z * SPACING + unit(rng) * 3.0f);
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), at);
+		m = glm::rotate(m, unit(rng) * 6.28f, glm::vec3(0.0f, 1.0f, 0.0f));
+		return glm::scale(m, glm::vec3(0.5f + unit(rng)));
+	};
+	for (int z = 0; z < SIDE; z++) {
+		for (int x = 0; x < SIDE; x++) {
+			Entity e = store.create();
+			store.transforms.add(e, placement(x, z));
+			store.addMeshes(e, &handle, 1);
+			entities.push_back(e);
+		}
+	}
+	store.transforms.update();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	snapper.update(store);
+	double build = msSince(start);
+	//A copy of the mesh's points for the brute force checks.
+	std::vector<BVHNode> checkNodes;
+	std::vector<SnapPoint> checkPoints;
+	buildSnapTree(mesh->getVertices(), mesh->getIndices(), mesh->getTriangleCount(), checkNodes, checkPoints);
+	std::cout << "SNAP: " << entities.size() << " objects of " << checkPoints.size() << " points each, set up in " << build << " ms\n";
+
+	float extent = SIDE * SPACING;
+	glm::vec3 target(extent * 0.5f, 0.0f, extent * 0.5f);
+	glm::vec3 eye = target + glm::vec3(0.0f, extent * 0.9f, -extent * 0.6f);
+	glm::mat4 VP = glm::perspective(glm::radians(45.0f), (float)WIDTH / HEIGHT, 1.0f, extent * 4.0f) * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec2 size((float)WIDTH, (float)HEIGHT);
+
+	std::vector<glm::vec3> spots(QUERIES);
+	std::vector<glm::vec2> cursors(QUERIES);
+	for (int i = 0; i < QUERIES; i++) {
+		spots[i] = glm::vec3(unit(rng) * extent, unit(rng) * 24.0f - 2.0f, unit(rng) * extent);
+		cursors[i] = glm::vec2(unit(rng) * WIDTH, unit(rng) * HEIGHT);
+	}
+	SnapHit hit;
+	int hits = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < QUERIES; i++)
+		hits += snapper.nearestWorld(spots[i], WORLD_RADIUS, hit);
+	double world = msSince(start);
+	std::cout << "SNAP: world, " << WORLD_RADIUS << " units: " << world * 1000.0 / QUERIES << " us/search, " << hits << "/" << QUERIES << " found\n";
+	hits = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < QUERIES; i++)
+		hits += snapper.nearestScreen(cursors[i], VP, WIDTH, HEIGHT, PIXEL_RADIUS, hit);
+	double screen = msSince(start);
+	std::cout << "SNAP: screen, " << PIXEL_RADIUS << " px: " << screen * 1000.0 / QUERIES << " us/search, " << hits << "/" << QUERIES << " found\n";
+
+	//An edit dragging some objects around: only theirs are redone.
+	for (int i = 0; i < MOVES; i++) {
+		Entity e = entities[rng() % entities.size()];
+		store.transforms.setLocal(e, placement((int)(unit(rng) * SIDE), (int)(unit(rng) * SIDE)));
+	}
+	store.transforms.update();
+	start = std::chrono::high_resolution_clock::now();
+	snapper.update(store);
+	std::cout << "SNAP: " << MOVES << " objects moved, updated in " << msSince(start) << " ms\n";
+
+	//Placing and deleting objects one at a time, an update after each.
+	double placing = 0.0, deleting = 0.0;
+	for (int i = 0; i < EDITS; i++) {
+		Entity e = store.create();
+		store.transforms.add(e, placement((int)(unit(rng) * SIDE), (int)(unit(rng) * SIDE)));
+		store.addMeshes(e, &handle, 1);
+		entities.push_back(e);
+		store.transforms.update();
+		start = std::chrono::high_resolution_clock::now();
+		snapper.update(store);
+		placing += msSince(start);
+	}
+	for (int i = 0; i < EDITS; i++) {
+		size_t k = rng() % entities.size();
+		store.destroy(entities[k]);
+		entities[k] = entities.back();
+		entities.pop_back();
+		store.transforms.update();
+		start = std::chrono::high_resolution_clock::now();
+		snapper.update(store);
+		deleting += msSince(start);
+	}
+	std::cout << "SNAP: " << EDITS << " objects placed, " << placing / EDITS << " ms per update; "
+		<< EDITS << " deleted, " << deleting / EDITS << " ms per update\n";
+
+	//After the edits, so refits and loose instances are checked too.
+	int mismatches = 0;
+	for (int i = 0; i < CHECKS; i++) {
+		SnapHit w, s;
+		float worldMax = WORLD_RADIUS * WORLD_RADIUS, pixelMax = PIXEL_RADIUS * PIXEL_RADIUS;
+		float worldBest = bruteNearest(store, entities, checkPoints, spots[i], NULL, glm::vec2(0.0f), size, worldMax);
+		bool worldFound = snapper.nearestWorld(spots[i], WORLD_RADIUS, w);
+		mismatches += worldFound != (worldBest < worldMax) || (worldFound && fabsf(w.distance * w.distance - worldBest) > 1e-3f * (1.0f + worldBest));
+		float screenBest = bruteNearest(store, entities, checkPoints, glm::vec3(0.0f), &VP, cursors[i], size, pixelMax);
+		bool screenFound = snapper.nearestScreen(cursors[i], VP, WIDTH, HEIGHT, PIXEL_RADIUS, s);
+		mismatches += screenFound != (screenBest < pixelMax) || (screenFound && fabsf(s.distance * s.distance - screenBest) > 1e-2f * (1.0f + screenBest));
+	}
+	if (mismatches)
+		std::cout << "SNAP: " << mismatches << " of " << 2 * CHECKS << " sampled searches disagree with trying every point!\n";
+
+	meshHandles.remove(handle);
+	snapper.clear();
+	mapArena.rewind(mark);
+}
+#pragma endregion
@@ -0,0 +1,131 @@
+#ifndef JSNAP_H
+#define JSNAP_H
+
+#include <float.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include "jbvh.h"
+#include "jecs.h"
+
+///
+/// Snapping to existing geometry. Every mesh gets a tree over its snap
+/// points: each distinct vertex position and the middle of each
+/// distinct edge. Points are split at the median of the longest axis
+/// down to leaves of SNAP_LEAF, a k-d tree that keeps a box per node,
+/// so the same tree answers both world-space and screen-space
+/// searches. Trees are in the mesh's local space and shared by every
+/// instance of it.
+///
+/// VertexSnapper keeps a box tree over the instances on top, the way
+/// ScenePicker does. Moving an object only redoes its own box and a
+/// refit. New objects are searched one by one outside the tree, and
+/// destroyed ones skipped, until there are enough to rebuild it. Point
+/// trees are only built for meshes that are new or were invalidated,
+/// several at once on the job system. So an edit costs in proportion
+/// to what it touched, not to the size of the map.
+///
+
+const uint32_t SNAP_LEAF = 8;			//Points per leaf, at most
+const uint32_t SNAP_LOOSE_MAX = 256;	//New instances searched one by one before the top tree is rebuilt
+
+//What a snap point is; also used as a mask of kinds to look for.
+enum SnapKind : uint32_t {
+	SNAP_VERTEX = 1,
+	SNAP_EDGE_MIDPOINT = 2,
+	SNAP_ALL = 3
+};
+
+struct SnapPoint {
+	glm::vec3 position;
+	uint32_t kind;
+};
+
+/// <summary>
+/// SnapTree. One mesh's points, reordered so each leaf's are adjacent.
+/// Nodes are as in a BVH: leaves hold points [first, first + count).
+/// Everything is in mapArena.
+/// </summary>
+struct SnapTree {
+	BVHNode* nodes = NULL;
+	SnapPoint* points = NULL;
+	uint32_t nodeCount = 0, pointCount = 0;
+};
+
+//Builds the tree for the vertices that triCount triangles of indices
+//use. Fills nodes and points rather than an arena, so several can be
+//built at once.
+void buildSnapTree(const Vertex* vertices, const unsigned short* indices, uint32_t triCount, std::vector<BVHNode>& nodes, std::vector<SnapPoint>& points);
+
+//What a snap found.
+struct SnapHit {
+	Entity entity = NULL_ENTITY;
+	MeshHandle mesh;
+	uint32_t kind = 0;					//0 on a miss
+	glm::vec3 position = glm::vec3(0.0f);	//World space
+	float distance = FLT_MAX;			//World units, or pixels from a screen search
+	bool hit() const { return kind != 0; }
+};
+
+/// <summary>
+/// VertexSnapper. Call update() once a frame after transforms.update(),
+/// like ScenePicker::update().
+/// </summary>
+class VertexSnapper {
+	private:
+		struct Instance {
+			Entity entity;
+			MeshHandle mesh;
+			const SnapTree* tree;
+			glm::mat4 world;
+		};
+		EntityStore* store = NULL;
+		std::vector<Instance> instances;
+		std::vector<glm::vec3> boxMin, boxMax;	//World space, by instance
+		std::vector<BVHNode> nodes;
+		std::vector<uint32_t> order;			//Leaf order -> instances index
+		uint32_t treeCount = 0;					//Instances in the tree; the rest are loose
+		std::vector<uint32_t> firstInstance;	//By entity index; an entity's instances are adjacent
+		std::unordered_map<uint32_t, SnapTree*> meshTrees;	//By MeshHandle value
+		uint32_t builtVersion = UINT32_MAX;
+
+		void buildMeshTrees();
+		bool known(Entity e) const;
+		bool live(const Instance& inst) const;
+		//Appends instances, of every entity or only unknown ones.
+		//Returns how many known ones were passed over.
+		uint32_t gatherInstances(bool onlyNew);
+		void rebuild();
+		void updateInstance(uint32_t i);
+		void refit();
+	public:
+		void update(EntityStore& storeIn);
+		//The mesh's vertices changed: its tree is rebuilt next update().
+		//The old one's memory stays in mapArena until closeMap().
+		void invalidate(MeshHandle h);
+
+		//Nearest point of kinds on a visible layer within maxDist of p.
+		//Returns 0 if there is none.
+		bool nearestWorld(glm::vec3 p, float maxDist, SnapHit& hit, uint32_t kinds = SNAP_ALL, LayerMask layers = LAYER_ALL) const;
+		//Nearest point on screen within maxPixels of cursor (window
+		//pixels from the top-left), the one nearer the camera on a tie.
+		//Points behind the camera or past the far plane don't count;
+		//hidden ones do.
+		bool nearestScreen(glm::vec2 cursor, const glm::mat4& VP, int width, int height, float maxPixels, SnapHit& hit, uint32_t kinds = SNAP_ALL, LayerMask layers = LAYER_ALL) const;
+
+		//Forgets every mesh tree. Their memory goes with mapArena.
+		void clear();
+		size_t getInstanceCount() const { return instances.size(); }
+};
+
+extern VertexSnapper vertexSnapper;
+
+//Builds snap trees for 50k objects, times world and screen searches
+//and moving some of the objects, and checks a sample of searches
+//against trying every point.
+void snapBenchmark();
+
+#endif
@@ -0,0 +1,196 @@
+#include "jstream.h"
+#include "headers/shader.hpp"
+#include <iostream>
+#include <string.h>
+
+StreamRing streamRing;
+PreviewRenderer previewRenderer;
+
+#pragma region StreamRing:
+bool StreamRing::create(GLsizeiptr size) {
+	regionSize = size;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+	if (persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, STREAM_REGIONS * regionSize, NULL, flags);
+		mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, STREAM_REGIONS * regionSize, flags);
+		if (!mapped) {
+			std::cout << "STREAM: could not map the ring persistently, orphaning instead\n";
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			persistent = 0;
+		}
+	}
+	if (!persistent)
+		glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	region = 0;
+	head = 0;
+	return buffer != 0;
+}
+
+void StreamRing::destroy() {
+	//Draws still reading the buffer keep it alive until they are done.
+	for (GLsync& f : fences) {
+		if (f)
+			glDeleteSync(f);
+		f = 0;
+	}
+	if (buffer) {
+		if (mapped) {
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	mapped = NULL;
+}
+
+void StreamRing::beginFrame() {
+	if (!buffer && !create(STREAM_REGION_BYTES))
+		return;
+	head = 0;
+	if (!persistent) {
+		//New storage; the old goes once the draws reading it are done.
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+	region = (region + 1) % STREAM_REGIONS;
+	GLsync& f = fences[region];
+	if (!f)
+		return;
+	//Normally long signalled: the GPU is at most a frame or so behind.
+	GLenum r = glClientWaitSync(f, 0, 0);
+	if (r == GL_TIMEOUT_EXPIRED) {
+		waits++;
+		do {
+			r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (r == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(f);
+	f = 0;
+}
+
+void StreamRing::endFrame() {
+	if (!persistent || !buffer)
+		return;
+	if (fences[region])
+		glDeleteSync(fences[region]);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool StreamRing::reserve(GLsizeiptr size) {
+	if (!buffer && !create(STREAM_REGION_BYTES))
+		return 0;
+	if (head + size <= regionSize)
+		return 1;
+	//Too big for a region. Start over in a new ring big enough, once;
+	//offsets written so far this frame stay good in the old buffer
+	//for draws already made from it.
+	GLsizeiptr size2 = regionSize * 2;
+	while (size2 < size)
+		size2 *= 2;
+	destroy();
+	grows++;
+	std::cout << "STREAM: regions grown to " << size2 / 1024 << " KB\n";
+	return create(size2);
+}
+
+GLintptr StreamRing::write(const void* data, GLsizeiptr size, GLsizeiptr align) {
+	GLsizeiptr start = (head + align - 1) / align * align;
+	if (!reserve(start - head + size))
+		return -1;
+	start = (head + align - 1) / align * align;	//0 if it grew
+	GLintptr offset;
+	if (persistent) {
+		offset = region * regionSize + start;
+		memcpy(mapped + offset, data, size);
+	}
+	else {
+		offset = start;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	head = start + size;
+	return offset;
+}
+
+void StreamRing::release() {
+	destroy();
+	regionSize = 0;
+	head = 0;
+	region = 0;
+}
+#pragma endregion
+
+#pragma region PreviewRenderer:
+bool PreviewRenderer::init() {
+	if (vao)
+		return 1;
+	if (failed)
+		return 0;
+	failed = 1;	//Until everything below works out; no retrying every frame.
+	program = LoadShaders("src/shaders/previewvert.glsl", "src/shaders/previewfrag.glsl");
+	if (!program) {
+		std::cout << "PREVIEW: could not load the preview shaders\n";
+		return 0;
+	}
+	vpID = glGetUniformLocation(program, "VP");
+	colorID = glGetUniformLocation(program, "color");
+	//Buffers and offsets change from frame to frame, so they are set
+	//per draw.
+	glGenVertexArrays(1, &vao);
+	failed = 0;
+	return 1;
+}
+
+void PreviewRenderer::render(const RenderPacket& packet) {
+	const PreviewGeometry& g = packet.preview;
+	if (g.indices.empty() || g.positions.empty() || !init())
+		return;
+	GLsizeiptr vertexBytes = g.positions.size() * sizeof(glm::vec3);
+	GLsizeiptr indexBytes = g.indices.size() * sizeof(unsigned short);
+	if (!streamRing.reserve(vertexBytes + indexBytes + 32))
+		return;
+	GLintptr vertexOffset = streamRing.write(g.positions.data(), vertexBytes);
+	GLintptr indexOffset = streamRing.write(g.indices.data(), indexBytes, 4);
+	if (vertexOffset < 0 || indexOffset < 0)
+		return;
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, streamRing.getBuffer());
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)vertexOffset);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, streamRing.getBuffer());
+
+	//Like the ghosts: over the scene, tested against it, writing no depth.
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+	glUseProgram(program);
+	glUniformMatrix4fv(vpID, 1, GL_FALSE, &packet.VP[0][0]);
+	glUniform4fv(colorID, 1, &g.color[0]);
+	glDrawElements(GL_TRIANGLES, (GLsizei)g.indices.size(), GL_UNSIGNED_SHORT, (void*)indexOffset);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PreviewRenderer::release() {
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	if (program)
+		glDeleteProgram(program);
+	vao = program = 0;
+}
+#pragma endregion
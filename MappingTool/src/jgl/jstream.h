@@ -0,0 +1,85 @@
+#ifndef JSTREAM_H
+#define JSTREAM_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+#include "jbufferqueue.h"
+
+///
+/// Streaming for geometry that changes every frame: previews of edits
+/// in progress, ghost sphere instances. Rather than making or orphaning
+/// buffers per frame, everything is written into one ring with
+/// STREAM_REGIONS regions, a frame each. The frame writing a region
+/// fences it when it is done; by the time the ring comes back around,
+/// the GPU has long passed the fence, so writing never waits on it and
+/// nothing is allocated.
+///
+/// With GL 4.4 or ARB_buffer_storage the ring is mapped once, persistent
+/// and coherent, and writes are plain memcpys. Without it the ring
+/// falls back to one region that is orphaned at the start of each frame
+/// and filled with glBufferSubData.
+///
+/// A frame that needs more than a region grows the ring once (a new
+/// buffer, regions twice as big); after that it costs nothing again.
+///
+
+const int STREAM_REGIONS = 3;
+const GLsizeiptr STREAM_REGION_BYTES = 1 << 20;	//Starting size of a region
+
+/// <summary>
+/// StreamRing. GL thread only. beginFrame() before the frame's writes,
+/// endFrame() after its last draw.
+/// </summary>
+class StreamRing {
+	private:
+		GLuint buffer = 0;
+		uint8_t* mapped = NULL;			//Whole ring, when persistent
+		GLsync fences[STREAM_REGIONS] = {};
+		GLsizeiptr regionSize = 0;
+		GLsizeiptr head = 0;			//Next free byte in the region
+		int region = 0;
+		bool persistent = 0;
+		uint64_t waits = 0, grows = 0;
+
+		bool create(GLsizeiptr size);
+		void destroy();
+	public:
+		void beginFrame();
+		void endFrame();
+		//Makes sure the next writes, size bytes in all, fit in this
+		//frame's region without it growing in between. Call it before
+		//writes whose offsets are used together.
+		bool reserve(GLsizeiptr size);
+		//Copies size bytes into this frame's region at a multiple of
+		//align. Returns the byte offset into getBuffer(), or -1 if the
+		//ring could not be made.
+		GLintptr write(const void* data, GLsizeiptr size, GLsizeiptr align = 16);
+		GLuint getBuffer() const { return buffer; }
+		bool isPersistent() const { return persistent; }
+		//Frames that had to wait on the GPU, and times the ring grew.
+		uint64_t getWaits() const { return waits; }
+		uint64_t getGrows() const { return grows; }
+		void release();
+};
+
+extern StreamRing streamRing;
+
+/// <summary>
+/// PreviewRenderer. Draws RenderPacket::preview out of streamRing,
+/// see-through, over the opaque scene. GL thread only.
+/// </summary>
+class PreviewRenderer {
+	private:
+		GLuint program = 0, vao = 0;
+		GLint vpID = -1, colorID = -1;
+		bool failed = 0;
+
+		bool init();
+	public:
+		void render(const RenderPacket& packet);
+		void release();
+};
+
+extern PreviewRenderer previewRenderer;
+
+#endif
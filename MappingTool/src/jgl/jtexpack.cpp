@@ -0,0 +1,416 @@
+#include "jtexpack.h"
+#include "jhash.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string.h>
+#include <stb/stb_image.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TexturePack texturePack;
+
+#pragma region MappedFile:
+bool MappedFile::open(std::string path) {
+	close();
+#ifdef _WIN32
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE)
+		return 0;
+	LARGE_INTEGER len;
+	if (!GetFileSizeEx(f, &len) || len.QuadPart == 0) {
+		CloseHandle(f);
+		return 0;
+	}
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m) {
+		CloseHandle(f);
+		return 0;
+	}
+	data = (const unsigned char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		CloseHandle(m);
+		CloseHandle(f);
+		return 0;
+	}
+	fileHandle = f;
+	mapHandle = m;
+	size = (size_t)len.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return 0;
+	}
+	void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); //The mapping keeps its own reference.
+	if (p == MAP_FAILED)
+		return 0;
+	data = (const unsigned char*)p;
+	size = (size_t)st.st_size;
+#endif
+	return 1;
+}
+
+void MappedFile::close() {
+	if (!data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapHandle);
+	CloseHandle((HANDLE)fileHandle);
+#else
+	munmap((void*)data, size);
+#endif
+	data = NULL;
+	size = 0;
+	fileHandle = mapHandle = NULL;
+}
+#pragma endregion
+
+#pragma region Helpers:
+//FNV-1a. Only used to order and bucket names, not for content.
+uint64_t texPackHash(const std::string& name) {
+	uint64_t h = 14695981039346656037ull;
+	for (unsigned char c : name) {
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+//Forward slashes, lower case, no "./" prefix. Windows paths are
+//case insensitive, and Materials build theirs with '/'.
+std::string texPackNormalize(std::string path) {
+	std::replace(path.begin(), path.end(), '\\', '/');
+	std::transform(path.begin(), path.end(), path.begin(), [](unsigned char c) { return (char)tolower(c); });
+	while (path.rfind("./", 0) == 0)
+		path = path.substr(2);
+	size_t dup;
+	while ((dup = path.find("//")) != std::string::npos)
+		path.erase(dup, 1);
+	return path;
+}
+
+//texPackNormalize() of the absolute path, with "." and ".." resolved
+//against the working directory.
+std::string texPackAbsolute(std::string path) {
+	std::error_code ec;
+	std::filesystem::path p = std::filesystem::absolute(std::filesystem::path(path), ec);
+	if (ec)
+		return texPackNormalize(path);
+	return texPackNormalize(p.lexically_normal().generic_string());
+}
+
+size_t texPackMipSize(int width, int height, int channels, int level) {
+	size_t w = std::max(1, width >> level), h = std::max(1, height >> level);
+	return w * h * channels;
+}
+
+static int mipCountFor(int width, int height) {
+	int levels = 1;
+	while ((width >> levels) > 0 || (height >> levels) > 0)
+		levels++;
+	return levels;
+}
+
+//Whether every entry's name and mip data lie inside the file, its
+//format and mip chain make sense, and the table is in the order find()
+//searches it in. Everything later reads entries without checking.
+static bool entriesValid(const TexPackHeader* h, const TexPackEntry* entries, const char* names, size_t fileSize) {
+	for (uint32_t i = 0; i < h->entryCount; i++) {
+		const TexPackEntry& e = entries[i];
+		if ((uint64_t)e.nameOffset + e.nameLength > h->namesSize)
+			return 0;
+		if (e.format < TEXPACK_R8 || e.format > TEXPACK_RGBA8 || e.width == 0 || e.height == 0
+			|| e.width > 65536 || e.height > 65536 || e.mipCount == 0 || e.mipCount > (uint32_t)mipCountFor(e.width, e.height))
+			return 0;
+		uint64_t mipBytes = 0;
+		for (uint32_t level = 0; level < e.mipCount; level++)
+			mipBytes += texPackMipSize(e.width, e.height, e.format, level);
+		if (e.dataSize < mipBytes || e.dataOffset > fileSize || e.dataSize > fileSize - e.dataOffset)
+			return 0;
+		if (e.nameHash != texPackHash(std::string(names + e.nameOffset, e.nameLength)))
+			return 0;
+		if (i > 0 && entries[i - 1].nameHash > e.nameHash)
+			return 0;
+	}
+	return 1;
+}
+
+//2x2 box filter. Odd edges reuse the last row/column.
+static void downsample(const unsigned char* src, int sw, int sh, unsigned char* dst, int channels) {
+	int dw = std::max(1, sw / 2), dh = std::max(1, sh / 2);
+	for (int y = 0; y < dh; y++) {
+		int y0 = std::min(y * 2, sh - 1), y1 = std::min(y * 2 + 1, sh - 1);
+		for (int x = 0; x < dw; x++) {
+			int x0 = std::min(x * 2, sw - 1), x1 = std::min(x * 2 + 1, sw - 1);
+			for (int c = 0; c < channels; c++) {
+				int sum = src[(y0 * sw + x0) * channels + c] + src[(y0 * sw + x1) * channels + c]
+					+ src[(y1 * sw + x0) * channels + c] + src[(y1 * sw + x1) * channels + c];
+				dst[(y * dw + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region TexturePack:
+bool TexturePack::open(std::string packPath, std::string mountDirM) {
+	close();
+	if (!file.open(packPath))
+		return 0; //Not an error on its own, loose files still work.
+
+	const unsigned char* base = file.getData();
+	size_t size = file.getSize();
+	const TexPackHeader* h = (const TexPackHeader*)base;
+	if (size < sizeof(TexPackHeader) || h->magic != TEXPACK_MAGIC || h->version != TEXPACK_VERSION
+		|| sizeof(TexPackHeader) + (uint64_t)h->entryCount * sizeof(TexPackEntry) > size
+		|| h->namesOffset > size || h->namesSize > size - h->namesOffset
+		|| !entriesValid(h, (const TexPackEntry*)(base + sizeof(TexPackHeader)), (const char*)(base + h->namesOffset), size)) {
+		std::cout << "TEXPACK: " << packPath << " is not a valid texture pack\n";
+		file.close();
+		return 0;
+	}
+
+	header = h;
+	entries = (const TexPackEntry*)(base + sizeof(TexPackHeader));
+	names = (const char*)(base + h->namesOffset);
+
+	if (mountDirM.empty()) {
+		size_t lastSlash = packPath.find_last_of("/\\");
+		mountDirM = (lastSlash == std::string::npos) ? "." : packPath.substr(0, lastSlash);
+	}
+	mountDir = texPackAbsolute(mountDirM);
+	if (!mountDir.empty() && mountDir.back() != '/')
+		mountDir += '/';
+
+	std::cout << "TEXPACK: Mounted " << header->entryCount << " textures from " << packPath << "\n";
+	return 1;
+}
+
+void TexturePack::close() {
+	file.close();
+	header = NULL;
+	entries = NULL;
+	names = NULL;
+	mountDir = "";
+}
+
+const TexPackEntry* TexturePack::find(std::string path) const {
+	if (!header)
+		return NULL;
+	std::string name = texPackAbsolute(path);
+	if (name.rfind(mountDir, 0) != 0)
+		return NULL;
+	name = name.substr(mountDir.size());
+	uint64_t hash = texPackHash(name);
+
+	const TexPackEntry* end = entries + header->entryCount;
+	const TexPackEntry* it = std::lower_bound(entries, end, hash,
+		[](const TexPackEntry& e, uint64_t h) { return e.nameHash < h; });
+	for (; it != end && it->nameHash == hash; ++it) {
+		if (it->nameLength == name.size() && memcmp(names + it->nameOffset, name.data(), name.size()) == 0)
+			return it;
+	}
+	return NULL;
+}
+
+std::string TexturePack::getName(const TexPackEntry* e) const {
+	return std::string(names + e->nameOffset, e->nameLength);
+}
+
+const unsigned char* TexturePack::getMipData(const TexPackEntry* e, int level, int& widthOut, int& heightOut) const {
+	if (!header || level < 0 || level >= (int)e->mipCount)
+		return NULL;
+	size_t offset = e->dataOffset;
+	for (int i = 0; i < level; i++)
+		offset += texPackMipSize(e->width, e->height, e->format, i);
+	if (offset + texPackMipSize(e->width, e->height, e->format, level) > file.getSize())
+		return NULL;
+	widthOut = std::max(1, (int)e->width >> level);
+	heightOut = std::max(1, (int)e->height >> level);
+	return file.getData() + offset;
+}
+#pragma endregion
+
+#pragma region Packer:
+bool writeTexturePack(std::string outPath, std::string rootDir, const std::vector<std::string>& files) {
+	struct Pending {
+		std::string name;
+		TexPackEntry entry;
+		int blob;
+	};
+	std::vector<Pending> pending;
+	//Byte-identical source files are decoded and stored once; their
+	//entries point at the same mip data.
+	std::vector<std::vector<unsigned char>> blobs;
+	std::map<std::pair<uint64_t, size_t>, int> blobByContent;
+
+	for (const std::string& f : files) {
+		std::string full = rootDir + "/" + f;
+		std::ifstream file(full, std::ios::binary);
+		std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		std::pair<uint64_t, size_t> content(contentHash64(bytes.data(), bytes.size()), bytes.size());
+
+		Pending p;
+		p.name = texPackNormalize(f);
+		p.entry = {};
+		p.entry.nameHash = texPackHash(p.name);
+
+		auto shared = blobByContent.find(content);
+		if (shared != blobByContent.end()) {
+			const Pending& first = *std::find_if(pending.begin(), pending.end(), [&](const Pending& o) { return o.blob == shared->second; });
+			p.entry = first.entry;
+			p.entry.nameHash = texPackHash(p.name);
+			p.blob = shared->second;
+			pending.push_back(p);
+			continue;
+		}
+
+		int w, h, channels;
+		unsigned char* image = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &channels, 0);
+		if (!image) {
+			std::cout << "TEXPACK: Skipping " << full << " (" << stbi_failure_reason() << ")\n";
+			continue;
+		}
+
+		p.entry.width = w;
+		p.entry.height = h;
+		p.entry.format = channels;
+		p.entry.mipCount = mipCountFor(w, h);
+
+		size_t total = 0;
+		for (uint32_t i = 0; i < p.entry.mipCount; i++)
+			total += texPackMipSize(w, h, channels, i);
+		std::vector<unsigned char> data(total);
+
+		memcpy(data.data(), image, texPackMipSize(w, h, channels, 0));
+		stbi_image_free(image);
+
+		size_t src = 0, dst = texPackMipSize(w, h, channels, 0);
+		for (uint32_t i = 1; i < p.entry.mipCount; i++) {
+			downsample(&data[src], std::max(1, w >> (i - 1)), std::max(1, h >> (i - 1)), &data[dst], channels);
+			src = dst;
+			dst += texPackMipSize(w, h, channels, i);
+		}
+		p.entry.dataSize = total;
+		p.blob = (int)blobs.size();
+		blobByContent[content] = p.blob;
+		blobs.push_back(std::move(data));
+		pending.push_back(p);
+	}
+
+	std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+		if (a.entry.nameHash != b.entry.nameHash)
+			return a.entry.nameHash < b.entry.nameHash;
+		return a.name < b.name;
+	});
+
+	TexPackHeader header = {};
+	header.magic = TEXPACK_MAGIC;
+	header.version = TEXPACK_VERSION;
+	header.entryCount = (uint32_t)pending.size();
+	header.namesOffset = sizeof(TexPackHeader) + pending.size() * sizeof(TexPackEntry);
+
+	std::string namesBlob;
+	for (Pending& p : pending) {
+		p.entry.nameOffset = (uint32_t)namesBlob.size();
+		p.entry.nameLength = (uint32_t)p.name.size();
+		namesBlob += p.name;
+	}
+	header.namesSize = namesBlob.size();
+
+	//Mip data starts 16-byte aligned so uploads read from aligned memory.
+	std::vector<uint64_t> blobOffsets(blobs.size());
+	uint64_t offset = (header.namesOffset + header.namesSize + 15) & ~15ull;
+	for (size_t i = 0; i < blobs.size(); i++) {
+		blobOffsets[i] = offset;
+		offset = (offset + blobs[i].size() + 15) & ~15ull;
+	}
+	for (Pending& p : pending)
+		p.entry.dataOffset = blobOffsets[p.blob];
+
+	std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+	if (!out.good()) {
+		std::cout << "TEXPACK: Can't write " << outPath << "\n";
+		return 0;
+	}
+	out.write((const char*)&header, sizeof(header));
+	for (Pending& p : pending)
+		out.write((const char*)&p.entry, sizeof(TexPackEntry));
+	out.write(namesBlob.data(), namesBlob.size());
+
+	static const char zeros[16] = { 0 };
+	uint64_t written = header.namesOffset + header.namesSize;
+	for (size_t i = 0; i < blobs.size(); i++) {
+		out.write(zeros, blobOffsets[i] - written);
+		out.write((const char*)blobs[i].data(), blobs[i].size());
+		written = blobOffsets[i] + blobs[i].size();
+	}
+	out.write(zeros, offset - written);
+
+	std::cout << "TEXPACK: Wrote " << pending.size() << " textures, " << blobs.size() << " unique ("
+		<< offset << " bytes) to " << outPath << "\n";
+	return out.good();
+}
+#pragma endregion
+
+#pragma region Check:
+void texturePackCheck(const std::vector<std::string>& materialPaths) {
+	std::string packPath = (std::filesystem::temp_directory_path() / "MappingTool-check.jtp").string();
+	if (!writeTexturePack(packPath, "src/assets", { "bricks.jpg" })) {
+		std::cout << "TEXPACK: check could not write its pack\n";
+		return;
+	}
+	TexturePack pack;
+	if (!pack.open(packPath, "src/assets")) {
+		std::cout << "TEXPACK: check could not open its pack\n";
+		return;
+	}
+
+	int found = 0, missed = 0;
+	for (const std::string& path : materialPaths) {
+		if (pack.find(path))
+			found++;
+		else {
+			std::cout << "TEXPACK: " << path << " missed the pack\n";
+			missed++;
+		}
+	}
+	if (found == 0)
+		std::cout << "TEXPACK: check got no Material texture paths in the pack\n";
+
+	const char* inside[] = { "src/assets/bricks.jpg", "./src\\Assets\\BRICKS.JPG", "src/shaders/../assets/bricks.jpg" };
+	for (const char* path : inside) {
+		if (!pack.find(path)) {
+			std::cout << "TEXPACK: " << path << " missed the pack\n";
+			missed++;
+		}
+	}
+	//Same name, but not under the mount directory.
+	if (pack.find("bricks.jpg") || pack.find("src/bricks.jpg")) {
+		std::cout << "TEXPACK: a file outside src/assets was found in the pack\n";
+		missed++;
+	}
+	pack.close();
+	std::error_code ec;
+	std::filesystem::remove(packPath, ec);
+	std::cout << "TEXPACK: check " << (missed == 0 && found > 0 ? "passed" : "FAILED") << ", " << found << " Material textures found in the pack\n";
+}
+#pragma endregion
@@ -0,0 +1,112 @@
+#ifndef JTEXPACK_H
+#define JTEXPACK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+///
+/// Texture pack (.jtp) layout. Everything is little-endian and
+/// tightly packed so the file can be used straight out of a
+/// memory mapping:
+///
+///		TexPackHeader
+///		TexPackEntry[entryCount]	sorted by (nameHash, name)
+///		names blob					not null terminated
+///		mip data					level 0 first, rows tightly packed
+///
+/// The packer does all the decoding and mip generation up front,
+/// so at runtime a texture costs one binary search and one upload
+/// per mip level, and only when it is first asked for.
+///
+
+const uint32_t TEXPACK_MAGIC	= 0x4B505458; // "XTPK"
+const uint32_t TEXPACK_VERSION	= 1;
+
+//Pixel formats are numbered by channel count so they can be
+//used as bytes-per-pixel directly.
+enum TexPackFormat : uint32_t {
+	TEXPACK_R8		= 1,
+	TEXPACK_RG8		= 2,
+	TEXPACK_RGB8	= 3,
+	TEXPACK_RGBA8	= 4
+};
+
+#pragma pack(push, 1)
+struct TexPackHeader {
+	uint32_t magic, version, entryCount, reserved;
+	uint64_t namesOffset, namesSize;
+};
+
+struct TexPackEntry {
+	uint64_t nameHash;
+	uint32_t nameOffset, nameLength;
+	uint32_t width, height, format, mipCount;
+	uint64_t dataOffset, dataSize;
+};
+#pragma pack(pop)
+
+/// <summary>
+/// Read-only view of a whole file in memory. Uses the OS file
+/// mapping so pages are only read from disk once touched.
+/// </summary>
+class MappedFile {
+	private:
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		void* fileHandle = NULL;
+		void* mapHandle = NULL;
+	public:
+		~MappedFile() { close(); }
+		bool open(std::string path);
+		void close();
+		const unsigned char* getData() const { return data; }
+		size_t getSize() const { return size; }
+};
+
+/// <summary>
+/// TexturePack. A memory-mapped .jtp archive. Lookups are done by
+/// path, relative to the directory the pack was mounted at, so a
+/// Material can ask for the same absolute path it would have
+/// handed to stbi_load. Both are made absolute against the working
+/// directory first, so relative and absolute spellings of the same
+/// file find the same entry.
+/// </summary>
+class TexturePack {
+	private:
+		MappedFile file;
+		const TexPackHeader* header = NULL;
+		const TexPackEntry* entries = NULL;
+		const char* names = NULL;
+		std::string mountDir;
+	public:
+		bool open(std::string packPath, std::string mountDirM = "");
+		void close();
+		bool isOpen() const { return header != NULL; }
+		int getEntryCount() const { return header ? header->entryCount : 0; }
+
+		//NULL if path isn't in the pack or isn't under the mount directory.
+		const TexPackEntry* find(std::string path) const;
+		std::string getName(const TexPackEntry* e) const;
+		const unsigned char* getMipData(const TexPackEntry* e, int level, int& widthOut, int& heightOut) const;
+};
+
+//Helpers shared by the packer and the runtime.
+uint64_t texPackHash(const std::string& name);
+std::string texPackNormalize(std::string path);
+std::string texPackAbsolute(std::string path);
+size_t texPackMipSize(int width, int height, int channels, int level);
+
+//Decodes every image in files (paths relative to rootDir), builds
+//its mip chain and writes the result to outPath. Returns 0 on failure.
+bool writeTexturePack(std::string outPath, std::string rootDir, const std::vector<std::string>& files);
+
+//Packs src/assets/bricks.jpg, mounts the pack at src/assets and checks
+//materialPaths, the paths a loaded Material asked getTexture() for,
+//are found in it; so are other spellings of the same file, and a file
+//outside the mount is not.
+void texturePackCheck(const std::vector<std::string>& materialPaths);
+
+extern TexturePack texturePack;
+
+#endif
@@ -0,0 +1,367 @@
+#include "jthumbs.h"
+#include "jhash.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <string.h>
+#include <stb/stb_image.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JGL_SSE2
+#include <emmintrin.h>
+#endif
+
+ThumbnailService thumbnailService;
+
+static const uint32_t THUMBCACHE_MAGIC	 = 0x43485458; // "XTHC"
+static const uint32_t THUMBCACHE_VERSION = 1;
+
+#pragma region Downscale:
+//Halves an RGBA8 image with a 2x2 box filter. Odd last rows/columns are dropped.
+static void halveRGBA(const unsigned char* src, int width, int height, unsigned char* dst) {
+	int dw = width / 2, dh = height / 2;
+	for (int y = 0; y < dh; y++) {
+		const unsigned char* r0 = src + (size_t)(y * 2) * width * 4;
+		const unsigned char* r1 = r0 + (size_t)width * 4;
+		unsigned char* out = dst + (size_t)y * dw * 4;
+		int x = 0;
+#ifdef JGL_SSE2
+		//Pixels are 32 bits, so 4 go in a register and the even/odd
+		//split is a float shuffle.
+		for (; x + 4 <= dw; x += 4) {
+			__m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(r0 + x * 8)), _mm_loadu_si128((const __m128i*)(r1 + x * 8)));
+			__m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(r0 + x * 8 + 16)), _mm_loadu_si128((const __m128i*)(r1 + x * 8 + 16)));
+			__m128 af = _mm_castsi128_ps(a), bf = _mm_castsi128_ps(b);
+			__m128i even = _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i odd = _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(3, 1, 3, 1)));
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm_avg_epu8(even, odd));
+		}
+#endif
+		for (; x < dw; x++) {
+			for (int c = 0; c < 4; c++) {
+				int sum = r0[x * 8 + c] + r0[x * 8 + 4 + c] + r1[x * 8 + c] + r1[x * 8 + 4 + c];
+				out[x * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void downscaleRGBA(const unsigned char* src, int width, int height, int dstMax,
+	std::vector<unsigned char>& dst, int& dstWidth, int& dstHeight) {
+	//Cheap halvings first while the image is still at least twice the target.
+	std::vector<unsigned char> a, b;
+	const unsigned char* cur = src;
+	while (width >= dstMax * 2 && height >= dstMax * 2) {
+		std::vector<unsigned char>& next = (cur == a.data()) ? b : a;
+		next.resize((size_t)(width / 2) * (height / 2) * 4);
+		halveRGBA(cur, width, height, next.data());
+		cur = next.data();
+		width /= 2;
+		height /= 2;
+	}
+
+	float scale = std::min(1.0f, (float)dstMax / (float)std::max(width, height));
+	dstWidth = std::max(1, (int)(width * scale + 0.5f));
+	dstHeight = std::max(1, (int)(height * scale + 0.5f));
+	dst.resize((size_t)dstWidth * dstHeight * 4);
+
+	//Area average for the last, non power of two step.
+	for (int y = 0; y < dstHeight; y++) {
+		int sy0 = y * height / dstHeight, sy1 = std::max(sy0 + 1, (y + 1) * height / dstHeight);
+		for (int x = 0; x < dstWidth; x++) {
+			int sx0 = x * width / dstWidth, sx1 = std::max(sx0 + 1, (x + 1) * width / dstWidth);
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+			for (int sy = sy0; sy < sy1; sy++) {
+				const unsigned char* p = cur + ((size_t)sy * width + sx0) * 4;
+				for (int sx = sx0; sx < sx1; sx++, p += 4) {
+					sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+				}
+			}
+			unsigned int n = (sy1 - sy0) * (sx1 - sx0);
+			unsigned char* out = &dst[((size_t)y * dstWidth + x) * 4];
+			for (int c = 0; c < 4; c++)
+				out[c] = (unsigned char)((sum[c] + n / 2) / n);
+		}
+	}
+}
+#pragma endregion
+
+#pragma region ThumbnailService:
+bool ThumbnailService::start(std::string cacheFile, int threadCount) {
+	stop();
+	stopping = 0;
+	cachePath = cacheFile;
+
+	//Index whatever earlier sessions left in the cache file.
+	bool fresh = 1;
+	if (cacheMap.open(cachePath)) {
+		const unsigned char* data = cacheMap.getData();
+		size_t size = cacheMap.getSize(), offset = 8;
+		if (size >= 8 && ((const uint32_t*)data)[0] == THUMBCACHE_MAGIC && ((const uint32_t*)data)[1] == THUMBCACHE_VERSION) {
+			fresh = 0;
+			while (offset + sizeof(CacheRecord) <= size) {
+				CacheRecord r;
+				memcpy(&r, data + offset, sizeof(r));
+				size_t next = offset + sizeof(CacheRecord) + (size_t)r.width * r.height * 4;
+				if (next > size)
+					break; //Torn write at the end, ignore it.
+				cacheIndex[r.hash] = offset;
+				offset = next;
+			}
+		}
+		else {
+			cacheMap.close();
+		}
+	}
+
+	cacheOut.open(cachePath, std::ios::binary | (fresh ? std::ios::trunc : std::ios::app));
+	if (fresh && cacheOut.good()) {
+		uint32_t header[2] = { THUMBCACHE_MAGIC, THUMBCACHE_VERSION };
+		cacheOut.write((const char*)header, sizeof(header));
+	}
+	if (!cacheOut.good())
+		std::cout << "THUMBS: Can't write " << cachePath << ", thumbnails won't persist\n";
+
+	if (threadCount <= 0)
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	for (int i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThumbnailService::workerLoop, this);
+	return 1;
+}
+
+void ThumbnailService::stop() {
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = 1;
+	}
+	queueCv.notify_all();
+	for (std::thread& w : workers)
+		w.join();
+	workers.clear();
+	queue.clear();
+	done.clear();
+
+	//No worker is left, so everything can go now.
+	for (auto& entry : thumbnails)
+		retired.push_back(entry.second);
+	thumbnails.clear();
+	for (Thumbnail* t : retired) {
+		if (t->texture)
+			glDeleteTextures(1, &t->texture);
+		delete t;
+	}
+	retired.clear();
+
+	cacheOut.close();
+	cacheMap.close();
+	cacheIndex.clear();
+	cacheAdded.clear();
+}
+
+Thumbnail* ThumbnailService::request(std::string filepath) {
+	auto it = thumbnails.find(filepath);
+	if (it != thumbnails.end()) {
+		Thumbnail* t = it->second;
+		t->lastRequest = ++requestClock;
+		//Still waiting: move it to the front of the line, since the
+		//palette only asks for what is on screen.
+		if (t->state == Thumbnail::THUMB_PENDING) {
+			std::lock_guard<std::mutex> lock(queueMutex);
+			auto q = std::find(queue.rbegin(), queue.rend(), t);
+			if (q != queue.rend() && q != queue.rbegin()) {
+				queue.erase(std::next(q).base());
+				queue.push_back(t);
+			}
+		}
+		return t;
+	}
+
+	if (thumbnails.size() >= maxKept)
+		evict();
+	Thumbnail* t = new Thumbnail();
+	t->filepath = filepath;
+	t->lastRequest = ++requestClock;
+	thumbnails[filepath] = t;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.push_back(t);
+	}
+	queueCv.notify_one();
+	return t;
+}
+
+void ThumbnailService::release(std::string filepath) {
+	auto it = thumbnails.find(filepath);
+	if (it == thumbnails.end())
+		return;
+	Thumbnail* t = it->second;
+	thumbnails.erase(it);
+	retire(t);
+}
+
+void ThumbnailService::releaseAll() {
+	for (auto& entry : thumbnails)
+		retire(entry.second);
+	thumbnails.clear();
+}
+
+void ThumbnailService::retire(Thumbnail* t) {
+	//Not started yet: nothing else knows of it.
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		auto q = std::find(queue.begin(), queue.end(), t);
+		if (q != queue.end()) {
+			queue.erase(q);
+			delete t;
+			return;
+		}
+	}
+	t->released = 1;
+	std::lock_guard<std::mutex> lock(doneMutex);
+	retired.push_back(t);
+}
+
+void ThumbnailService::evict() {
+	//Down to three quarters in one go, so this isn't done every request.
+	std::vector<std::pair<uint64_t, std::string>> byAge;
+	byAge.reserve(thumbnails.size());
+	for (auto& entry : thumbnails)
+		byAge.push_back({ entry.second->lastRequest, entry.first });
+	size_t n = thumbnails.size() - std::min(thumbnails.size(), maxKept * 3 / 4);
+	std::nth_element(byAge.begin(), byAge.begin() + n, byAge.end());
+	for (size_t i = 0; i < n; i++)
+		release(byAge[i].second);
+}
+
+int ThumbnailService::poll(int maxUploads) {
+	std::vector<Thumbnail*> ready;
+	{
+		std::lock_guard<std::mutex> lock(doneMutex);
+		int n = std::min((int)done.size(), maxUploads);
+		ready.assign(done.begin(), done.begin() + n);
+		done.erase(done.begin(), done.begin() + n);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	int uploads = 0;
+	for (Thumbnail* t : ready) {
+		if (t->released) {
+			//Let go while a worker had it; the sweep below frees it.
+			std::vector<unsigned char>().swap(t->pixels);
+			t->state = Thumbnail::THUMB_FAILED;
+			continue;
+		}
+		glGenTextures(1, &t->texture);
+		glBindTexture(GL_TEXTURE_2D, t->texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, t->width, t->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, t->pixels.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		std::vector<unsigned char>().swap(t->pixels);
+		t->state = Thumbnail::THUMB_READY;
+		uploads++;
+	}
+	if (uploads)
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+	//Released thumbnails go once no worker has them any more: pending
+	//ones are still being made, and decoded ones are waiting in done.
+	std::lock_guard<std::mutex> lock(doneMutex);
+	size_t kept = 0;
+	for (Thumbnail* t : retired) {
+		int state = t->state;
+		if (state == Thumbnail::THUMB_PENDING || state == Thumbnail::THUMB_DECODED) {
+			retired[kept++] = t;
+			continue;
+		}
+		if (t->texture)
+			glDeleteTextures(1, &t->texture);
+		delete t;
+	}
+	retired.resize(kept);
+	return uploads;
+}
+
+void ThumbnailService::workerLoop() {
+	while (1) {
+		Thumbnail* t;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCv.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (stopping)
+				return;
+			t = queue.back();
+			queue.pop_back();
+		}
+		process(t);
+	}
+}
+
+void ThumbnailService::process(Thumbnail* t) {
+	std::ifstream file(t->filepath, std::ios::binary);
+	std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (bytes.empty()) {
+		t->state = Thumbnail::THUMB_FAILED;
+		return;
+	}
+
+	uint64_t hash = contentHash64(bytes.data(), bytes.size());
+	if (!fromCache(hash, t)) {
+		int w, h, channels;
+		unsigned char* image = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &w, &h, &channels, 4);
+		if (!image) {
+			t->state = Thumbnail::THUMB_FAILED;
+			return;
+		}
+		downscaleRGBA(image, w, h, THUMB_SIZE, t->pixels, t->width, t->height);
+		stbi_image_free(image);
+		toCache(hash, t);
+	}
+
+	t->state = Thumbnail::THUMB_DECODED;
+	std::lock_guard<std::mutex> lock(doneMutex);
+	done.push_back(t);
+}
+
+bool ThumbnailService::fromCache(uint64_t hash, Thumbnail* t) {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	const unsigned char* record = NULL;
+	auto added = cacheAdded.find(hash);
+	if (added != cacheAdded.end()) {
+		record = added->second.data();
+	}
+	else {
+		auto it = cacheIndex.find(hash);
+		if (it == cacheIndex.end())
+			return 0;
+		record = cacheMap.getData() + it->second;
+	}
+
+	CacheRecord r;
+	memcpy(&r, record, sizeof(r));
+	t->width = r.width;
+	t->height = r.height;
+	const unsigned char* pixels = record + sizeof(CacheRecord);
+	t->pixels.assign(pixels, pixels + (size_t)r.width * r.height * 4);
+	return 1;
+}
+
+void ThumbnailService::toCache(uint64_t hash, const Thumbnail* t) {
+	CacheRecord r;
+	r.hash = hash;
+	r.width = (uint16_t)t->width;
+	r.height = (uint16_t)t->height;
+
+	std::vector<unsigned char> record(sizeof(CacheRecord) + t->pixels.size());
+	memcpy(record.data(), &r, sizeof(r));
+	memcpy(record.data() + sizeof(r), t->pixels.data(), t->pixels.size());
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (cacheOut.good()) {
+		cacheOut.write((const char*)record.data(), record.size());
+		cacheOut.flush();
+	}
+	cacheAdded[hash] = std::move(record);
+}
+#pragma endregion
@@ -0,0 +1,110 @@
+#ifndef JTHUMBS_H
+#define JTHUMBS_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "jtexpack.h"
+
+const int THUMB_SIZE = 64;
+const size_t THUMB_MAX_KEPT = 4096;	//64x64 RGBA8 each, so about 64 MB of textures
+
+/// <summary>
+/// A small preview of an image for the texture palette. Starts out
+/// pending; the GL texture exists once state reaches THUMB_READY.
+/// Thumbnails keep the image's aspect ratio, so width or height
+/// may be under THUMB_SIZE.
+/// </summary>
+struct Thumbnail {
+	enum State { THUMB_PENDING, THUMB_DECODED, THUMB_READY, THUMB_FAILED };
+	std::string filepath;
+	std::atomic<int> state{ THUMB_PENDING };
+	int width = 0, height = 0;
+	std::vector<unsigned char> pixels; //RGBA8, freed after upload
+	GLuint texture = 0;
+	uint64_t lastRequest = 0;			//Main thread
+	std::atomic<bool> released{ 0 };	//Set once it is no longer in the service's map
+};
+
+/// <summary>
+/// ThumbnailService. Reads, hashes, decodes and shrinks images on
+/// worker threads so the palette can ask for thousands of previews
+/// without blocking a frame. Finished thumbnails are stored in a
+/// cache file keyed by the hash of the source file's bytes, so a
+/// renamed or copied image doesn't get decoded again.
+///
+/// request() is cheap and can be called every frame for whatever
+/// is scrolled into view; the most recent requests are served
+/// first. poll() must be called on the GL thread to upload results.
+///
+/// Past maxKept thumbnails, the ones requested longest ago are
+/// released. A released thumbnail is freed by a later poll(), once
+/// no worker has it and its texture can go on the GL thread, so a
+/// Thumbnail* is only good until the next poll() after it was
+/// released or evicted; ask again rather than keeping it.
+/// </summary>
+class ThumbnailService {
+	private:
+		#pragma pack(push, 1)
+		struct CacheRecord {
+			uint64_t hash;
+			uint16_t width, height;
+		};
+		#pragma pack(pop)
+
+		std::vector<std::thread> workers;
+		std::mutex queueMutex, cacheMutex, doneMutex;
+		std::condition_variable queueCv;
+		std::vector<Thumbnail*> queue;		//Served from the back (newest first)
+		std::vector<Thumbnail*> done;
+		std::vector<Thumbnail*> retired;	//Released, waiting for poll() to free them
+		std::map<std::string, Thumbnail*> thumbnails;
+		uint64_t requestClock = 0;
+		bool stopping = 0;
+
+		MappedFile cacheMap;
+		std::unordered_map<uint64_t, size_t> cacheIndex;	//hash -> record offset in cacheMap
+		std::unordered_map<uint64_t, std::vector<unsigned char>> cacheAdded;	//written this session
+		std::ofstream cacheOut;
+		std::string cachePath;
+
+		void workerLoop();
+		void process(Thumbnail* t);
+		bool fromCache(uint64_t hash, Thumbnail* t);
+		void toCache(uint64_t hash, const Thumbnail* t);
+		void retire(Thumbnail* t);
+		void evict();
+	public:
+		size_t maxKept = THUMB_MAX_KEPT;
+
+		~ThumbnailService() { stop(); }
+		bool start(std::string cacheFile, int threadCount = 0);
+		//Also frees every thumbnail and its texture, so the GL context
+		//must be current on the calling thread.
+		void stop();
+
+		Thumbnail* request(std::string filepath);
+		//Lets go of one thumbnail, or all of them. Main thread, like request().
+		void release(std::string filepath);
+		void releaseAll();
+		//Uploads up to maxUploads finished thumbnails and frees released
+		//ones. GL thread only.
+		int poll(int maxUploads = 32);
+		size_t getCount() const { return thumbnails.size(); }
+};
+
+//Shrinks an RGBA8 image to fit in dstMax x dstMax, keeping its aspect.
+//Halvings are done with SSE2 when available. Returns the new size.
+void downscaleRGBA(const unsigned char* src, int width, int height, int dstMax,
+	std::vector<unsigned char>& dst, int& dstWidth, int& dstHeight);
+
+extern ThumbnailService thumbnailService;
+
+#endif
@@ -0,0 +1,580 @@
+#include "jundo.h"
+#include "jbvh.h"
+#include "jsnap.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+UndoStack undoStack("MappingTool-undo");
+
+#pragma region Bytes:
+static void putBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data;
+	out.insert(out.end(), p, p + size);
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t v) {
+	putBytes(out, &v, sizeof(v));
+}
+
+//XOR of after and before, so what an edit left alone comes out zero.
+static void putDelta(std::vector<uint8_t>& out, const void* after, const void* before, size_t size) {
+	size_t start = out.size();
+	putBytes(out, after, size);
+	const uint8_t* b = (const uint8_t*)before;
+	for (size_t i = 0; i < size; i++)
+		out[start + i] ^= b[i];
+}
+
+struct ByteReader {
+	const uint8_t* p;
+	size_t left;
+
+	bool get(void* out, size_t size) {
+		if (size > left)
+			return 0;
+		memcpy(out, p, size);
+		p += size;
+		left -= size;
+		return 1;
+	}
+	bool getU32(uint32_t& v) { return get(&v, sizeof(v)); }
+	//Reads a delta saved by putDelta against before, which is already read.
+	bool getDelta(void* out, const void* before, size_t size) {
+		if (!get(out, size))
+			return 0;
+		uint8_t* o = (uint8_t*)out;
+		const uint8_t* b = (const uint8_t*)before;
+		for (size_t i = 0; i < size; i++)
+			o[i] ^= b[i];
+		return 1;
+	}
+};
+
+static void putVarint(std::vector<uint8_t>& out, size_t v) {
+	while (v >= 0x80) {
+		out.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+static bool getVarint(const uint8_t*& p, const uint8_t* end, size_t& v) {
+	v = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= (size_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return 1;
+	}
+	return 0;
+}
+
+//A small LZ77: runs of literals, each followed by a copy of earlier
+//output (offset, length). Offset 0 ends the stream. Matches are found
+//through a hash of the next 4 bytes, so it is one pass and fast; the
+//zero runs deltas are made of turn into a handful of bytes.
+static const int LZ_HASH_BITS = 14;
+static const size_t LZ_MIN_MATCH = 4;
+
+static uint32_t lzHash(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void lzCompress(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+	std::vector<int64_t> table((size_t)1 << LZ_HASH_BITS, -1);
+	size_t i = 0, anchor = 0;
+	while (i + LZ_MIN_MATCH <= size) {
+		uint32_t h = lzHash(in + i);
+		int64_t candidate = table[h];
+		table[h] = (int64_t)i;
+		if (candidate < 0 || memcmp(in + candidate, in + i, LZ_MIN_MATCH) != 0) {
+			i++;
+			continue;
+		}
+		size_t length = LZ_MIN_MATCH;
+		while (i + length < size && in[candidate + length] == in[i + length])
+			length++;
+		putVarint(out, i - anchor);
+		putBytes(out, in + anchor, i - anchor);
+		putVarint(out, i - (size_t)candidate);
+		putVarint(out, length);
+		i += length;
+		anchor = i;
+	}
+	putVarint(out, size - anchor);
+	putBytes(out, in + anchor, size - anchor);
+	putVarint(out, 0);
+}
+
+static bool lzDecompress(const uint8_t* in, size_t size, std::vector<uint8_t>& out, size_t rawSize) {
+	out.clear();
+	out.reserve(rawSize);
+	const uint8_t* p = in;
+	const uint8_t* end = in + size;
+	while (1) {
+		size_t literals, offset, length;
+		if (!getVarint(p, end, literals) || literals > (size_t)(end - p) || out.size() + literals > rawSize)
+			return 0;
+		out.insert(out.end(), p, p + literals);
+		p += literals;
+		if (!getVarint(p, end, offset))
+			return 0;
+		if (offset == 0)
+			return out.size() == rawSize;
+		if (!getVarint(p, end, length) || offset > out.size() || out.size() + length > rawSize)
+			return 0;
+		//Byte by byte: a match may overlap what it is copying.
+		size_t from = out.size() - offset;
+		for (size_t k = 0; k < length; k++)
+			out.push_back(out[from + k]);
+	}
+}
+#pragma endregion
+
+#pragma region Commands:
+void TransformCommand::undo(EntityStore& store, [[maybe_unused]] RenderPacket& packet) {
+	for (size_t i = 0; i < entities.size(); i++) {
+		if (store.transforms.has(entities[i]))
+			store.transforms.setLocal(entities[i], before[i]);
+	}
+}
+
+void TransformCommand::redo(EntityStore& store, [[maybe_unused]] RenderPacket& packet) {
+	for (size_t i = 0; i < entities.size(); i++) {
+		if (store.transforms.has(entities[i]))
+			store.transforms.setLocal(entities[i], after[i]);
+	}
+}
+
+size_t TransformCommand::memoryBytes() const {
+	return sizeof(*this) + entities.size() * (sizeof(Entity) + 2 * sizeof(glm::mat4));
+}
+
+void TransformCommand::save(std::vector<uint8_t>& out) const {
+	putU32(out, (uint32_t)entities.size());
+	putBytes(out, entities.data(), entities.size() * sizeof(Entity));
+	putBytes(out, before.data(), before.size() * sizeof(glm::mat4));
+	putDelta(out, after.data(), before.data(), after.size() * sizeof(glm::mat4));
+}
+
+bool TransformCommand::load(const uint8_t* data, size_t size) {
+	ByteReader r = { data, size };
+	uint32_t count;
+	if (!r.getU32(count) || count > size / sizeof(Entity))
+		return 0;
+	entities.resize(count);
+	before.resize(count);
+	after.resize(count);
+	return r.get(entities.data(), count * sizeof(Entity)) && r.get(before.data(), count * sizeof(glm::mat4))
+		&& r.getDelta(after.data(), before.data(), count * sizeof(glm::mat4));
+}
+
+//Queues the GPU copy of vertices [first, first + count) for the next frame.
+static void uploadVertices(Mesh* m, uint32_t first, uint32_t count, RenderPacket& packet) {
+	if (!m->getVertexBuffer() || count == 0)
+		return;
+	BufferWrite w;
+	w.buffer = m->getVertexBuffer();
+	w.offset = (GLintptr)first * sizeof(Vertex);
+	w.dataStart = packet.writeData.size();
+	w.size = count * sizeof(Vertex);
+	putBytes(packet.writeData, m->getVertices() + first, w.size);
+	packet.bufferWrites.push_back(w);
+}
+
+//Trees built from the mesh's old vertices are redone next update(),
+//and the entities using it get its new bounds.
+static void meshChanged(EntityStore& store, MeshHandle h) {
+	scenePicker.invalidate(h);
+	vertexSnapper.invalidate(h);
+	store.meshBoundsChanged(h);
+}
+
+void GeometryCommand::apply(EntityStore& store, const std::vector<UndoChunk>& state, RenderPacket& packet) {
+	Mesh* m = meshHandles.get(mesh);
+	if (!m)
+		return;
+	std::vector<UndoChunk>& current = owner->meshChunks[mesh.value];
+	current.resize((m->getVertexCount() + UNDO_CHUNK_VERTICES - 1) / UNDO_CHUNK_VERTICES);
+	for (size_t i = 0; i < chunks.size(); i++) {
+		uint32_t first = chunks[i] * UNDO_CHUNK_VERTICES;
+		uint32_t count = (uint32_t)(state[i]->size() / sizeof(Vertex));
+		m->writeVertices(first, count, (const Vertex*)state[i]->data());
+		uploadVertices(m, first, count, packet);
+		current[chunks[i]] = state[i];
+	}
+	meshChanged(store, mesh);
+}
+
+void GeometryCommand::undo(EntityStore& store, RenderPacket& packet) {
+	apply(store, before, packet);
+}
+
+void GeometryCommand::redo(EntityStore& store, RenderPacket& packet) {
+	apply(store, after, packet);
+}
+
+void GeometryCommand::save(std::vector<uint8_t>& out) const {
+	putU32(out, mesh.value);
+	putU32(out, (uint32_t)chunks.size());
+	for (size_t i = 0; i < chunks.size(); i++) {
+		putU32(out, chunks[i]);
+		putU32(out, (uint32_t)before[i]->size());
+		putBytes(out, before[i]->data(), before[i]->size());
+		putDelta(out, after[i]->data(), before[i]->data(), after[i]->size());
+	}
+}
+
+bool GeometryCommand::load(const uint8_t* data, size_t size) {
+	ByteReader r = { data, size };
+	uint32_t count;
+	if (!r.getU32(mesh.value) || !r.getU32(count))
+		return 0;
+	ownedBytes = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t chunk, bytes;
+		if (!r.getU32(chunk) || !r.getU32(bytes) || 2 * (size_t)bytes > r.left)
+			return 0;
+		std::shared_ptr<std::vector<uint8_t>> b = std::make_shared<std::vector<uint8_t>>(bytes);
+		std::shared_ptr<std::vector<uint8_t>> a = std::make_shared<std::vector<uint8_t>>(bytes);
+		r.get(b->data(), bytes);
+		r.getDelta(a->data(), b->data(), bytes);
+		chunks.push_back(chunk);
+		before.push_back(b);
+		after.push_back(a);
+		ownedBytes += 2 * (size_t)bytes;
+	}
+	return 1;
+}
+#pragma endregion
+
+#pragma region UndoStack:
+UndoStack::~UndoStack() {
+	clear();
+}
+
+UndoChunk UndoStack::captureChunk(Mesh* m, uint32_t c) {
+	uint32_t first = c * UNDO_CHUNK_VERTICES;
+	uint32_t count = std::min(UNDO_CHUNK_VERTICES, m->getVertexCount() - first);
+	const uint8_t* p = (const uint8_t*)(m->getVertices() + first);
+	return std::make_shared<const std::vector<uint8_t>>(p, p + count * sizeof(Vertex));
+}
+
+void UndoStack::push(UndoCommand* c) {
+	//A new edit: whatever could have been redone is gone. Its journal
+	//space is left alone until clear().
+	for (size_t i = cursor; i < entries.size(); i++) {
+		if (entries[i].command)
+			memory -= entries[i].command->memoryBytes();
+	}
+	entries.resize(cursor);
+	Entry e;
+	e.kind = c->kind();
+	e.command.reset(c);
+	memory += c->memoryBytes();
+	entries.push_back(std::move(e));
+	cursor = entries.size();
+	spillScan = std::min(spillScan, entries.size() - 1);
+	enforceCap();
+}
+
+bool UndoStack::spill(Entry& e) {
+	if (!e.journalBytes) {
+		std::vector<uint8_t> raw, packed;
+		putU32(raw, e.kind);
+		e.command->save(raw);
+		lzCompress(raw.data(), raw.size(), packed);
+		if (!journal.is_open()) {
+			std::filesystem::path path = std::filesystem::temp_directory_path() / (journalName + ".journal");
+			journal.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!journal.is_open()) {
+				std::cout << "UNDO: could not open the journal at " << path.string() << ", keeping history in memory\n";
+				return 0;
+			}
+			journalEnd = 0;
+		}
+		journal.seekp((std::streamoff)journalEnd);
+		journal.write((const char*)packed.data(), packed.size());
+		if (!journal) {
+			std::cout << "UNDO: could not write the journal, keeping history in memory\n";
+			journal.clear();
+			return 0;
+		}
+		e.journalOffset = journalEnd;
+		e.journalBytes = (uint32_t)packed.size();
+		e.rawBytes = (uint32_t)raw.size();
+		journalEnd += packed.size();
+	}
+	memory -= e.command->memoryBytes();
+	e.command.reset();
+	spills++;
+	return 1;
+}
+
+bool UndoStack::bringBack(Entry& e) {
+	std::vector<uint8_t> packed(e.journalBytes), raw;
+	journal.flush();
+	journal.seekg((std::streamoff)e.journalOffset);
+	journal.read((char*)packed.data(), packed.size());
+	if (!journal || !lzDecompress(packed.data(), packed.size(), raw, e.rawBytes) || raw.size() < sizeof(uint32_t)) {
+		std::cout << "UNDO: could not read history back from the journal\n";
+		journal.clear();
+		return 0;
+	}
+	uint32_t kind;
+	memcpy(&kind, raw.data(), sizeof(kind));
+	const uint8_t* body = raw.data() + sizeof(kind);
+	size_t bodySize = raw.size() - sizeof(kind);
+	bool ok = 0;
+	if (kind == UNDO_TRANSFORM) {
+		TransformCommand* t = new TransformCommand();
+		e.command.reset(t);
+		ok = t->load(body, bodySize);
+	}
+	else if (kind == UNDO_GEOMETRY) {
+		GeometryCommand* g = new GeometryCommand(this);
+		e.command.reset(g);
+		ok = g->load(body, bodySize);
+	}
+	if (!ok) {
+		std::cout << "UNDO: history in the journal is damaged\n";
+		e.command.reset();
+		return 0;
+	}
+	memory += e.command->memoryBytes();
+	loads++;
+	return 1;
+}
+
+void UndoStack::enforceCap() {
+	//Oldest first; a command read back for undo goes out again as soon
+	//as it is the oldest one left, which costs nothing since it is
+	//already in the journal.
+	for (size_t i = spillScan; i < entries.size() && memory > memoryCap; i++) {
+		if (entries[i].command && !spill(entries[i]))
+			break;
+	}
+	while (spillScan < entries.size() && !entries[spillScan].command)
+		spillScan++;
+}
+
+void UndoStack::setLocal(EntityStore& store, const Entity* list, const glm::mat4* after, uint32_t count) {
+	TransformCommand* t = new TransformCommand();
+	t->entities.reserve(count);
+	t->before.reserve(count);
+	t->after.reserve(count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (!store.transforms.has(list[i]))
+			continue;
+		t->entities.push_back(list[i]);
+		t->before.push_back(store.transforms.local[store.transforms.indexOf(list[i])]);
+		t->after.push_back(after[i]);
+		store.transforms.setLocal(list[i], after[i]);
+	}
+	push(t);
+}
+
+void UndoStack::recordMove(const Entity* list, const glm::mat4* before, const glm::mat4* after, uint32_t count) {
+	TransformCommand* t = new TransformCommand();
+	t->entities.assign(list, list + count);
+	t->before.assign(before, before + count);
+	t->after.assign(after, after + count);
+	push(t);
+}
+
+bool UndoStack::editVertices(EntityStore& store, MeshHandle h, uint32_t first, uint32_t count, const Vertex* vertices, RenderPacket& packet) {
+	Mesh* m = meshHandles.get(h);
+	if (!m || count == 0 || first >= m->getVertexCount() || count > m->getVertexCount() - first)
+		return 0;
+	std::vector<UndoChunk>& current = meshChunks[h.value];
+	current.resize((m->getVertexCount() + UNDO_CHUNK_VERTICES - 1) / UNDO_CHUNK_VERTICES);
+
+	//Only the chunks the range touches: the current one is the before
+	//state (made now if the chunk was never edited), a copy with the
+	//range written in is the after state and the new current one.
+	GeometryCommand* g = new GeometryCommand(this);
+	g->mesh = h;
+	uint32_t last = first + count;
+	for (uint32_t c = first / UNDO_CHUNK_VERTICES; c <= (last - 1) / UNDO_CHUNK_VERTICES; c++) {
+		if (!current[c]) {
+			current[c] = captureChunk(m, c);
+			g->ownedBytes += current[c]->size();
+		}
+		std::shared_ptr<std::vector<uint8_t>> copy = std::make_shared<std::vector<uint8_t>>(*current[c]);
+		uint32_t chunkFirst = c * UNDO_CHUNK_VERTICES;
+		uint32_t chunkLast = chunkFirst + (uint32_t)(copy->size() / sizeof(Vertex));
+		uint32_t lo = std::max(first, chunkFirst), hi = std::min(last, chunkLast);
+		memcpy(copy->data() + (lo - chunkFirst) * sizeof(Vertex), vertices + (lo - first), (hi - lo) * sizeof(Vertex));
+		g->chunks.push_back(c);
+		g->before.push_back(current[c]);
+		g->after.push_back(copy);
+		g->ownedBytes += copy->size();
+		current[c] = copy;
+	}
+	m->writeVertices(first, count, vertices);
+	uploadVertices(m, first, count, packet);
+	meshChanged(store, h);
+	push(g);
+	return 1;
+}
+
+bool UndoStack::undo(EntityStore& store, RenderPacket& packet) {
+	if (!canUndo())
+		return 0;
+	Entry& e = entries[cursor - 1];
+	if (!e.command) {
+		if (!bringBack(e))
+			return 0;
+		spillScan = std::min(spillScan, cursor - 1);
+	}
+	e.command->undo(store, packet);
+	cursor--;
+	enforceCap();
+	return 1;
+}
+
+bool UndoStack::redo(EntityStore& store, RenderPacket& packet) {
+	if (!canRedo())
+		return 0;
+	Entry& e = entries[cursor];
+	if (!e.command) {
+		if (!bringBack(e))
+			return 0;
+		spillScan = std::min(spillScan, cursor);
+	}
+	e.command->redo(store, packet);
+	cursor++;
+	enforceCap();
+	return 1;
+}
+
+void UndoStack::clear() {
+	entries.clear();
+	meshChunks.clear();
+	cursor = memory = spillScan = 0;
+	if (journal.is_open()) {
+		journal.close();
+		std::error_code ec;
+		std::filesystem::remove(std::filesystem::temp_directory_path() / (journalName + ".journal"), ec);
+	}
+	journalEnd = 0;
+}
+
+void UndoStack::printStats() {
+	size_t inMemory = 0;
+	for (const Entry& e : entries)
+		inMemory += e.command != NULL;
+	std::cout << "UNDO: " << entries.size() << " edits (" << cursor << " can be undone), " << inMemory << " in memory using "
+		<< memory / 1024 << " KB, " << journalEnd / 1024 << " KB in the journal; " << spills << " spilled, " << loads << " read back\n";
+}
+#pragma endregion
+
+#pragma region Benchmark:
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void undoBenchmark() {
+	const uint32_t OBJECTS = 10000, EDITS = 300, EDIT_VERTICES = 3000;
+	const int TERRAIN = 256;	//Vertices a side, as many as 16-bit indices reach
+	const size_t GEOMETRY_CAP = 1 << 20;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	RenderPacket packet;
+
+	//Moving every object at once.
+	EntityStore store;
+	UndoStack moves("MappingTool-undo-benchmark-moves");
+	std::vector<Entity> entities(OBJECTS);
+	std::vector<glm::mat4> placed(OBJECTS), moved(OBJECTS);
+	for (uint32_t i = 0; i < OBJECTS; i++) {
+		entities[i] = store.create();
+		placed[i] = glm::translate(glm::mat4(1.0f), glm::vec3(unit(rng), unit(rng), unit(rng)) * 500.0f);
+		moved[i] = glm::translate(placed[i], glm::vec3(5.0f, 0.0f, 0.0f));
+		store.transforms.add(entities[i], placed[i]);
+	}
+	store.transforms.update();
+	auto matches = [&](const std::vector<glm::mat4>& expected) {
+		for (uint32_t i = 0; i < OBJECTS; i++) {
+			if (store.transforms.local[store.transforms.indexOf(entities[i])] != expected[i])
+				return 0;
+		}
+		return 1;
+	};
+	auto start = std::chrono::high_resolution_clock::now();
+	moves.setLocal(store, entities.data(), moved.data(), OBJECTS);
+	double record = msSince(start);
+	start = std::chrono::high_resolution_clock::now();
+	moves.undo(store, packet);
+	double undone = msSince(start);
+	bool undoOk = matches(placed);
+	start = std::chrono::high_resolution_clock::now();
+	moves.redo(store, packet);
+	double redone = msSince(start);
+	bool redoOk = matches(moved);
+	std::cout << "UNDO: " << OBJECTS << " objects moved: recorded in " << record << " ms, undone in " << undone << " ms, redone in "
+		<< redone << " ms, " << moves.getMemoryBytes() / 1024 << " KB of history\n";
+	if (!undoOk || !redoOk)
+		std::cout << "UNDO: the move did not come back exactly!\n";
+
+	//Vertex edits on one big mesh, most of them pushed out to the journal.
+	ArenaMark mark = mapArena.mark();
+	aiMesh* source = makeTestTerrain(TERRAIN, 0.3f);
+	Mesh* mesh = mapArena.create<Mesh>(source);
+	delete source;
+	MeshHandle handle = meshHandles.insert(mesh);
+	uint32_t vertexCount = mesh->getVertexCount();
+	std::vector<Vertex> original(mesh->getVertices(), mesh->getVertices() + vertexCount);
+
+	UndoStack edits("MappingTool-undo-benchmark");
+	edits.memoryCap = GEOMETRY_CAP;
+	std::vector<Vertex> brush(EDIT_VERTICES);
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < EDITS; i++) {
+		uint32_t first = rng() % (vertexCount - EDIT_VERTICES);
+		memcpy(brush.data(), mesh->getVertices() + first, EDIT_VERTICES * sizeof(Vertex));
+		for (uint32_t k = 0; k < EDIT_VERTICES; k++)
+			brush[k].position.y += 0.5f * sinf(k * 3.14159265f / EDIT_VERTICES);
+		edits.editVertices(store, handle, first, EDIT_VERTICES, brush.data(), packet);
+		packet.clear();
+	}
+	double editing = msSince(start);
+	std::vector<Vertex> edited(mesh->getVertices(), mesh->getVertices() + vertexCount);
+	std::cout << "UNDO: " << EDITS << " edits of " << EDIT_VERTICES << " vertices on a " << vertexCount << " vertex mesh in " << editing << " ms; "
+		<< edits.getMemoryBytes() / 1024 << " KB in memory, " << edits.getJournalBytes() / 1024 << " KB in the journal, against "
+		<< (size_t)EDITS * vertexCount * sizeof(Vertex) / 1024 << " KB of full copies\n";
+
+	start = std::chrono::high_resolution_clock::now();
+	uint32_t steps = 0;
+	while (edits.undo(store, packet)) {
+		packet.clear();
+		steps++;
+	}
+	double undoing = msSince(start);
+	undoOk = steps == EDITS && memcmp(mesh->getVertices(), original.data(), vertexCount * sizeof(Vertex)) == 0;
+	start = std::chrono::high_resolution_clock::now();
+	steps = 0;
+	while (edits.redo(store, packet)) {
+		packet.clear();
+		steps++;
+	}
+	double redoing = msSince(start);
+	redoOk = steps == EDITS && memcmp(mesh->getVertices(), edited.data(), vertexCount * sizeof(Vertex)) == 0;
+	std::cout << "UNDO: all undone in " << undoing << " ms, redone in " << redoing << " ms\n";
+	edits.printStats();
+	if (!undoOk || !redoOk)
+		std::cout << "UNDO: the vertex edits did not come back exactly!\n";
+
+	edits.clear();
+	meshHandles.remove(handle);
+	mapArena.rewind(mark);
+}
+#pragma endregion
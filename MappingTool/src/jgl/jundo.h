@@ -0,0 +1,170 @@
+#ifndef JUNDO_H
+#define JUNDO_H
+
+#include <fstream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include "jbufferqueue.h"
+#include "jecs.h"
+#include "jmodule.h"
+
+///
+/// Undo and redo. Every edit is a command that holds what it changed,
+/// before and after, and nothing else: moving 10k objects keeps 10k
+/// pairs of local matrices, and undoing it is 10k setLocal() calls.
+///
+/// Vertex edits go through copy-on-write chunks. A mesh's vertices are
+/// cut into UNDO_CHUNK_VERTICES pieces; a chunk is immutable once made
+/// and shared by reference count. An edit copies only the chunks it
+/// touches, keeps the old ones as its before state and the copies as
+/// its after state, and the next edit's before state is that same
+/// after chunk. So history grows by the chunks edits touched, however
+/// big the mesh is.
+///
+/// Past memoryCap, the oldest commands are compressed and appended to
+/// a journal file in the temp directory, and read back in if undo or
+/// redo gets to them. Chunks are saved as their XOR with the before
+/// chunk and matrices as their XOR with the before matrix, so what an
+/// edit left alone is zeros, which compress to next to nothing.
+///
+
+const uint32_t UNDO_CHUNK_VERTICES = 1024;
+const size_t UNDO_MEMORY_CAP = 64 << 20;	//Bytes of history kept in memory
+
+typedef std::shared_ptr<const std::vector<uint8_t>> UndoChunk;
+
+enum UndoKind : uint32_t {
+	UNDO_TRANSFORM = 1,
+	UNDO_GEOMETRY = 2
+};
+
+/// <summary>
+/// UndoCommand. One edit, able to undo and redo itself against the
+/// scene and meshes, and to save itself for the journal.
+/// </summary>
+class UndoCommand {
+	public:
+		virtual ~UndoCommand() {}
+		virtual UndoKind kind() const = 0;
+		virtual void undo(EntityStore& store, RenderPacket& packet) = 0;
+		virtual void redo(EntityStore& store, RenderPacket& packet) = 0;
+		//Bytes only this command keeps alive.
+		virtual size_t memoryBytes() const = 0;
+		virtual void save(std::vector<uint8_t>& out) const = 0;
+};
+
+/// <summary>
+/// TransformCommand. New local matrices for a set of entities.
+/// Entities destroyed since are passed over.
+/// </summary>
+class TransformCommand : public UndoCommand {
+	public:
+		std::vector<Entity> entities;
+		std::vector<glm::mat4> before, after;
+
+		UndoKind kind() const { return UNDO_TRANSFORM; }
+		void undo(EntityStore& store, RenderPacket& packet);
+		void redo(EntityStore& store, RenderPacket& packet);
+		size_t memoryBytes() const;
+		void save(std::vector<uint8_t>& out) const;
+		bool load(const uint8_t* data, size_t size);
+};
+
+class UndoStack;
+
+/// <summary>
+/// GeometryCommand. Some chunks of one mesh's vertices, before and
+/// after. Chunks may be shared with neighbouring commands and with
+/// the stack's record of each mesh's current chunks.
+/// </summary>
+class GeometryCommand : public UndoCommand {
+	private:
+		UndoStack* owner = NULL;
+		void apply(EntityStore& store, const std::vector<UndoChunk>& state, RenderPacket& packet);
+	public:
+		MeshHandle mesh;
+		std::vector<uint32_t> chunks;			//Chunk indices, ascending
+		std::vector<UndoChunk> before, after;	//By chunks entry
+		size_t ownedBytes = 0;					//Of chunks first made for this command
+
+		GeometryCommand(UndoStack* ownerIn) : owner(ownerIn) {}
+		UndoKind kind() const { return UNDO_GEOMETRY; }
+		void undo(EntityStore& store, RenderPacket& packet);
+		void redo(EntityStore& store, RenderPacket& packet);
+		size_t memoryBytes() const { return ownedBytes; }
+		void save(std::vector<uint8_t>& out) const;
+		bool load(const uint8_t* data, size_t size);
+};
+
+/// <summary>
+/// UndoStack. Main thread only. Edits made through it are recorded;
+/// undo() and redo() walk the history. Making an edit drops whatever
+/// could have been redone.
+/// </summary>
+class UndoStack {
+	private:
+		struct Entry {
+			std::unique_ptr<UndoCommand> command;	//NULL while only in the journal
+			UndoKind kind;
+			uint64_t journalOffset = 0;
+			uint32_t journalBytes = 0, rawBytes = 0;	//0 until saved
+		};
+		std::vector<Entry> entries;
+		size_t cursor = 0;			//entries[0, cursor) can be undone, the rest redone
+		size_t memory = 0;			//memoryBytes() of the entries in memory
+		size_t spillScan = 0;		//No entry below this is in memory
+		std::string journalName;
+		std::fstream journal;
+		uint64_t journalEnd = 0;
+		std::unordered_map<uint32_t, std::vector<UndoChunk>> meshChunks;	//Current chunks of edited meshes, by MeshHandle value; NULL = never edited
+		uint64_t spills = 0, loads = 0;
+
+		void push(UndoCommand* c);
+		bool spill(Entry& e);
+		bool bringBack(Entry& e);
+		void enforceCap();
+		//Makes chunk c of mesh m from the mesh as it is now.
+		UndoChunk captureChunk(Mesh* m, uint32_t c);
+
+		friend class GeometryCommand;
+	public:
+		size_t memoryCap = UNDO_MEMORY_CAP;
+
+		UndoStack(const char* journalNameIn) : journalName(journalNameIn) {}
+		~UndoStack();
+
+		//Sets the local matrices of count entities and records it.
+		void setLocal(EntityStore& store, const Entity* list, const glm::mat4* after, uint32_t count);
+		//Records a move that was already made, by a drag say, that
+		//took list from before to after.
+		void recordMove(const Entity* list, const glm::mat4* before, const glm::mat4* after, uint32_t count);
+		//Overwrites vertices [first, first + count) of a mesh and records
+		//it. The GPU copy is updated through packet, and the bounds of
+		//the entities using the mesh in store. Returns 0 if the mesh is
+		//gone or the range is past its end.
+		bool editVertices(EntityStore& store, MeshHandle h, uint32_t first, uint32_t count, const Vertex* vertices, RenderPacket& packet);
+
+		bool undo(EntityStore& store, RenderPacket& packet);
+		bool redo(EntityStore& store, RenderPacket& packet);
+		bool canUndo() const { return cursor > 0; }
+		bool canRedo() const { return cursor < entries.size(); }
+
+		//Forgets the history and empties the journal.
+		void clear();
+		size_t getMemoryBytes() const { return memory; }
+		uint64_t getJournalBytes() const { return journalEnd; }
+		void printStats();
+};
+
+extern UndoStack undoStack;
+
+//Undoes and redoes a 10k-object move, then a run of vertex edits on a
+//large mesh under a small memory cap, so most of it goes through the
+//journal, and checks every step comes back exactly.
+void undoBenchmark();
+
+#endif
@@ -0,0 +1,69 @@
+#version 330 core
+
+in vec3 nearPoint;
+in vec3 farPoint;
+
+uniform mat4 VP;
+uniform vec3 eye;
+uniform float level;		// Height (y) of the plane
+uniform float spacing;		// Between minor lines
+uniform float majorEvery;	// Minor lines per major line
+uniform float maxDistance;	// Faded out completely past this
+
+layout(location = 0) out vec4 diffuseColor;
+
+// How much of this pixel is covered by a line of the grid with cells of
+// size cell, about a pixel wide at any distance: the distance to the
+// nearest line is measured in pixels using coordWidth, the screen-space
+// derivatives of coord.
+float lineCoverage(vec2 coord, vec2 coordWidth, float cell, out float density) {
+	vec2 c = coord / cell;
+	vec2 width = coordWidth / cell;
+	vec2 toLine = abs(fract(c - 0.5) - 0.5) / max(width, vec2(1e-6));
+	// Cells under a few pixels would only shimmer; fade them out first.
+	density = max(width.x, width.y);
+	return 1.0 - min(min(toLine.x, toLine.y), 1.0);
+}
+
+void main(void)
+{
+	// The view ray through this pixel against the plane y = level.
+	float dy = farPoint.y - nearPoint.y;
+	float t = (level - nearPoint.y) / (abs(dy) > 1e-6 ? dy : 1e-6);
+	vec3 p = mix(nearPoint, farPoint, t);
+	// Derivatives before any discard: once pixels of a quad have been
+	// discarded, they are undefined for the rest of it.
+	vec2 pWidth = fwidth(p.xz);
+	if (t <= 0.0 || t > 1.0)
+		discard;
+
+	float minorDensity, majorDensity;
+	float minor = lineCoverage(p.xz, pWidth, spacing, minorDensity);
+	float major = lineCoverage(p.xz, pWidth, spacing * majorEvery, majorDensity);
+	minor *= 1.0 - smoothstep(0.15, 0.4, minorDensity);
+	major *= 1.0 - smoothstep(0.15, 0.4, majorDensity);
+
+	vec3 color = vec3(0.6);
+	float alpha = max(minor * 0.35, major * 0.7);
+	if (major > 0.0)
+		color = vec3(0.75);
+	// The world axes, x in red and z in blue, where they cross the plane.
+	vec2 axis = 1.0 - min(abs(p.zx) / max(pWidth.yx, vec2(1e-6)), 1.0);
+	if (axis.x > 0.0) {
+		color = vec3(0.9, 0.25, 0.25);
+		alpha = max(alpha, axis.x * 0.9);
+	}
+	if (axis.y > 0.0) {
+		color = vec3(0.25, 0.4, 0.9);
+		alpha = max(alpha, axis.y * 0.9);
+	}
+
+	alpha *= 1.0 - smoothstep(0.5 * maxDistance, maxDistance, length(p - eye));
+	if (alpha <= 0.0)
+		discard;
+
+	// The plane's own depth, so the scene hides it where it should.
+	vec4 clip = VP * vec4(p, 1);
+	gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+	diffuseColor = vec4(color, alpha);
+}
\ No newline at end of file
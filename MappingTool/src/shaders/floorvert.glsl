@@ -0,0 +1,20 @@
+#version 330 core
+
+// One triangle that covers the screen, made from gl_VertexID; no buffers.
+uniform mat4 invVP;
+
+out vec3 nearPoint;
+out vec3 farPoint;
+
+vec3 unproject(vec2 ndc, float z) {
+	vec4 p = invVP * vec4(ndc, z, 1);
+	return p.xyz / p.w;
+}
+
+void main(){
+	vec2 ndc = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);
+	// Where the pixel's view ray crosses the near and far planes.
+	nearPoint = unproject(ndc, -1.0);
+	farPoint = unproject(ndc, 1.0);
+	gl_Position = vec4(ndc, 0, 1);
+}
\ No newline at end of file
@@ -4,6 +4,7 @@ in vec3 normal;
 in vec2 uv;
 
 uniform sampler2D tex;
+uniform float alphaCutoff;
 
 layout(location = 0) out vec4 diffuseColor;
 
@@ -21,5 +22,9 @@ void main(void)
 
 	// finally, sample from the texuture and multiply in the light.
 	diffuseColor = texture(tex, uv);
+	// Alpha test, for materials that ask for cut-outs; 0 otherwise, so
+	// translucent texels still show.
+	if (diffuseColor.a < alphaCutoff)
+		discard;
 	//diffuseColor = vec4(0.5, 0.0, 0.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 normal;
+in float opacity;
+
+layout(location = 0) out vec4 diffuseColor;
+
+void main(void)
+{
+	// White, a little darker underneath so the spheres read as round.
+	float shade = 0.8 + 0.2 * normalize(normal).y;
+	diffuseColor = vec4(vec3(shade), opacity);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 330 core
+
+layout(location = 0) in vec3 modelSpaceIn;
+layout(location = 3) in vec4 instanceIn;	// Center (xyz) and opacity (w), one per sphere
+
+uniform mat4 VP;
+uniform float radius;
+
+out vec3 normal;
+out float opacity;
+
+void main(){
+	gl_Position = VP * vec4(instanceIn.xyz + modelSpaceIn * radius, 1);
+	// A unit sphere is its own normal.
+	normal = modelSpaceIn;
+	opacity = instanceIn.w;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 330 core
+
+in vec3 worldPos;
+flat in vec3 center;
+flat in float opacity;
+
+uniform mat4 VP;
+uniform float radius;
+uniform vec3 eye;
+
+layout(location = 0) out vec4 diffuseColor;
+
+void main(void)
+{
+	// The view ray through this pixel against the exact sphere. The
+	// squared miss distance comes from the closest approach rather than
+	// |eye - center|^2 - r^2, which loses the small radius to rounding
+	// at a distance.
+	vec3 dir = normalize(worldPos - eye);
+	vec3 toCenter = center - eye;
+	float along = dot(toCenter, dir);
+	vec3 closest = toCenter - dir * along;
+	float h = radius * radius - dot(closest, closest);
+	if (h < 0.0)
+		discard;
+	vec3 hit = eye + dir * (along - sqrt(h));
+	vec3 normal = (hit - center) / radius;
+
+	// The sphere's own depth, not the quad's.
+	vec4 clip = VP * vec4(hit, 1);
+	gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+	// Same look as ghostfrag.glsl.
+	float shade = 0.8 + 0.2 * normal.y;
+	diffuseColor = vec4(vec3(shade), opacity);
+}
\ No newline at end of file
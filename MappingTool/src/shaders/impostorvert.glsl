@@ -0,0 +1,36 @@
+#version 330 core
+
+layout(location = 3) in vec4 instanceIn;	// Center (xyz) and opacity (w), one per sphere
+
+uniform mat4 VP;
+uniform float radius;
+uniform vec3 eye;
+
+out vec3 worldPos;
+flat out vec3 center;
+flat out float opacity;
+
+void main(){
+	center = instanceIn.xyz;
+	opacity = instanceIn.w;
+	vec3 axis = center - eye;
+	float dist = length(axis);
+	// Camera inside the sphere: nothing sensible to draw, so put the
+	// quad outside clip space.
+	if (dist <= radius * 1.001) {
+		worldPos = center;
+		gl_Position = vec4(2, 2, 2, 1);
+		return;
+	}
+	axis /= dist;
+	vec3 side = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0)));
+	vec3 up = cross(side, axis);
+
+	// A quad through the center, facing the camera, as wide as the
+	// cone of rays touching the sphere is there, so it covers exactly
+	// the sphere's outline.
+	float halfSize = radius * dist / sqrt(dist * dist - radius * radius);
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	worldPos = center + (side * corner.x + up * corner.y) * halfSize;
+	gl_Position = VP * vec4(worldPos, 1);
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+
+in vec2 uv;
+
+uniform sampler2D tex;
+uniform uint entity;
+uniform uint part;
+uniform float alphaCutoff;
+
+layout(location = 0) out uvec4 id;
+
+void main(void)
+{
+	// Clicks go through nearly clear texels, whether or not the main
+	// pass cuts them out too.
+	if (texture(tex, uv).a < alphaCutoff)
+		discard;
+
+	// The triangle is counted from the start of the draw, which is
+	// the mesh's own index order.
+	id = uvec4(entity, part, uint(gl_PrimitiveID), floatBitsToUint(gl_FragCoord.z));
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+layout(location = 0) in vec3 modelSpaceIn;
+layout(location = 2) in vec2 uvIn;
+
+uniform mat4 M;
+uniform mat4 VP;
+
+out vec2 uv;
+
+void main(){
+	gl_Position = VP * M * vec4(modelSpaceIn, 1);
+	uv = uvIn;
+}
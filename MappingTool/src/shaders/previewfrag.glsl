@@ -0,0 +1,15 @@
+#version 330 core
+
+in vec3 worldPosition;
+
+uniform vec4 color;
+
+layout(location = 0) out vec4 diffuseColor;
+
+void main(void)
+{
+	// Previews carry no normals; the face's own, from the derivatives, is enough to shade by.
+	vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));
+	float shade = 0.7 + 0.3 * abs(normal.y);
+	diffuseColor = vec4(color.rgb * shade, color.a);
+}
\ No newline at end of file
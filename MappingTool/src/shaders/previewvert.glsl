@@ -0,0 +1,12 @@
+#version 330 core
+
+layout(location = 0) in vec3 worldSpaceIn;	// Streamed each frame, already in world space
+
+uniform mat4 VP;
+
+out vec3 worldPosition;
+
+void main(){
+	gl_Position = VP * vec4(worldSpaceIn, 1);
+	worldPosition = worldSpaceIn;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+///
+/// TexPacker: command-line tool that bakes a directory of loose
+/// images into a single memory-mappable texture pack (.jtp).
+///
+/// Usage: TexPacker <output.jtp> <textureDir>
+///
+/// Every .jpg/.jpeg/.png/.tga/.bmp under textureDir is decoded,
+/// given a full mip chain and stored under its path relative to
+/// textureDir. Put the pack in that same directory and the tool
+/// will find it through texturePack.open() at startup.
+///
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <jgl/jtexpack.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+namespace fs = std::filesystem;
+
+bool isImage(const fs::path& p) {
+	std::string ext = p.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+	return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".tga" || ext == ".bmp";
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		std::cout << "Usage: TexPacker <output.jtp> <textureDir>\n";
+		return 1;
+	}
+	std::string outPath = argv[1];
+	fs::path root = argv[2];
+
+	std::error_code ec;
+	if (!fs::is_directory(root, ec)) {
+		std::cout << root.string() << " is not a directory\n";
+		return 1;
+	}
+
+	std::vector<std::string> files;
+	for (const fs::directory_entry& e : fs::recursive_directory_iterator(root, ec)) {
+		if (e.is_regular_file() && isImage(e.path()))
+			files.push_back(fs::relative(e.path(), root).generic_string());
+	}
+	std::sort(files.begin(), files.end());
+
+	std::cout << "Packing " << files.size() << " images from " << root.string() << "\n";
+	return writeTexturePack(outPath, root.generic_string(), files) ? 0 : 1;
+}